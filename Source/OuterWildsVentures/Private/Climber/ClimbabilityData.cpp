@@ -0,0 +1,290 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Climber/ClimbabilityData.h"
+
+#include "Components/ModelComponent.h"
+#include "Components/StaticMeshComponent.h"
+#include "Engine/Level.h"
+#include "Engine/StaticMesh.h"
+#include "Engine/World.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogClimbability, Log, All);
+
+#if WITH_EDITOR
+#include "Engine/LevelBounds.h"
+#include "Misc/ScopedSlowTask.h"
+
+void UClimbabilityData::Bake()
+{
+	// Only a level open in the editor has its collision to query
+	UWorld* World = BakedLevel.Get();
+	if (!World)
+	{
+		UE_LOG(LogClimbability, Error, TEXT("Open %s in the editor to bake %s"), *BakedLevel.ToString(), *GetName());
+		return;
+	}
+
+	// Static geometry only. Anything movable is traced at runtime.
+	TArray<const UPrimitiveComponent*> Primitives;
+	GetStaticPrimitives(World->PersistentLevel, Primitives);
+
+	const FBox Bounds = BakeBounds.IsValid ? BakeBounds : ALevelBounds::CalculateLevelBounds(World->PersistentLevel);
+	if (!Bounds.IsValid || Primitives.Num() == 0)
+	{
+		UE_LOG(LogClimbability, Error, TEXT("Nothing to bake in %s"), *BakedLevel.ToString());
+		return;
+	}
+
+	// Baked apart and only kept once complete, so a cancelled bake leaves the previous one as it was
+	TSet<FIntVector> NewCells;
+
+	// Slightly larger than the cell, so geometry on a cell face is never left out of it
+	const FCollisionShape CellShape = FCollisionShape::MakeBox(FVector(CellSize / 2 + 1.f));
+
+	FScopedSlowTask SlowTask(Primitives.Num(), FText::FromString(FString::Printf(TEXT("Baking %s"), *GetName())));
+	SlowTask.MakeDialog(true);
+
+	// Most of a level is empty. Only cells within the bounds of a static primitive are tested, against that primitive.
+	for (const UPrimitiveComponent* Primitive : Primitives)
+	{
+		SlowTask.EnterProgressFrame();
+		if (SlowTask.ShouldCancel())
+		{
+			UE_LOG(LogClimbability, Display, TEXT("Cancelled baking %s. The previous bake is kept."), *GetName());
+			return;
+		}
+
+		const FBox PrimitiveBounds = Primitive->Bounds.GetBox().ExpandBy(1.f).Overlap(Bounds);
+		if (!PrimitiveBounds.IsValid)
+		{
+			continue;
+		}
+
+		const FIntVector MinCell = GetCellCoordinates(PrimitiveBounds.Min, CellSize);
+		const FIntVector MaxCell = GetCellCoordinates(PrimitiveBounds.Max, CellSize);
+		for (int32 X = MinCell.X; X <= MaxCell.X; X++)
+		{
+			for (int32 Y = MinCell.Y; Y <= MaxCell.Y; Y++)
+			{
+				for (int32 Z = MinCell.Z; Z <= MaxCell.Z; Z++)
+				{
+					const FIntVector Coordinates(X, Y, Z);
+					if (NewCells.Contains(Coordinates))
+					{
+						continue;
+					}
+
+					const FVector Center = (FVector(X, Y, Z) + 0.5) * CellSize;
+					if (Primitive->OverlapComponent(Center, FQuat::Identity, CellShape))
+					{
+						NewCells.Add(Coordinates);
+					}
+				}
+			}
+		}
+	}
+
+	Modify();
+	Cells = MoveTemp(NewCells);
+	Cells.Compact();
+	BakedBounds = Bounds;
+	BakedCellSize = CellSize;
+	BakedCollisionHash = HashStaticCollision(Primitives);
+	CheckedWorld = nullptr;
+	MarkPackageDirty();
+
+	UE_LOG(LogClimbability, Display, TEXT("Baked %d climbability cells of %s into %s"), Cells.Num(), *BakedLevel.ToString(), *GetName());
+}
+#endif
+
+bool UClimbabilityData::IsBakedFrom(const UWorld* World) const
+{
+	if (CheckedWorld.Get() == World)
+	{
+		return bCheckedWorldBaked;
+	}
+
+	CheckedWorld = World;
+	bCheckedWorldBaked = false;
+	if (!World || !World->PersistentLevel || !BakedBounds.IsValid)
+	{
+		return false;
+	}
+
+	if (World->GetStreamingLevels().Num() > 0)
+	{
+		UE_LOG(LogClimbability, Warning, TEXT("%s streams levels in, which %s does not cover. Ignoring it."), *World->GetName(), *GetName());
+		return false;
+	}
+
+	TArray<const UPrimitiveComponent*> Primitives;
+	GetStaticPrimitives(World->PersistentLevel, Primitives);
+	bCheckedWorldBaked = HashStaticCollision(Primitives) == BakedCollisionHash;
+	if (!bCheckedWorldBaked)
+	{
+		UE_LOG(LogClimbability, Warning, TEXT("Static collision of %s changed since %s was baked. Ignoring it until baked again."), *World->GetName(), *GetName());
+	}
+	return bCheckedWorldBaked;
+}
+
+bool UClimbabilityData::Contains(const FVector& Location) const
+{
+	return BakedBounds.IsValid && BakedBounds.IsInsideOrOn(Location);
+}
+
+EClimbabilityQuery UClimbabilityData::FindStaticGeometry(const FVector& Start, const FVector& End) const
+{
+	if (!Contains(Start) || !Contains(End))
+	{
+		return EClimbabilityQuery::OutOfBounds;
+	}
+
+	// Visit every cell the segment passes through, in order
+	const FVector Segment = End - Start;
+	FIntVector Coordinates = GetCellCoordinates(Start, BakedCellSize);
+	const FIntVector EndCoordinates = GetCellCoordinates(End, BakedCellSize);
+
+	FIntVector Step;
+	FVector NextBoundaryTime;
+	FVector BoundaryTimeStep;
+	for (int32 Axis = 0; Axis < 3; Axis++)
+	{
+		if (FMath::IsNearlyZero(Segment[Axis]))
+		{
+			Step[Axis] = 0;
+			NextBoundaryTime[Axis] = TNumericLimits<double>::Max();
+			BoundaryTimeStep[Axis] = TNumericLimits<double>::Max();
+			continue;
+		}
+
+		Step[Axis] = Segment[Axis] > 0 ? 1 : -1;
+		const double NextBoundary = (Coordinates[Axis] + (Step[Axis] > 0 ? 1 : 0)) * BakedCellSize;
+		NextBoundaryTime[Axis] = (NextBoundary - Start[Axis]) / Segment[Axis];
+		BoundaryTimeStep[Axis] = BakedCellSize / FMath::Abs(Segment[Axis]);
+	}
+
+	const FIntVector CellSpan = EndCoordinates - Coordinates;
+	const int32 MaxCells = FMath::Abs(CellSpan.X) + FMath::Abs(CellSpan.Y) + FMath::Abs(CellSpan.Z) + 1;
+	for (int32 CellIndex = 0; CellIndex < MaxCells; CellIndex++)
+	{
+		if (Cells.Contains(Coordinates))
+		{
+			return EClimbabilityQuery::Hit;
+		}
+
+		const int32 Axis = NextBoundaryTime.X < NextBoundaryTime.Y
+			? (NextBoundaryTime.X < NextBoundaryTime.Z ? 0 : 2)
+			: (NextBoundaryTime.Y < NextBoundaryTime.Z ? 1 : 2);
+		if (NextBoundaryTime[Axis] > 1.0)
+		{
+			break;
+		}
+		Coordinates[Axis] += Step[Axis];
+		NextBoundaryTime[Axis] += BoundaryTimeStep[Axis];
+	}
+
+	return EClimbabilityQuery::Miss;
+}
+
+EClimbabilityQuery UClimbabilityData::FindStaticGeometry(const FBox& Box) const
+{
+	if (!Contains(Box.Min) || !Contains(Box.Max))
+	{
+		return EClimbabilityQuery::OutOfBounds;
+	}
+
+	const FIntVector MinCell = GetCellCoordinates(Box.Min, BakedCellSize);
+	const FIntVector MaxCell = GetCellCoordinates(Box.Max, BakedCellSize);
+	for (int32 X = MinCell.X; X <= MaxCell.X; X++)
+	{
+		for (int32 Y = MinCell.Y; Y <= MaxCell.Y; Y++)
+		{
+			for (int32 Z = MinCell.Z; Z <= MaxCell.Z; Z++)
+			{
+				if (Cells.Contains(FIntVector(X, Y, Z)))
+				{
+					return EClimbabilityQuery::Hit;
+				}
+			}
+		}
+	}
+
+	return EClimbabilityQuery::Miss;
+}
+
+int32 UClimbabilityData::GetNumCells() const
+{
+	return Cells.Num();
+}
+
+void UClimbabilityData::GetStaticPrimitives(const ULevel* Level, TArray<const UPrimitiveComponent*>& OutPrimitives)
+{
+	// Editor only collision is stripped from cooked levels, so it is left out in the editor too
+	auto IsStaticBlocking = [](const UPrimitiveComponent* Primitive)
+	{
+		return Primitive && Primitive->IsRegistered() && !Primitive->IsEditorOnly() && Primitive->Mobility == EComponentMobility::Static &&
+			Primitive->IsQueryCollisionEnabled() && Primitive->GetCollisionResponseToChannel(ECC_WorldStatic) == ECR_Block;
+	};
+
+	for (const AActor* Actor : Level->Actors)
+	{
+		if (!Actor || Actor->IsEditorOnly())
+		{
+			continue;
+		}
+
+		TInlineComponentArray<const UPrimitiveComponent*> Components(Actor);
+		for (const UPrimitiveComponent* Primitive : Components)
+		{
+			if (IsStaticBlocking(Primitive))
+			{
+				OutPrimitives.Add(Primitive);
+			}
+		}
+	}
+
+	// BSP
+	for (const UModelComponent* ModelComponent : Level->ModelComponents)
+	{
+		if (IsStaticBlocking(ModelComponent))
+		{
+			OutPrimitives.Add(ModelComponent);
+		}
+	}
+}
+
+uint32 UClimbabilityData::HashStaticCollision(const TArray<const UPrimitiveComponent*>& Primitives)
+{
+	auto RoundToIntVector = [](const FVector& Vector)
+	{
+		return FIntVector(FMath::RoundToInt(Vector.X), FMath::RoundToInt(Vector.Y), FMath::RoundToInt(Vector.Z));
+	};
+
+	uint32 Hash = 0;
+	for (const UPrimitiveComponent* Primitive : Primitives)
+	{
+		const FBox Box = Primitive->Bounds.GetBox();
+		uint32 PrimitiveHash = HashCombine(GetTypeHash(RoundToIntVector(Box.Min)), GetTypeHash(RoundToIntVector(Box.Max)));
+
+		const UStaticMeshComponent* MeshComponent = Cast<UStaticMeshComponent>(Primitive);
+		if (MeshComponent && MeshComponent->GetStaticMesh())
+		{
+			PrimitiveHash = HashCombine(PrimitiveHash, GetTypeHash(MeshComponent->GetStaticMesh()->GetPathName()));
+		}
+
+		// Summed, so the order primitives are found in does not matter
+		Hash += PrimitiveHash;
+	}
+
+	// 0 is left for data baked before the hash was recorded
+	return Hash != 0 ? Hash : 1;
+}
+
+FIntVector UClimbabilityData::GetCellCoordinates(const FVector& Location, float InCellSize)
+{
+	return FIntVector(
+		FMath::FloorToInt(Location.X / InCellSize),
+		FMath::FloorToInt(Location.Y / InCellSize),
+		FMath::FloorToInt(Location.Z / InCellSize));
+}
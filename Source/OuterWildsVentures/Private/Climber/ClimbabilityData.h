@@ -0,0 +1,94 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/DataAsset.h"
+#include "ClimbabilityData.generated.h"
+
+// Answer of the baked data to a climb query
+enum class EClimbabilityQuery : uint8
+{
+	// Not baked here. Trace against everything.
+	OutOfBounds,
+	// Nothing static. Only dynamic objects need tracing.
+	Miss,
+	// Static geometry may be hit. Cells are too coarse to say where, so trace against everything.
+	Hit
+};
+
+/**
+ * Static geometry of one level, sampled into a sparse grid by an editor bake. Only which cells touch static collision
+ * is kept. Lets climbing skip static geometry in its traces wherever the grid shows there is none.
+ * The bake records a hash of the level's static collision. Data whose hash no longer matches the level, or baked
+ * before the hash was recorded, is ignored until baked again.
+ */
+UCLASS()
+class UClimbabilityData : public UDataAsset
+{
+	GENERATED_BODY()
+
+public:
+	// Level this data was baked from, and is used in
+	UPROPERTY(EditAnywhere, Category="Bake")
+	TSoftObjectPtr<UWorld> BakedLevel;
+
+	// Area to bake. Level bounds when left empty.
+	UPROPERTY(EditAnywhere, Category="Bake")
+	FBox BakeBounds = FBox(ForceInit);
+
+	// Grid cell size
+	UPROPERTY(EditAnywhere, Category="Bake", meta=(ClampMin="10.0", ClampMax="200.0"))
+	float CellSize = 50.f;
+
+#if WITH_EDITOR
+	// Sample static geometry of BakedLevel, which has to be open in the editor
+	UFUNCTION(CallInEditor, Category="Bake")
+	void Bake();
+#endif
+
+	// Whether the static collision of a world is the one baked. Worlds streaming levels in are never, as the bake only
+	// knows the persistent level.
+	bool IsBakedFrom(const UWorld* World) const;
+
+	// Whether a location was baked
+	bool Contains(const FVector& Location) const;
+
+	// Whether a segment passes through any cell touching static geometry
+	EClimbabilityQuery FindStaticGeometry(const FVector& Start, const FVector& End) const;
+
+	// Whether any cell a box overlaps touches static geometry, for sweeps
+	EClimbabilityQuery FindStaticGeometry(const FBox& Box) const;
+
+	// Number of baked cells
+	int32 GetNumCells() const;
+
+private:
+	static FIntVector GetCellCoordinates(const FVector& Location, float InCellSize);
+
+	// Static primitives of a level that block climb queries
+	static void GetStaticPrimitives(const ULevel* Level, TArray<const UPrimitiveComponent*>& OutPrimitives);
+
+	// Hash of the bounds and meshes of static primitives, independent of their order
+	static uint32 HashStaticCollision(const TArray<const UPrimitiveComponent*>& Primitives);
+
+	// Area that was baked
+	UPROPERTY(VisibleAnywhere, Category="Baked")
+	FBox BakedBounds = FBox(ForceInit);
+
+	// Cell size used when baking
+	UPROPERTY(VisibleAnywhere, Category="Baked")
+	float BakedCellSize = 50.f;
+
+	// Static collision of the level when baking. 0 for data baked before it was recorded.
+	UPROPERTY(VisibleAnywhere, Category="Baked")
+	uint32 BakedCollisionHash = 0;
+
+	// World last checked against the bake, and whether it matched
+	mutable TWeakObjectPtr<const UWorld> CheckedWorld;
+	mutable bool bCheckedWorldBaked = false;
+
+	// Cells touching static geometry. Cells not in the set are empty.
+	UPROPERTY()
+	TSet<FIntVector> Cells;
+};
@@ -3,11 +3,14 @@
 
 #include "Climber/Climber.h"
 
+#include "ClimberStats.h"
 #include "EnhancedInputComponent.h"
 #include "EnhancedInputSubsystems.h"
 #include "Camera/CameraComponent.h"
 #include "GameFramework/SpringArmComponent.h"
 
+DECLARE_CYCLE_STAT(TEXT("Climber Tick"), STAT_ClimberTick, STATGROUP_Climb);
+
 // Sets default values
 AClimber::AClimber(const FObjectInitializer& ObjectInitializer)
 	:Super(ObjectInitializer.SetDefaultSubobjectClass<UClimberCMC>(ACharacter::CharacterMovementComponentName))
@@ -46,6 +49,8 @@ void AClimber::BeginPlay()
 
 void AClimber::Tick(float DeltaSeconds)
 {
+	SCOPE_CYCLE_COUNTER(STAT_ClimberTick);
+
 	Super::Tick(DeltaSeconds);
 }
 
@@ -3,8 +3,25 @@
 
 #include "Climber/ClimberCMC.h"
 
+#include "ClimberStats.h"
 #include "Components/CapsuleComponent.h"
 #include "GameFramework/Character.h"
+#include "Query/QueryBudgetSubsystem.h"
+
+DECLARE_CYCLE_STAT(TEXT("ClimberCMC Tick"), STAT_ClimberCMCTick, STATGROUP_Climb);
+DECLARE_CYCLE_STAT(TEXT("SweepAndStoreWallHits"), STAT_ClimbSweepAndStoreWallHits, STATGROUP_Climb);
+DECLARE_CYCLE_STAT(TEXT("CanStartClimbing"), STAT_ClimbCanStartClimbing, STATGROUP_Climb);
+DECLARE_CYCLE_STAT(TEXT("PhysClimbing"), STAT_ClimbPhysClimbing, STATGROUP_Climb);
+DECLARE_CYCLE_STAT(TEXT("ComputeSurfaceInfo"), STAT_ClimbComputeSurfaceInfo, STATGROUP_Climb);
+DECLARE_CYCLE_STAT(TEXT("ClimbDownToFloor"), STAT_ClimbClimbDownToFloor, STATGROUP_Climb);
+DECLARE_CYCLE_STAT(TEXT("MoveAlongClimbingSurface"), STAT_ClimbMoveAlongClimbingSurface, STATGROUP_Climb);
+DECLARE_CYCLE_STAT(TEXT("SnapToClimbingSurface"), STAT_ClimbSnapToClimbingSurface, STATGROUP_Climb);
+
+static TAutoConsoleVariable<bool> CVarClimbNetShowCorrections(
+	TEXT("climb.Net.ShowCorrections"),
+	false,
+	TEXT("Show on screen how many times the server has corrected the local climber's moves."),
+	ECVF_Cheat);
 
 UClimberCMC::UClimberCMC(const FObjectInitializer& ObjectInitializer)
 {
@@ -19,18 +36,57 @@ void UClimberCMC::BeginPlay()
 	AnimInstance = GetCharacterOwner()->GetMesh()->GetAnimInstance();
 	
 	ClimbQueryParams.AddIgnoredActor(GetOwner());
+
+	ClimbDynamicQueryParams = ClimbQueryParams;
+	ClimbDynamicQueryParams.MobilityType = EQueryMobilityType::Dynamic;
+
+	const FString LevelPackageName = UWorld::RemovePIEPrefix(GetWorld()->GetPackage()->GetName());
+	for (UClimbabilityData* Data : ClimbabilityData)
+	{
+		if (Data && Data->BakedLevel.ToSoftObjectPath().GetLongPackageName() == LevelPackageName && Data->IsBakedFrom(GetWorld()))
+		{
+			LevelClimbabilityData = Data;
+			break;
+		}
+	}
 }
 
 void UClimberCMC::TickComponent(float DeltaTime, ELevelTick TickType,
                                                   FActorComponentTickFunction* ThisTickFunction)
 {
+	SCOPE_CYCLE_COUNTER(STAT_ClimberCMCTick);
+
 	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
 
-	SweepAndStoreWallHits();
+	if (ShouldSweepWallHits())
+	{
+		SweepAndStoreWallHits();
+	}
+	else
+	{
+		INC_DWORD_STAT(STAT_ClimbWallSweepsSkipped);
+	}
+}
+
+bool UClimberCMC::ShouldSweepWallHits() const
+{
+	if (!bHasWallSweep || IsClimbing() || bWantsToClimb)
+	{
+		return true;
+	}
+
+	// Walls around a climber standing still are the ones already found
+	const FVector Location = UpdatedComponent->GetComponentLocation();
+	const FQuat Rotation = UpdatedComponent->GetComponentQuat();
+	
+	return FVector::DistSquared(Location, LastWallSweepLocation) > FMath::Square(WallSweepDistanceThreshold) ||
+		FMath::RadiansToDegrees(Rotation.AngularDistance(LastWallSweepRotation)) > WallSweepDegreesThreshold;
 }
 
 void UClimberCMC::SweepAndStoreWallHits()
 {
+	SCOPE_CYCLE_COUNTER(STAT_ClimbSweepAndStoreWallHits);
+
 	const FCollisionShape CollisionShape = FCollisionShape::MakeCapsule(CollisionCapsuleRadius, CollisionCapsuleHalfHeight);
 
 	const FVector StartOffset = UpdatedComponent->GetForwardVector() * 20;
@@ -39,15 +95,42 @@ void UClimberCMC::SweepAndStoreWallHits()
 	const FVector Start = UpdatedComponent->GetComponentLocation() + StartOffset;
 	const FVector End = Start + UpdatedComponent->GetForwardVector();
 
+	// Out of wall sweeps for this frame. Keep the walls found last.
+	if (UQueryBudgetSubsystem::GetRemainingBudget(GetWorld(), EQueryDebugCategory::ClimbWall, this) <= 0)
+	{
+		return;
+	}
+
+	// With no static geometry baked around the sweep, only dynamic objects are left to sweep
+	const FCollisionQueryParams* Params = &ClimbQueryParams;
+	if (LevelClimbabilityData)
+	{
+		FBox SweepBounds(ForceInit);
+		SweepBounds += Start;
+		SweepBounds += End;
+		if (LevelClimbabilityData->FindStaticGeometry(SweepBounds.ExpandBy(CollisionShape.GetExtent())) == EClimbabilityQuery::Miss)
+		{
+			INC_DWORD_STAT(STAT_ClimbBakedQueries);
+			Params = &ClimbDynamicQueryParams;
+		}
+	}
+
 	TArray<FHitResult> Hits;
-	const bool HitWall = GetWorld()->SweepMultiByChannel(Hits, Start, End, FQuat::Identity,
-		  ECC_WorldStatic, CollisionShape, ClimbQueryParams);
+	INC_DWORD_STAT(STAT_ClimbSweeps);
+	const bool HitWall = UQueryBudgetSubsystem::SweepMulti(GetWorld(), EQueryDebugCategory::ClimbWall, this, Hits, Start, End, FQuat::Identity,
+		  ECC_WorldStatic, CollisionShape, *Params);
+
+	HitWall ? CurrentWallHits = MoveTemp(Hits) : CurrentWallHits.Reset();
 
-	HitWall ? CurrentWallHits = Hits : CurrentWallHits.Reset();
+	bHasWallSweep = true;
+	LastWallSweepLocation = UpdatedComponent->GetComponentLocation();
+	LastWallSweepRotation = UpdatedComponent->GetComponentQuat();
 }
 
 bool UClimberCMC::CanStartClimbing()
 {
+	SCOPE_CYCLE_COUNTER(STAT_ClimbCanStartClimbing);
+
 	for (FHitResult& Hit : CurrentWallHits)
 	{
 		const FVector HorizontalNormal = Hit.Normal.GetSafeNormal2D();
@@ -87,7 +170,38 @@ bool UClimberCMC::EyeHeightTrace(const float TraceDistance) const
 	const FVector Start = UpdatedComponent->GetComponentLocation() + UpdatedComponent->GetUpVector() * EyeHeightOffset;
 	const FVector End = Start + (UpdatedComponent->GetForwardVector() * TraceDistance);
 
-	return GetWorld()->LineTraceSingleByChannel(UpperEdgeHit, Start, End, ECC_WorldStatic, ClimbQueryParams);
+	// With no static geometry baked along the trace, only dynamic objects are left to trace
+	const FCollisionQueryParams* Params = &ClimbQueryParams;
+	if (LevelClimbabilityData && LevelClimbabilityData->FindStaticGeometry(Start, End) == EClimbabilityQuery::Miss)
+	{
+		INC_DWORD_STAT(STAT_ClimbBakedQueries);
+		Params = &ClimbDynamicQueryParams;
+	}
+
+	INC_DWORD_STAT(STAT_ClimbLineTraces);
+	const bool bHit = UQueryBudgetSubsystem::LineTraceSingle(GetWorld(), EQueryDebugCategory::ClimbProbe, this, UpperEdgeHit, Start, End, ECC_WorldStatic, *Params);
+
+	return bHit;
+}
+
+void UClimberCMC::UpdateFromCompressedFlags(uint8 Flags)
+{
+	Super::UpdateFromCompressedFlags(Flags);
+
+	bWantsToClimb = (Flags & FSavedMove_Character::FLAG_Custom_0) != 0;
+	bWantsToClimbDash = (Flags & FSavedMove_Character::FLAG_Custom_1) != 0;
+}
+
+void UClimberCMC::UpdateCharacterStateBeforeMovement(float DeltaSeconds)
+{
+	// Started inside the move, so the server starts the dash on the same move as the client
+	if (bWantsToClimbDash)
+	{
+		bWantsToClimbDash = false;
+		StartClimbDashing();
+	}
+
+	Super::UpdateCharacterStateBeforeMovement(DeltaSeconds);
 }
 
 void UClimberCMC::OnMovementUpdated(float DeltaSeconds, const FVector& OldLocation, const FVector& OldVelocity)
@@ -105,6 +219,9 @@ void UClimberCMC::OnMovementModeChanged(EMovementMode PreviousMovementMode, uint
 	if (IsClimbing())
 	{
 		bOrientRotationToMovement = false;
+
+		// Surface smoothing starts over from the first probes of this climb
+		CurrentClimbingNormal = FVector::ZeroVector;
 	
 		UCapsuleComponent* Capsule = CharacterOwner->GetCapsuleComponent();
 		Capsule->SetCapsuleHalfHeight(Capsule->GetUnscaledCapsuleHalfHeight() - ClimbingCollisionShrinkAmount);
@@ -162,12 +279,14 @@ void UClimberCMC::UpdateClimbDashState(float deltaTime)
 
 void UClimberCMC::PhysClimbing(float deltaTime, int32 Iterations)
 {
+	SCOPE_CYCLE_COUNTER(STAT_ClimbPhysClimbing);
+
 	if (deltaTime < MIN_TICK_TIME)
 	{
 		return;
 	}
 
-	ComputeSurfaceInfo();
+	ComputeSurfaceInfo(deltaTime);
 	
 	if (ShouldStopClimbing() || ClimbDownToFloor())
 	{
@@ -193,33 +312,100 @@ void UClimberCMC::PhysClimbing(float deltaTime, int32 Iterations)
 	SnapToClimbingSurface(deltaTime);
 }
 
-void UClimberCMC::ComputeSurfaceInfo()
+void UClimberCMC::ComputeSurfaceInfo(float deltaTime)
 {
-	CurrentClimbingNormal = FVector::ZeroVector;
-	CurrentClimbingPosition = FVector::ZeroVector;
+	SCOPE_CYCLE_COUNTER(STAT_ClimbComputeSurfaceInfo);
+
+	// Out of surface probes for this frame. Keep the surface found last.
+	const int32 SurfaceProbeBudget = UQueryBudgetSubsystem::GetRemainingBudget(GetWorld(), EQueryDebugCategory::ClimbSurface, this);
+	if (SurfaceProbeBudget <= 0 && !CurrentWallHits.IsEmpty())
+	{
+		return;
+	}
 
 	if (CurrentWallHits.IsEmpty())
 	{
+		CurrentClimbingNormal = FVector::ZeroVector;
+		CurrentClimbingPosition = FVector::ZeroVector;
 		return;
 	}
 	
 	const FVector Start = UpdatedComponent->GetComponentLocation();
 	const FCollisionShape CollisionSphere = FCollisionShape::MakeSphere(6);
+
+	// Wall hits on the same face would only probe it again
+	const float DuplicateDot = FMath::Cos(FMath::DegreesToRadians(SurfaceProbeDuplicateDegrees));
+	TArray<const FHitResult*, TInlineAllocator<8>> ProbeHits;
+	for (const FHitResult& Hit : CurrentWallHits)
+	{
+		const bool bDuplicate = ProbeHits.ContainsByPredicate([&Hit, DuplicateDot](const FHitResult* ProbeHit)
+		{
+			if (ProbeHit->Component != Hit.Component)
+			{
+				return false;
+			}
+			return Hit.FaceIndex != INDEX_NONE ? ProbeHit->FaceIndex == Hit.FaceIndex : FVector::DotProduct(ProbeHit->Normal, Hit.Normal) >= DuplicateDot;
+		});
+
+		if (!bDuplicate)
+		{
+			ProbeHits.Add(&Hit);
+		}
+	}
+
+	// Same number of probes however many primitives the capsule touches. The nearest faces shape the surface most.
+	if (ProbeHits.Num() > SurfaceProbeCount)
+	{
+		ProbeHits.Sort([&Start](const FHitResult& A, const FHitResult& B)
+		{
+			return FVector::DistSquared(A.ImpactPoint, Start) < FVector::DistSquared(B.ImpactPoint, Start);
+		});
+		ProbeHits.SetNum(SurfaceProbeCount);
+	}
+
+	// Over budget, the surface is averaged over the first probes only
+	const int32 ProbeCount = FMath::Min(ProbeHits.Num(), SurfaceProbeBudget);
+
+	FVector ProbedPosition = FVector::ZeroVector;
+	FVector ProbedNormal = FVector::ZeroVector;
+	int32 ProbedHitCount = 0;
 	
-	for (const FHitResult& WallHit : CurrentWallHits)
+	for (int32 ProbeIndex = 0; ProbeIndex < ProbeCount; ProbeIndex++)
 	{
-		const FVector End = Start + (WallHit.ImpactPoint - Start).GetSafeNormal() * 120;
+		const FVector End = Start + (ProbeHits[ProbeIndex]->ImpactPoint - Start).GetSafeNormal() * 120;
 		
 		FHitResult AssistHit;
-		GetWorld()->SweepSingleByChannel(AssistHit, Start, End, FQuat::Identity,
-		                                 ECC_WorldStatic, CollisionSphere, ClimbQueryParams);
-		
-		CurrentClimbingPosition += AssistHit.Location;
-		CurrentClimbingNormal += AssistHit.Normal;
+		INC_DWORD_STAT(STAT_ClimbSweeps);
+		if (UQueryBudgetSubsystem::SweepSingle(GetWorld(), EQueryDebugCategory::ClimbSurface, this, AssistHit, Start, End, FQuat::Identity,
+		                                     ECC_WorldStatic, CollisionSphere, ClimbQueryParams))
+		{
+			ProbedPosition += AssistHit.Location;
+			ProbedNormal += AssistHit.Normal;
+			ProbedHitCount++;
+		}
 	}
-	
-	CurrentClimbingPosition /= CurrentWallHits.Num();
-	CurrentClimbingNormal = CurrentClimbingNormal.GetSafeNormal();
+
+	if (ProbedHitCount == 0)
+	{
+		CurrentClimbingNormal = FVector::ZeroVector;
+		CurrentClimbingPosition = FVector::ZeroVector;
+		return;
+	}
+
+	ProbedPosition /= ProbedHitCount;
+	ProbedNormal = ProbedNormal.GetSafeNormal();
+
+	// Smoothed over frames, so the surface does not jump as the few probes move from face to face
+	if (SurfaceSmoothingSpeed <= 0.f || CurrentClimbingNormal.IsZero())
+	{
+		CurrentClimbingPosition = ProbedPosition;
+		CurrentClimbingNormal = ProbedNormal;
+		return;
+	}
+
+	const float SmoothingAlpha = 1.f - FMath::Exp(-SurfaceSmoothingSpeed * deltaTime);
+	CurrentClimbingPosition = FMath::Lerp(CurrentClimbingPosition, ProbedPosition, SmoothingAlpha);
+	CurrentClimbingNormal = FMath::Lerp(CurrentClimbingNormal, ProbedNormal, SmoothingAlpha).GetSafeNormal(UE_SMALL_NUMBER, ProbedNormal);
 }
 
 bool UClimberCMC::ShouldStopClimbing() const
@@ -240,6 +426,8 @@ void UClimberCMC::StopClimbing(float deltaTime, int32 Iterations)
 
 bool UClimberCMC::ClimbDownToFloor() const
 {
+	SCOPE_CYCLE_COUNTER(STAT_ClimbClimbDownToFloor);
+
 	FHitResult FloorHit;
 	if (!CheckFloor(FloorHit))
 	{
@@ -261,7 +449,18 @@ bool UClimberCMC::CheckFloor(FHitResult& FloorHit) const
 	const FVector Start = UpdatedComponent->GetComponentLocation() + (UpdatedComponent->GetUpVector() * - 20);
 	const FVector End = Start + FVector::DownVector * FloorCheckDistance;
 
-	return GetWorld()->LineTraceSingleByChannel(FloorHit, Start, End, ECC_WorldStatic, ClimbQueryParams);
+	// With no static geometry baked below, only dynamic objects are left to trace
+	const FCollisionQueryParams* Params = &ClimbQueryParams;
+	if (LevelClimbabilityData && LevelClimbabilityData->FindStaticGeometry(Start, End) == EClimbabilityQuery::Miss)
+	{
+		INC_DWORD_STAT(STAT_ClimbBakedQueries);
+		Params = &ClimbDynamicQueryParams;
+	}
+
+	INC_DWORD_STAT(STAT_ClimbLineTraces);
+	const bool bHit = UQueryBudgetSubsystem::LineTraceSingle(GetWorld(), EQueryDebugCategory::ClimbProbe, this, FloorHit, Start, End, ECC_WorldStatic, *Params);
+
+	return bHit;
 }
 
 /*
@@ -363,6 +562,8 @@ float UClimberCMC::GetMaxAcceleration() const
 
 void UClimberCMC::MoveAlongClimbingSurface(float deltaTime)
 {
+	SCOPE_CYCLE_COUNTER(STAT_ClimbMoveAlongClimbingSurface);
+
 	const FVector Adjusted = Velocity * deltaTime;
 	
 	FHitResult Hit(1.f);
@@ -416,6 +617,8 @@ bool UClimberCMC::TryClimbUpLedge() const
 
 void UClimberCMC::SnapToClimbingSurface(float deltaTime) const
 {
+	SCOPE_CYCLE_COUNTER(STAT_ClimbSnapToClimbingSurface);
+
 	const FVector Forward = UpdatedComponent->GetForwardVector();
 	const FVector Location = UpdatedComponent->GetComponentLocation();
 	const FQuat Rotation = UpdatedComponent->GetComponentQuat();
@@ -432,6 +635,9 @@ void UClimberCMC::SnapToClimbingSurface(float deltaTime) const
 
 void UClimberCMC::TryClimbing()
 {
+	// Walls may have moved since the last sweep even if the climber has not. Only the per tick sweep is skipped.
+	SweepAndStoreWallHits();
+
 	if (CanStartClimbing())
 	{
 		bWantsToClimb = true;
@@ -439,6 +645,14 @@ void UClimberCMC::TryClimbing()
 }
 
 void UClimberCMC::TryClimbDashing()
+{
+	if (ClimbDashCurve && bIsClimbDashing == false)
+	{
+		bWantsToClimbDash = true;
+	}
+}
+
+void UClimberCMC::StartClimbDashing()
 {
 	if (ClimbDashCurve && bIsClimbDashing == false)
 	{
@@ -484,3 +698,122 @@ bool UClimberCMC::IsClimbDashing() const
 {
 	return IsClimbing() && bIsClimbDashing;
 }
+
+int32 UClimberCMC::GetNetCorrectionCount() const
+{
+	return NetCorrectionCount;
+}
+
+void UClimberCMC::OnClientCorrectionReceived(FNetworkPredictionData_Client_Character& ClientData, float TimeStamp, FVector NewLocation, FVector NewVelocity,
+	UPrimitiveComponent* NewBase, FName NewBaseBoneName, bool bHasBase, bool bBaseRelativePosition, uint8 ServerMovementMode)
+{
+	NetCorrectionCount++;
+	if (CVarClimbNetShowCorrections.GetValueOnGameThread() && GEngine)
+	{
+		GEngine->AddOnScreenDebugMessage(reinterpret_cast<uint64>(this), 1.0f, FColor::Orange,
+			FString::Printf(TEXT("%s: %d corrections, last %.1f"), *GetOwner()->GetName(), NetCorrectionCount, FVector::Dist(NewLocation, UpdatedComponent->GetComponentLocation())));
+	}
+
+	Super::OnClientCorrectionReceived(ClientData, TimeStamp, NewLocation, NewVelocity, NewBase, NewBaseBoneName, bHasBase, bBaseRelativePosition, ServerMovementMode);
+}
+
+FNetworkPredictionData_Client* UClimberCMC::GetPredictionData_Client() const
+{
+	if (ClientPredictionData == nullptr)
+	{
+		UClimberCMC* MutableThis = const_cast<UClimberCMC*>(this);
+		MutableThis->ClientPredictionData = new FNetworkPredictionData_Client_Climber(*this);
+	}
+
+	return ClientPredictionData;
+}
+
+void UClimberCMC::FSavedMove_Climber::Clear()
+{
+	Super::Clear();
+
+	bSavedWantsToClimb = false;
+	bSavedWantsToClimbDash = false;
+	bSavedIsClimbDashing = false;
+	SavedClimbDashTime = 0.f;
+	SavedClimbDashDirection = FVector::ZeroVector;
+	SavedClimbingPosition = FVector::ZeroVector;
+	SavedClimbingNormal = FVector::ZeroVector;
+}
+
+uint8 UClimberCMC::FSavedMove_Climber::GetCompressedFlags() const
+{
+	uint8 Flags = Super::GetCompressedFlags();
+
+	if (bSavedWantsToClimb)
+	{
+		Flags |= FLAG_Custom_0;
+	}
+
+	if (bSavedWantsToClimbDash)
+	{
+		Flags |= FLAG_Custom_1;
+	}
+
+	return Flags;
+}
+
+bool UClimberCMC::FSavedMove_Climber::CanCombineWith(const FSavedMovePtr& NewMove, ACharacter* InCharacter, float MaxDelta) const
+{
+	const FSavedMove_Climber* NewClimberMove = static_cast<const FSavedMove_Climber*>(NewMove.Get());
+
+	if (bSavedWantsToClimb != NewClimberMove->bSavedWantsToClimb || bSavedWantsToClimbDash || NewClimberMove->bSavedWantsToClimbDash)
+	{
+		return false;
+	}
+
+	// Dash speed follows a curve, which one long move would sample differently from two short ones
+	if (bSavedIsClimbDashing || NewClimberMove->bSavedIsClimbDashing)
+	{
+		return false;
+	}
+
+	return Super::CanCombineWith(NewMove, InCharacter, MaxDelta);
+}
+
+void UClimberCMC::FSavedMove_Climber::SetMoveFor(ACharacter* C, float InDeltaTime, FVector const& NewAccel, FNetworkPredictionData_Client_Character& ClientData)
+{
+	Super::SetMoveFor(C, InDeltaTime, NewAccel, ClientData);
+
+	if (const UClimberCMC* ClimberMovement = Cast<UClimberCMC>(C->GetCharacterMovement()))
+	{
+		bSavedWantsToClimb = ClimberMovement->bWantsToClimb;
+		bSavedWantsToClimbDash = ClimberMovement->bWantsToClimbDash;
+		bSavedIsClimbDashing = ClimberMovement->bIsClimbDashing;
+		SavedClimbDashTime = ClimberMovement->CurrentClimbDashTime;
+		SavedClimbDashDirection = ClimberMovement->ClimbDashDirection;
+		SavedClimbingPosition = ClimberMovement->CurrentClimbingPosition;
+		SavedClimbingNormal = ClimberMovement->CurrentClimbingNormal;
+	}
+}
+
+void UClimberCMC::FSavedMove_Climber::PrepMoveFor(ACharacter* C)
+{
+	Super::PrepMoveFor(C);
+
+	if (UClimberCMC* ClimberMovement = Cast<UClimberCMC>(C->GetCharacterMovement()))
+	{
+		ClimberMovement->bWantsToClimb = bSavedWantsToClimb;
+		ClimberMovement->bWantsToClimbDash = bSavedWantsToClimbDash;
+		ClimberMovement->bIsClimbDashing = bSavedIsClimbDashing;
+		ClimberMovement->CurrentClimbDashTime = SavedClimbDashTime;
+		ClimberMovement->ClimbDashDirection = SavedClimbDashDirection;
+		ClimberMovement->CurrentClimbingPosition = SavedClimbingPosition;
+		ClimberMovement->CurrentClimbingNormal = SavedClimbingNormal;
+	}
+}
+
+UClimberCMC::FNetworkPredictionData_Client_Climber::FNetworkPredictionData_Client_Climber(const UCharacterMovementComponent& ClientMovement)
+	: Super(ClientMovement)
+{
+}
+
+FSavedMovePtr UClimberCMC::FNetworkPredictionData_Client_Climber::AllocateNewMove()
+{
+	return FSavedMovePtr(new FSavedMove_Climber());
+}
@@ -4,6 +4,7 @@
 
 #include "CoreMinimal.h"
 #include "GameFramework/CharacterMovementComponent.h"
+#include "ClimbabilityData.h"
 #include "ClimberCMC.generated.h"
 
 /**
@@ -21,6 +22,50 @@ UCLASS()
 class UClimberCMC : public UCharacterMovementComponent
 {
 	GENERATED_BODY()
+
+	// Climb and climb dash intent, saved with each move so the server runs and the client replays the same move
+	class FSavedMove_Climber : public FSavedMove_Character
+	{
+	public:
+		typedef FSavedMove_Character Super;
+
+		virtual void Clear() override;
+
+		virtual uint8 GetCompressedFlags() const override;
+
+		virtual bool CanCombineWith(const FSavedMovePtr& NewMove, ACharacter* InCharacter, float MaxDelta) const override;
+
+		virtual void SetMoveFor(ACharacter* C, float InDeltaTime, FVector const& NewAccel, FNetworkPredictionData_Client_Character& ClientData) override;
+
+		virtual void PrepMoveFor(ACharacter* C) override;
+
+	private:
+		uint8 bSavedWantsToClimb : 1;
+
+		uint8 bSavedWantsToClimbDash : 1;
+
+		// Climb dash in progress when the move started, to replay it from the same point
+		uint8 bSavedIsClimbDashing : 1;
+
+		float SavedClimbDashTime = 0.f;
+
+		FVector SavedClimbDashDirection = FVector::ZeroVector;
+
+		// Smoothed climbing surface when the move started, so a replayed move smooths from the same surface
+		FVector SavedClimbingPosition = FVector::ZeroVector;
+
+		FVector SavedClimbingNormal = FVector::ZeroVector;
+	};
+
+	class FNetworkPredictionData_Client_Climber : public FNetworkPredictionData_Client_Character
+	{
+	public:
+		typedef FNetworkPredictionData_Client_Character Super;
+
+		FNetworkPredictionData_Client_Climber(const UCharacterMovementComponent& ClientMovement);
+
+		virtual FSavedMovePtr AllocateNewMove() override;
+	};
 	
 public:
 	UClimberCMC(const FObjectInitializer& ObjectInitializer);
@@ -46,6 +91,12 @@ public:
 	UFUNCTION(BlueprintCallable)
 	void CancelClimbing();
 
+	// Server corrections to this client's moves since play began
+	UFUNCTION(BlueprintPure)
+	int32 GetNetCorrectionCount() const;
+
+	virtual FNetworkPredictionData_Client* GetPredictionData_Client() const override;
+
 private:
 	UPROPERTY(Category="Character Movement: Climbing", EditAnywhere)
 	int CollisionCapsuleRadius = 50;
@@ -80,6 +131,30 @@ private:
 	UPROPERTY(Category="Character Movement: Climbing", EditAnywhere, meta=(ClampMin="1.0", ClampMax="75.0"))
 	float MinHorizontalDegreesToStartClimbing = 25;
 
+	// Out of climbing, wall sweeps are skipped until the climber moves further than this from the last one
+	UPROPERTY(Category="Character Movement: Climbing", EditAnywhere, meta=(ClampMin="0.0", ClampMax="100.0"))
+	float WallSweepDistanceThreshold = 5.f;
+
+	// Out of climbing, wall sweeps are skipped until the climber turns further than this from the last one
+	UPROPERTY(Category="Character Movement: Climbing", EditAnywhere, meta=(ClampMin="0.0", ClampMax="90.0"))
+	float WallSweepDegreesThreshold = 3.f;
+
+	// Most surface probes swept per climbing frame, towards the nearest distinct wall hits
+	UPROPERTY(Category="Character Movement: Climbing", EditAnywhere, meta=(ClampMin="1", ClampMax="8"))
+	int SurfaceProbeCount = 3;
+
+	// Wall hits on the same component with normals closer than this many degrees are probed once
+	UPROPERTY(Category="Character Movement: Climbing", EditAnywhere, meta=(ClampMin="0.0", ClampMax="45.0"))
+	float SurfaceProbeDuplicateDegrees = 10.f;
+
+	// How quickly the climbing surface follows the probes. 0 takes the probes as they are.
+	UPROPERTY(Category="Character Movement: Climbing", EditAnywhere, meta=(ClampMin="0.0", ClampMax="60.0"))
+	float SurfaceSmoothingSpeed = 15.f;
+
+	// Baked climbability of levels. Climb queries in a level with data go to it before tracing.
+	UPROPERTY(Category="Character Movement: Climbing", EditDefaultsOnly)
+	TArray<UClimbabilityData*> ClimbabilityData;
+
 	UPROPERTY(Category="Character Movement: Climbing", EditDefaultsOnly)
 	UAnimMontage* LedgeClimbMontage;
 
@@ -93,8 +168,25 @@ private:
 
 	FCollisionQueryParams ClimbQueryParams;
 
+	// Climbability data baked for the current level, if any
+	UPROPERTY()
+	UClimbabilityData* LevelClimbabilityData;
+
+	// Queries for what baked climbability data leaves out
+	FCollisionQueryParams ClimbDynamicQueryParams;
+
+	// Pose of the last wall sweep. CurrentWallHits are reused while the climber stays close to it.
+	bool bHasWallSweep = false;
+
+	FVector LastWallSweepLocation;
+
+	FQuat LastWallSweepRotation;
+
 	bool bWantsToClimb = false;
 
+	// Climb dash requested, started on the next move
+	bool bWantsToClimbDash = false;
+
 	bool bIsClimbDashing = false;
 
 	float CurrentClimbDashTime;
@@ -105,12 +197,21 @@ private:
 	
 	FVector CurrentClimbingPosition;
 
+	int32 NetCorrectionCount = 0;
+
 private:
 	virtual void BeginPlay() override;
 
 	virtual void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
 
+	virtual void UpdateFromCompressedFlags(uint8 Flags) override;
+
+	virtual void UpdateCharacterStateBeforeMovement(float DeltaSeconds) override;
+
 	virtual void OnMovementUpdated(float DeltaSeconds, const FVector& OldLocation, const FVector& OldVelocity) override;
+
+	virtual void OnClientCorrectionReceived(FNetworkPredictionData_Client_Character& ClientData, float TimeStamp, FVector NewLocation, FVector NewVelocity,
+		UPrimitiveComponent* NewBase, FName NewBaseBoneName, bool bHasBase, bool bBaseRelativePosition, uint8 ServerMovementMode) override;
 	
 	virtual void OnMovementModeChanged(EMovementMode PreviousMovementMode, uint8 PreviousCustomMode) override;
 	
@@ -150,6 +251,8 @@ private:
 	
 	void StopClimbing(float deltaTime, int32 Iterations);
 	
+	void StartClimbDashing();
+
 	void AlignClimbDashDirection();
 
 	void StoreClimbDashDirection();
@@ -162,8 +265,11 @@ private:
 
 	void SnapToClimbingSurface(float deltaTime) const;
 	
-	void ComputeSurfaceInfo();
+	void ComputeSurfaceInfo(float deltaTime);
 	
+	// Whether the tick sweeps for walls. The climber moved or turned enough since the last sweep, or is climbing.
+	bool ShouldSweepWallHits() const;
+
 	void SweepAndStoreWallHits();
 };
 
@@ -0,0 +1,9 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Climber/ClimberStats.h"
+
+DEFINE_STAT(STAT_ClimbLineTraces);
+DEFINE_STAT(STAT_ClimbSweeps);
+DEFINE_STAT(STAT_ClimbWallSweepsSkipped);
+DEFINE_STAT(STAT_ClimbBakedQueries);
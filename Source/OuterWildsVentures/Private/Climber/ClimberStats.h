@@ -0,0 +1,19 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Stats/Stats.h"
+
+// stat Climb
+DECLARE_STATS_GROUP(TEXT("Climb"), STATGROUP_Climb, STATCAT_Advanced);
+
+// Per frame counts of scene queries issued by climbing code
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Line traces"), STAT_ClimbLineTraces, STATGROUP_Climb, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Sweeps"), STAT_ClimbSweeps, STATGROUP_Climb, );
+
+// Per frame count of wall sweeps skipped because the climber had not moved since the last one
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Wall sweeps skipped"), STAT_ClimbWallSweepsSkipped, STATGROUP_Climb, );
+
+// Per frame count of climb traces that skipped static geometry thanks to baked climbability data
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Queries skipping static geometry"), STAT_ClimbBakedQueries, STATGROUP_Climb, );
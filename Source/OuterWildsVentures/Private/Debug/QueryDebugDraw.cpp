@@ -0,0 +1,188 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Debug/QueryDebugDraw.h"
+
+#if ENABLE_DRAW_DEBUG
+
+#include "DrawDebugHelpers.h"
+#include "Engine/HitResult.h"
+#include "Engine/World.h"
+
+namespace QueryDebugDraw
+{
+	static TAutoConsoleVariable<bool> CVarSkateLanding(TEXT("skate.Debug.Landing"), false, TEXT("Draw recent landing prediction traces."));
+	static TAutoConsoleVariable<bool> CVarSkateGround(TEXT("skate.Debug.Ground"), false, TEXT("Draw recent ground condition probes."));
+	static TAutoConsoleVariable<bool> CVarSkateGrind(TEXT("skate.Debug.Grind"), false, TEXT("Draw recent grind detection traces."));
+	static TAutoConsoleVariable<bool> CVarClimbWall(TEXT("climb.Debug.Wall"), false, TEXT("Draw recent climbing wall sweeps."));
+	static TAutoConsoleVariable<bool> CVarClimbSurface(TEXT("climb.Debug.Surface"), false, TEXT("Draw recent climbing surface probes."));
+	static TAutoConsoleVariable<bool> CVarClimbProbe(TEXT("climb.Debug.Probe"), false, TEXT("Draw recent eye height and floor traces."));
+	static TAutoConsoleVariable<float> CVarLifetime(TEXT("query.Debug.Lifetime"), 1.0f, TEXT("Seconds a recorded skate or climb query stays on screen."));
+
+	enum class EShape : uint8
+	{
+		Line,
+		Sphere,
+		Capsule
+	};
+
+	struct FEntry
+	{
+		// World the query ran in. Only compared against, never dereferenced.
+		const UWorld* World;
+		double WorldTime;
+		FVector Start;
+		FVector End;
+		FVector HitLocation;
+		FVector HitNormal;
+		float Radius;
+		float HalfHeight;
+		EShape Shape;
+		EQueryDebugCategory Category;
+		bool bHit;
+	};
+
+	// Oldest entries are overwritten once the buffer is full.
+	constexpr int32 Capacity = 512;
+	static FEntry Entries[Capacity];
+	static int32 NextEntry = 0;
+	static int32 NumEntries = 0;
+
+	static bool bDelegatesRegistered = false;
+
+	static FColor GetCategoryColor(EQueryDebugCategory Category)
+	{
+		switch (Category)
+		{
+		case EQueryDebugCategory::SkateLanding: return FColor::Emerald;
+		case EQueryDebugCategory::SkateGround: return FColor::Yellow;
+		case EQueryDebugCategory::SkateGrind: return FColor::Magenta;
+		case EQueryDebugCategory::ClimbWall: return FColor::Cyan;
+		case EQueryDebugCategory::ClimbSurface: return FColor::Blue;
+		case EQueryDebugCategory::ClimbProbe: return FColor::White;
+		default: return FColor::Silver;
+		}
+	}
+
+	static void DrawEntries(UWorld* World, ELevelTick TickType, float DeltaSeconds)
+	{
+		const double OldestWorldTime = World->GetTimeSeconds() - CVarLifetime.GetValueOnGameThread();
+
+		for (int32 EntryIndex = 0; EntryIndex < NumEntries; EntryIndex++)
+		{
+			const FEntry& Entry = Entries[EntryIndex];
+			if (Entry.World != World || Entry.WorldTime < OldestWorldTime || !FQueryDebugDraw::IsCategoryEnabled(Entry.Category))
+			{
+				continue;
+			}
+
+			// Drawn for this frame only, so the line batcher never grows.
+			const FColor Color = GetCategoryColor(Entry.Category);
+			switch (Entry.Shape)
+			{
+			case EShape::Line:
+				DrawDebugLine(World,Entry.Start,Entry.End,Color);
+				break;
+			case EShape::Sphere:
+				DrawDebugLine(World,Entry.Start,Entry.End,Color);
+				DrawDebugSphere(World,Entry.End,Entry.Radius,8,Color);
+				break;
+			case EShape::Capsule:
+				DrawDebugLine(World,Entry.Start,Entry.End,Color);
+				DrawDebugCapsule(World,Entry.End,Entry.HalfHeight,Entry.Radius,FQuat::Identity,Color);
+				break;
+			default: break;
+			}
+
+			if (Entry.bHit)
+			{
+				DrawDebugPoint(World,Entry.HitLocation,8.0f,FColor::Red);
+				DrawDebugLine(World,Entry.HitLocation,Entry.HitLocation + Entry.HitNormal*25.0f,FColor::Red);
+			}
+		}
+	}
+
+	static void ForgetWorld(UWorld* World, bool bSessionEnded, bool bCleanupResources)
+	{
+		for (int32 EntryIndex = 0; EntryIndex < NumEntries; EntryIndex++)
+		{
+			if (Entries[EntryIndex].World == World)
+			{
+				Entries[EntryIndex].World = nullptr;
+			}
+		}
+	}
+
+	static FEntry& AddEntry(const UWorld* World, EQueryDebugCategory Category, EShape Shape, const FVector& Start, const FVector& End, const FHitResult* Hit)
+	{
+		if (!bDelegatesRegistered)
+		{
+			FWorldDelegates::OnWorldPostActorTick.AddStatic(&DrawEntries);
+			FWorldDelegates::OnWorldCleanup.AddStatic(&ForgetWorld);
+			bDelegatesRegistered = true;
+		}
+
+		FEntry& Entry = Entries[NextEntry];
+		NextEntry = (NextEntry + 1) % Capacity;
+		NumEntries = FMath::Min(NumEntries + 1, Capacity);
+
+		Entry.World = World;
+		Entry.WorldTime = World->GetTimeSeconds();
+		Entry.Start = Start;
+		Entry.End = End;
+		Entry.Radius = 0.0f;
+		Entry.HalfHeight = 0.0f;
+		Entry.Shape = Shape;
+		Entry.Category = Category;
+		Entry.bHit = Hit != nullptr;
+		Entry.HitLocation = Hit ? FVector(Hit->ImpactPoint) : FVector::ZeroVector;
+		Entry.HitNormal = Hit ? FVector(Hit->ImpactNormal) : FVector::ZeroVector;
+
+		return Entry;
+	}
+}
+
+bool FQueryDebugDraw::IsCategoryEnabled(EQueryDebugCategory Category)
+{
+	using namespace QueryDebugDraw;
+
+	switch (Category)
+	{
+	case EQueryDebugCategory::SkateLanding: return CVarSkateLanding.GetValueOnGameThread();
+	case EQueryDebugCategory::SkateGround: return CVarSkateGround.GetValueOnGameThread();
+	case EQueryDebugCategory::SkateGrind: return CVarSkateGrind.GetValueOnGameThread();
+	case EQueryDebugCategory::ClimbWall: return CVarClimbWall.GetValueOnGameThread();
+	case EQueryDebugCategory::ClimbSurface: return CVarClimbSurface.GetValueOnGameThread();
+	case EQueryDebugCategory::ClimbProbe: return CVarClimbProbe.GetValueOnGameThread();
+	default: return false;
+	}
+}
+
+void FQueryDebugDraw::RecordLine(const UWorld* World, EQueryDebugCategory Category, const FVector& Start, const FVector& End, const FHitResult* Hit)
+{
+	if (World && IsCategoryEnabled(Category))
+	{
+		QueryDebugDraw::AddEntry(World,Category,QueryDebugDraw::EShape::Line,Start,End,Hit);
+	}
+}
+
+void FQueryDebugDraw::RecordSphereSweep(const UWorld* World, EQueryDebugCategory Category, const FVector& Start, const FVector& End, float Radius, const FHitResult* Hit)
+{
+	if (World && IsCategoryEnabled(Category))
+	{
+		QueryDebugDraw::FEntry& Entry = QueryDebugDraw::AddEntry(World,Category,QueryDebugDraw::EShape::Sphere,Start,End,Hit);
+		Entry.Radius = Radius;
+	}
+}
+
+void FQueryDebugDraw::RecordCapsuleSweep(const UWorld* World, EQueryDebugCategory Category, const FVector& Start, const FVector& End, float Radius, float HalfHeight, const FHitResult* Hit)
+{
+	if (World && IsCategoryEnabled(Category))
+	{
+		QueryDebugDraw::FEntry& Entry = QueryDebugDraw::AddEntry(World,Category,QueryDebugDraw::EShape::Capsule,Start,End,Hit);
+		Entry.Radius = Radius;
+		Entry.HalfHeight = HalfHeight;
+	}
+}
+
+#endif
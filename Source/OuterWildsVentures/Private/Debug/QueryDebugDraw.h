@@ -0,0 +1,62 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "EngineDefines.h"
+
+class UWorld;
+struct FHitResult;
+
+// Groups of scene queries that can be visualized. Each one is toggled by its own console variable.
+enum class EQueryDebugCategory : uint8
+{
+	// Landing prediction segments (skate.Debug.Landing)
+	SkateLanding,
+
+	// Ground condition probes (skate.Debug.Ground)
+	SkateGround,
+
+	// Grind detection traces (skate.Debug.Grind)
+	SkateGrind,
+
+	// Wall sweeps for climbing (climb.Debug.Wall)
+	ClimbWall,
+
+	// Climbing surface probes (climb.Debug.Surface)
+	ClimbSurface,
+
+	// Eye height and floor traces while climbing (climb.Debug.Probe)
+	ClimbProbe,
+
+	Num
+};
+
+/**
+ * Debug visualization channel for scene queries issued by the Skate and Climber code.
+ * Recent queries go into a fixed-capacity ring buffer and are redrawn every frame until they expire, instead of being
+ * pushed into the persistent line batcher. Nothing is recorded unless the query's category is enabled, and the whole
+ * channel compiles out of Shipping and Test builds.
+ */
+class FQueryDebugDraw
+{
+public:
+#if ENABLE_DRAW_DEBUG
+	// Whether queries of a category are currently recorded.
+	static bool IsCategoryEnabled(EQueryDebugCategory Category);
+
+	// Record a line trace. Hit is null if the trace did not block.
+	static void RecordLine(const UWorld* World, EQueryDebugCategory Category, const FVector& Start, const FVector& End, const FHitResult* Hit);
+
+	// Record a sphere sweep. Hit is null if the sweep did not block.
+	static void RecordSphereSweep(const UWorld* World, EQueryDebugCategory Category, const FVector& Start, const FVector& End, float Radius, const FHitResult* Hit);
+
+	// Record a capsule sweep. Hit is null if the sweep did not block.
+	static void RecordCapsuleSweep(const UWorld* World, EQueryDebugCategory Category, const FVector& Start, const FVector& End, float Radius, float HalfHeight, const FHitResult* Hit);
+#else
+	static bool IsCategoryEnabled(EQueryDebugCategory Category) { return false; }
+	static void RecordLine(const UWorld* World, EQueryDebugCategory Category, const FVector& Start, const FVector& End, const FHitResult* Hit) {}
+	static void RecordSphereSweep(const UWorld* World, EQueryDebugCategory Category, const FVector& Start, const FVector& End, float Radius, const FHitResult* Hit) {}
+	static void RecordCapsuleSweep(const UWorld* World, EQueryDebugCategory Category, const FVector& Start, const FVector& End, float Radius, float HalfHeight, const FHitResult* Hit) {}
+#endif
+};
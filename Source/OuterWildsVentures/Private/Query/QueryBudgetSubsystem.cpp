@@ -0,0 +1,298 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Query/QueryBudgetSubsystem.h"
+
+#include "Engine/World.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogQueryBudget,Log,All);
+
+namespace QueryBudget
+{
+	// A negative budget is unlimited. Defaults leave a few dozen skaters and climbers untouched. Past that, each
+	// requester is held to its share of the category.
+	static TAutoConsoleVariable<int32> CVarFrame(TEXT("query.Budget.Frame"), 2048, TEXT("Scene queries the Skate and Climber code may issue per frame in total. Negative is unlimited."));
+	static TAutoConsoleVariable<int32> CVarSkateLanding(TEXT("query.Budget.SkateLanding"), 512, TEXT("Landing prediction queries per frame. Negative is unlimited."));
+	static TAutoConsoleVariable<int32> CVarSkateGround(TEXT("query.Budget.SkateGround"), 512, TEXT("Ground condition probes per frame. Negative is unlimited."));
+	static TAutoConsoleVariable<int32> CVarSkateGrind(TEXT("query.Budget.SkateGrind"), 256, TEXT("Grind detection traces per frame. Negative is unlimited."));
+	static TAutoConsoleVariable<int32> CVarClimbWall(TEXT("query.Budget.ClimbWall"), 128, TEXT("Climbing wall sweeps per frame. Negative is unlimited."));
+	static TAutoConsoleVariable<int32> CVarClimbSurface(TEXT("query.Budget.ClimbSurface"), 256, TEXT("Climbing surface probes per frame. Negative is unlimited."));
+	static TAutoConsoleVariable<int32> CVarClimbProbe(TEXT("query.Budget.ClimbProbe"), 256, TEXT("Eye height and floor traces per frame. Negative is unlimited."));
+	static TAutoConsoleVariable<int32> CVarMaxReuseFrames(TEXT("query.Budget.MaxReuseFrames"), 4, TEXT("Frames in a row a requester may be refused before its queries are issued over budget."));
+	static TAutoConsoleVariable<bool> CVarShow(TEXT("query.Budget.Show"), false, TEXT("Show scene queries issued and refused last frame per category."));
+
+	// Frames a requester is remembered without asking, so destroyed actors are dropped
+	constexpr uint64 RequesterTimeoutFrames = 60;
+
+	static int32 GetCategoryBudget(EQueryDebugCategory Category)
+	{
+		switch (Category)
+		{
+		case EQueryDebugCategory::SkateLanding: return CVarSkateLanding.GetValueOnGameThread();
+		case EQueryDebugCategory::SkateGround: return CVarSkateGround.GetValueOnGameThread();
+		case EQueryDebugCategory::SkateGrind: return CVarSkateGrind.GetValueOnGameThread();
+		case EQueryDebugCategory::ClimbWall: return CVarClimbWall.GetValueOnGameThread();
+		case EQueryDebugCategory::ClimbSurface: return CVarClimbSurface.GetValueOnGameThread();
+		case EQueryDebugCategory::ClimbProbe: return CVarClimbProbe.GetValueOnGameThread();
+		default: return -1;
+		}
+	}
+
+	static const TCHAR* GetCategoryName(EQueryDebugCategory Category)
+	{
+		switch (Category)
+		{
+		case EQueryDebugCategory::SkateLanding: return TEXT("SkateLanding");
+		case EQueryDebugCategory::SkateGround: return TEXT("SkateGround");
+		case EQueryDebugCategory::SkateGrind: return TEXT("SkateGrind");
+		case EQueryDebugCategory::ClimbWall: return TEXT("ClimbWall");
+		case EQueryDebugCategory::ClimbSurface: return TEXT("ClimbSurface");
+		case EQueryDebugCategory::ClimbProbe: return TEXT("ClimbProbe");
+		default: return TEXT("Unknown");
+		}
+	}
+
+	static void RecordSweep(const UWorld* World, EQueryDebugCategory Category, const FVector& Start, const FVector& End, const FCollisionShape& Shape, const FHitResult* Hit)
+	{
+		if (Shape.IsSphere())
+		{
+			FQueryDebugDraw::RecordSphereSweep(World,Category,Start,End,Shape.GetSphereRadius(),Hit);
+		}
+		else if (Shape.IsCapsule())
+		{
+			FQueryDebugDraw::RecordCapsuleSweep(World,Category,Start,End,Shape.GetCapsuleRadius(),Shape.GetCapsuleHalfHeight(),Hit);
+		}
+		else
+		{
+			FQueryDebugDraw::RecordLine(World,Category,Start,End,Hit);
+		}
+	}
+}
+
+bool UQueryBudgetSubsystem::LineTraceSingle(const UWorld* World, EQueryDebugCategory Category, const UObject* Requester, FHitResult& OutHit, const FVector& Start, const FVector& End,
+	ECollisionChannel TraceChannel, const FCollisionQueryParams& Params)
+{
+	UQueryBudgetSubsystem* Budget = Get(World);
+	if (Budget && !Budget->TryIssue(Category,Requester,1))
+	{
+		OutHit = FHitResult(1.0f);
+		return false;
+	}
+
+	const bool bHit = World->LineTraceSingleByChannel(OutHit,Start,End,TraceChannel,Params);
+	FQueryDebugDraw::RecordLine(World,Category,Start,End,bHit ? &OutHit : nullptr);
+	return bHit;
+}
+
+bool UQueryBudgetSubsystem::SweepSingle(const UWorld* World, EQueryDebugCategory Category, const UObject* Requester, FHitResult& OutHit, const FVector& Start, const FVector& End,
+	const FQuat& Rotation, ECollisionChannel TraceChannel, const FCollisionShape& Shape, const FCollisionQueryParams& Params)
+{
+	UQueryBudgetSubsystem* Budget = Get(World);
+	if (Budget && !Budget->TryIssue(Category,Requester,1))
+	{
+		OutHit = FHitResult(1.0f);
+		return false;
+	}
+
+	const bool bHit = World->SweepSingleByChannel(OutHit,Start,End,Rotation,TraceChannel,Shape,Params);
+	QueryBudget::RecordSweep(World,Category,Start,End,Shape,bHit ? &OutHit : nullptr);
+	return bHit;
+}
+
+bool UQueryBudgetSubsystem::SweepMulti(const UWorld* World, EQueryDebugCategory Category, const UObject* Requester, TArray<FHitResult>& OutHits, const FVector& Start, const FVector& End,
+	const FQuat& Rotation, ECollisionChannel TraceChannel, const FCollisionShape& Shape, const FCollisionQueryParams& Params)
+{
+	UQueryBudgetSubsystem* Budget = Get(World);
+	if (Budget && !Budget->TryIssue(Category,Requester,1))
+	{
+		OutHits.Reset();
+		return false;
+	}
+
+	const bool bHit = World->SweepMultiByChannel(OutHits,Start,End,Rotation,TraceChannel,Shape,Params);
+	QueryBudget::RecordSweep(World,Category,Start,End,Shape,OutHits.Num() > 0 ? &OutHits[0] : nullptr);
+	return bHit;
+}
+
+FTraceHandle UQueryBudgetSubsystem::AsyncLineTrace(UWorld* World, EQueryDebugCategory Category, const UObject* Requester, EAsyncTraceType TraceType, const FVector& Start, const FVector& End,
+	ECollisionChannel TraceChannel, const FCollisionQueryParams& Params)
+{
+	UQueryBudgetSubsystem* Budget = Get(World);
+	if (Budget && !Budget->TryIssue(Category,Requester,1))
+	{
+		return FTraceHandle();
+	}
+
+	// Recorded by the caller when the result is read
+	return World->AsyncLineTraceByChannel(TraceType,Start,End,TraceChannel,Params);
+}
+
+int32 UQueryBudgetSubsystem::GetRemainingBudget(const UWorld* World, EQueryDebugCategory Category, const UObject* Requester)
+{
+	UQueryBudgetSubsystem* Budget = Get(World);
+	return Budget ? Budget->GetRemainingBudget(Category,Requester) : MAX_int32;
+}
+
+const FQueryCategoryCounts& UQueryBudgetSubsystem::GetFrameCounts(EQueryDebugCategory Category) const
+{
+	return FrameCounts[static_cast<int32>(Category)];
+}
+
+const FQueryCategoryCounts& UQueryBudgetSubsystem::GetTotalCounts(EQueryDebugCategory Category) const
+{
+	return TotalCounts[static_cast<int32>(Category)];
+}
+
+int32 UQueryBudgetSubsystem::GetOverrunFrames(EQueryDebugCategory Category) const
+{
+	return OverrunFrames[static_cast<int32>(Category)];
+}
+
+UQueryBudgetSubsystem* UQueryBudgetSubsystem::Get(const UWorld* World)
+{
+	// Worlds without subsystems, e.g. editor previews, are not budgeted
+	return World ? World->GetSubsystem<UQueryBudgetSubsystem>() : nullptr;
+}
+
+bool UQueryBudgetSubsystem::TryIssue(EQueryDebugCategory Category, const UObject* Requester, int32 Count)
+{
+	check(IsInGameThread());
+
+	const int32 Remaining = GetRemainingBudget(Category,Requester);
+	FQueryRequesterState& RequesterState = GetRequesterState(Category,Requester);
+	FQueryCategoryCounts& Counts = FrameCounts[static_cast<int32>(Category)];
+	if (Remaining < Count)
+	{
+		RequesterState.bRefused = true;
+		Counts.Denied += Count;
+		TotalCounts[static_cast<int32>(Category)].Denied += Count;
+		return false;
+	}
+
+	if (IsForced(RequesterState))
+	{
+		Counts.Forced += Count;
+		TotalCounts[static_cast<int32>(Category)].Forced += Count;
+	}
+	RequesterState.Issued += Count;
+	Counts.Issued += Count;
+	TotalCounts[static_cast<int32>(Category)].Issued += Count;
+	FrameIssued += Count;
+	return true;
+}
+
+int32 UQueryBudgetSubsystem::GetRemainingBudget(EQueryDebugCategory Category, const UObject* Requester)
+{
+	UpdateFrame();
+
+	FQueryRequesterState& RequesterState = GetRequesterState(Category,Requester);
+	if (IsForced(RequesterState))
+	{
+		return MAX_int32;
+	}
+
+	int32 Remaining = MAX_int32;
+
+	const int32 CategoryBudget = QueryBudget::GetCategoryBudget(Category);
+	if (CategoryBudget >= 0)
+	{
+		const int32 CategoryIndex = static_cast<int32>(Category);
+		const int32 CategoryLeft = FMath::Max(CategoryBudget - FrameCounts[CategoryIndex].Issued,0);
+
+		// Requesters of last frame that have not asked yet keep their share. What is left over goes to whoever asks.
+		const int32 Share = FMath::Max(CategoryBudget / FMath::Max(LastFrameRequesterCounts[CategoryIndex],1),1);
+		const int32 Reserved = Share * FMath::Max(LastFrameRequesterCounts[CategoryIndex] - FrameRequesterCounts[CategoryIndex],0);
+		Remaining = FMath::Min(CategoryLeft,FMath::Max(Share - RequesterState.Issued,CategoryLeft - Reserved));
+	}
+
+	const int32 FrameBudget = QueryBudget::CVarFrame.GetValueOnGameThread();
+	if (FrameBudget >= 0)
+	{
+		Remaining = FMath::Min(Remaining,FMath::Max(FrameBudget - FrameIssued,0));
+	}
+
+	// Callers skip the query when told nothing is left, which counts as a refusal
+	if (Remaining <= 0)
+	{
+		RequesterState.bRefused = true;
+	}
+	return FMath::Max(Remaining,0);
+}
+
+FQueryRequesterState& UQueryBudgetSubsystem::GetRequesterState(EQueryDebugCategory Category, const UObject* Requester)
+{
+	const int32 CategoryIndex = static_cast<int32>(Category);
+	FQueryRequesterState& RequesterState = Requesters[CategoryIndex].FindOrAdd(FObjectKey(Requester));
+	if (!RequesterState.bActive)
+	{
+		RequesterState.bActive = true;
+		RequesterState.LastActiveFrame = GFrameCounter;
+		FrameRequesterCounts[CategoryIndex]++;
+	}
+	return RequesterState;
+}
+
+bool UQueryBudgetSubsystem::IsForced(const FQueryRequesterState& RequesterState)
+{
+	return RequesterState.RefusedFrames >= FMath::Max(QueryBudget::CVarMaxReuseFrames.GetValueOnGameThread(),1);
+}
+
+void UQueryBudgetSubsystem::UpdateFrame()
+{
+	if (CountedFrame == GFrameCounter)
+	{
+		return;
+	}
+
+	const bool bShow = QueryBudget::CVarShow.GetValueOnGameThread();
+	for (int32 Index = 0; Index < static_cast<int32>(EQueryDebugCategory::Num); Index++)
+	{
+		const EQueryDebugCategory Category = static_cast<EQueryDebugCategory>(Index);
+		const FQueryCategoryCounts& Counts = FrameCounts[Index];
+		if (Counts.Denied > 0 || Counts.Forced > 0)
+		{
+			// First overrun of a category is a warning, later ones are verbose so a busy scene does not flood the log
+			OverrunFrames[Index]++;
+			if (OverrunFrames[Index] == 1)
+			{
+				UE_LOG(LogQueryBudget,Warning,TEXT("%s query budget overrun in frame %llu: %d issued (%d forced), %d refused"),QueryBudget::GetCategoryName(Category),CountedFrame,Counts.Issued,Counts.Forced,Counts.Denied);
+			}
+			else
+			{
+				UE_LOG(LogQueryBudget,Verbose,TEXT("%s query budget overrun in frame %llu: %d issued (%d forced), %d refused"),QueryBudget::GetCategoryName(Category),CountedFrame,Counts.Issued,Counts.Forced,Counts.Denied);
+			}
+		}
+
+		if (bShow && GEngine)
+		{
+			GEngine->AddOnScreenDebugMessage(static_cast<uint64>(GetUniqueID()) * 16 + Index,0.0f,Counts.Denied > 0 ? FColor::Red : FColor::Yellow,
+				FString::Printf(TEXT("%s queries: %d issued (%d forced), %d refused by %d requesters, budget %d"),QueryBudget::GetCategoryName(Category),
+					Counts.Issued,Counts.Forced,Counts.Denied,FrameRequesterCounts[Index],QueryBudget::GetCategoryBudget(Category)));
+		}
+
+		FrameCounts[Index] = FQueryCategoryCounts();
+
+		// Requesters refused last frame move towards being forced. The rest start over.
+		for (auto It = Requesters[Index].CreateIterator(); It; ++It)
+		{
+			FQueryRequesterState& RequesterState = It.Value();
+			if (RequesterState.bActive)
+			{
+				RequesterState.RefusedFrames = RequesterState.bRefused ? RequesterState.RefusedFrames + 1 : 0;
+			}
+			else if (GFrameCounter - RequesterState.LastActiveFrame > QueryBudget::RequesterTimeoutFrames)
+			{
+				It.RemoveCurrent();
+				continue;
+			}
+			RequesterState.Issued = 0;
+			RequesterState.bActive = false;
+			RequesterState.bRefused = false;
+		}
+		LastFrameRequesterCounts[Index] = FrameRequesterCounts[Index];
+		FrameRequesterCounts[Index] = 0;
+	}
+
+	FrameIssued = 0;
+	CountedFrame = GFrameCounter;
+}
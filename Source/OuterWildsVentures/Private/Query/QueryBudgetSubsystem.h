@@ -0,0 +1,123 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "WorldCollision.h"
+#include "Debug/QueryDebugDraw.h"
+#include "Engine/HitResult.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "UObject/ObjectKey.h"
+#include "QueryBudgetSubsystem.generated.h"
+
+// Scene queries of one category in one frame
+struct FQueryCategoryCounts
+{
+	// Queries issued
+	int32 Issued = 0;
+
+	// Queries refused because the category or frame budget was spent
+	int32 Denied = 0;
+
+	// Queries issued over budget for requesters refused too many frames in a row
+	int32 Forced = 0;
+};
+
+// One requester's use of a category's budget
+struct FQueryRequesterState
+{
+	// Queries issued this frame
+	int32 Issued = 0;
+
+	// Asked for queries this frame
+	bool bActive = false;
+
+	// Was refused, or told nothing was left, this frame
+	bool bRefused = false;
+
+	// Frames in a row with a refusal
+	int32 RefusedFrames = 0;
+
+	// Last frame the requester asked for queries
+	uint64 LastActiveFrame = 0;
+};
+
+/**
+ * Scene queries issued by the Skate and Climber code go through here. Queries are counted per category (the query
+ * debug draw categories) and per frame, and refused once the category's budget (query.Budget.<Category>) or the
+ * frame's total budget (query.Budget.Frame) is spent. A refused query reports no hit.
+ * A category's budget is shared between the requesters that used it last frame. Each is kept an equal share until it
+ * has asked this frame, so requesters ticking early cannot spend the budget of those ticking late. A requester refused
+ * query.Budget.MaxReuseFrames frames in a row has its queries forced through, so no reused result gets older than that.
+ * Callers that can do better than a miss check GetRemainingBudget first and degrade on their own, e.g. by shortening
+ * the landing prediction horizon or keeping last frame's result. Frames with refused queries are reported as overruns.
+ * Queries are also recorded with the query debug draw channel, so callers do not need to.
+ */
+UCLASS()
+class UQueryBudgetSubsystem : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	// Functions
+
+	// Line trace against a channel. Returns true on a blocking hit.
+	static bool LineTraceSingle(const UWorld* World, EQueryDebugCategory Category, const UObject* Requester, FHitResult& OutHit, const FVector& Start, const FVector& End,
+		ECollisionChannel TraceChannel, const FCollisionQueryParams& Params = FCollisionQueryParams::DefaultQueryParam);
+
+	// Shape sweep against a channel. Returns true on a blocking hit.
+	static bool SweepSingle(const UWorld* World, EQueryDebugCategory Category, const UObject* Requester, FHitResult& OutHit, const FVector& Start, const FVector& End,
+		const FQuat& Rotation, ECollisionChannel TraceChannel, const FCollisionShape& Shape, const FCollisionQueryParams& Params = FCollisionQueryParams::DefaultQueryParam);
+
+	// Shape sweep against a channel, keeping every hit up to the first blocking one. Returns true on a blocking hit.
+	static bool SweepMulti(const UWorld* World, EQueryDebugCategory Category, const UObject* Requester, TArray<FHitResult>& OutHits, const FVector& Start, const FVector& End,
+		const FQuat& Rotation, ECollisionChannel TraceChannel, const FCollisionShape& Shape, const FCollisionQueryParams& Params = FCollisionQueryParams::DefaultQueryParam);
+
+	// Async line trace against a channel. Returns an invalid handle if refused.
+	static FTraceHandle AsyncLineTrace(UWorld* World, EQueryDebugCategory Category, const UObject* Requester, EAsyncTraceType TraceType, const FVector& Start, const FVector& End,
+		ECollisionChannel TraceChannel, const FCollisionQueryParams& Params = FCollisionQueryParams::DefaultQueryParam);
+
+	// Queries a requester may still issue in a category this frame. MAX_int32 if unbudgeted or forced.
+	static int32 GetRemainingBudget(const UWorld* World, EQueryDebugCategory Category, const UObject* Requester);
+
+	// Counts of the frame so far
+	const FQueryCategoryCounts& GetFrameCounts(EQueryDebugCategory Category) const;
+
+	// Counts since the world began
+	const FQueryCategoryCounts& GetTotalCounts(EQueryDebugCategory Category) const;
+
+	// Frames in which a category had queries refused
+	int32 GetOverrunFrames(EQueryDebugCategory Category) const;
+
+protected:
+	static UQueryBudgetSubsystem* Get(const UWorld* World);
+
+	// Count a query against the budget. Returns false if it is refused.
+	bool TryIssue(EQueryDebugCategory Category, const UObject* Requester, int32 Count);
+
+	int32 GetRemainingBudget(EQueryDebugCategory Category, const UObject* Requester);
+
+	// Requester's state for this frame, marking it active
+	FQueryRequesterState& GetRequesterState(EQueryDebugCategory Category, const UObject* Requester);
+
+	// Whether a requester has been refused for too long to be refused again
+	static bool IsForced(const FQueryRequesterState& RequesterState);
+
+	// Report the last frame and start counting a new one, once per frame
+	void UpdateFrame();
+
+	// Frame being counted
+	uint64 CountedFrame = 0;
+
+	FQueryCategoryCounts FrameCounts[static_cast<int32>(EQueryDebugCategory::Num)];
+	FQueryCategoryCounts TotalCounts[static_cast<int32>(EQueryDebugCategory::Num)];
+	int32 OverrunFrames[static_cast<int32>(EQueryDebugCategory::Num)] = {};
+	int32 FrameIssued = 0;
+
+	// Requesters of each category. Dropped after a while without asking.
+	TMap<FObjectKey, FQueryRequesterState> Requesters[static_cast<int32>(EQueryDebugCategory::Num)];
+
+	// Requesters of each category that asked last frame, and so far this frame
+	int32 LastFrameRequesterCounts[static_cast<int32>(EQueryDebugCategory::Num)] = {};
+	int32 FrameRequesterCounts[static_cast<int32>(EQueryDebugCategory::Num)] = {};
+};
@@ -0,0 +1,361 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Skate/GrindRail.h"
+
+#include "GrindRailSubsystem.h"
+#include "Components/SplineComponent.h"
+
+namespace GrindRailTable
+{
+	// Segments per leaf of the closest point tree
+	constexpr int32 LeafSegmentCount = 4;
+
+	int32 BuildBoundsNode(TArray<FGrindRailBoundsNode>& Nodes, const TArray<FGrindRailSample>& Samples, int32 FirstSegment, int32 LastSegment)
+	{
+		const int32 NodeIndex = Nodes.AddDefaulted();
+		FGrindRailBoundsNode& Node = Nodes[NodeIndex];
+		Node.FirstSegment = FirstSegment;
+		Node.LastSegment = LastSegment;
+		for (int32 SampleIndex = FirstSegment; SampleIndex <= LastSegment + 1; SampleIndex++)
+		{
+			Node.Bounds += Samples[SampleIndex].Location;
+		}
+		return NodeIndex;
+	}
+}
+
+// Sets default values
+AGrindRail::AGrindRail()
+{
+	// Rails never change at runtime.
+	PrimaryActorTick.bCanEverTick = false;
+
+	RailSpline = CreateDefaultSubobject<USplineComponent>("RailSpline");
+	RootComponent = RailSpline;
+}
+
+void AGrindRail::OnConstruction(const FTransform& Transform)
+{
+	Super::OnConstruction(Transform);
+
+	// Segments of the last run. Found on the actor as well, since the transient list is lost when the editor copies the actor.
+	TArray<USplineMeshComponent*> OldRailSegments(RailSegments);
+	TInlineComponentArray<USplineMeshComponent*> SplineMeshComponents(this);
+	for (USplineMeshComponent* SplineMeshComponent : SplineMeshComponents)
+	{
+		if (SplineMeshComponent->CreationMethod == EComponentCreationMethod::UserConstructionScript && SplineMeshComponent->GetAttachParent() == RailSpline)
+		{
+			OldRailSegments.AddUnique(SplineMeshComponent);
+		}
+	}
+	for (USplineMeshComponent* RailSegment : OldRailSegments)
+	{
+		if (IsValid(RailSegment))
+		{
+			RailSegment->DestroyComponent();
+		}
+	}
+	RailSegments.Reset();
+
+	BakeRailTable();
+
+	if (!RailSegmentMesh)
+	{
+		return;
+	}
+
+	for (int32 SegmentIndex = 0; SegmentIndex < RailSpline->GetNumberOfSplineSegments(); SegmentIndex++)
+	{
+		FVector StartLocation;
+		FVector StartTangent;
+		FVector EndLocation;
+		FVector EndTangent;
+		RailSpline->GetLocationAndTangentAtSplinePoint(SegmentIndex,StartLocation,StartTangent,ESplineCoordinateSpace::Local);
+		RailSpline->GetLocationAndTangentAtSplinePoint(SegmentIndex + 1,EndLocation,EndTangent,ESplineCoordinateSpace::Local);
+
+		// Construction script components, so the editor clears them before every rerun
+		USplineMeshComponent* RailSegment = NewObject<USplineMeshComponent>(this);
+		RailSegment->CreationMethod = EComponentCreationMethod::UserConstructionScript;
+		RailSegment->SetStaticMesh(RailSegmentMesh);
+		RailSegment->SetForwardAxis(RailSegmentMeshAxis,false);
+		RailSegment->SetStartAndEnd(StartLocation,StartTangent,EndLocation,EndTangent,false);
+
+		// Rail only answers grind traces. Physical collision comes from the ramp or ledge it sits on.
+		RailSegment->SetCollisionEnabled(ECollisionEnabled::QueryOnly);
+		RailSegment->SetCollisionResponseToAllChannels(ECR_Ignore);
+		RailSegment->SetCollisionResponseToChannel(ECC_GameTraceChannel1,ECR_Block);
+
+		RailSegment->SetupAttachment(RailSpline);
+		RailSegment->RegisterComponent();
+		RailSegments.Add(RailSegment);
+	}
+}
+
+void AGrindRail::BeginPlay()
+{
+	Super::BeginPlay();
+
+	if (!HasRailTable())
+	{
+		BakeRailTable();
+	}
+
+	if (UGrindRailSubsystem* GrindRailSubsystem = GetWorld()->GetSubsystem<UGrindRailSubsystem>())
+	{
+		TArray<FBox> RailPieceBounds;
+		GetRailPieceBounds(500.0f,RailPieceBounds);
+		GrindRailSubsystem->RegisterGrindActor(this,RailPieceBounds);
+	}
+}
+
+void AGrindRail::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	if (UGrindRailSubsystem* GrindRailSubsystem = GetWorld()->GetSubsystem<UGrindRailSubsystem>())
+	{
+		GrindRailSubsystem->UnregisterGrindActor(this);
+	}
+
+	Super::EndPlay(EndPlayReason);
+}
+
+void AGrindRail::BakeRailTable()
+{
+	RailSamples.Reset();
+	RailBoundsNodes.Reset();
+	RailBakedLength = RailSpline->GetSplineLength();
+
+	if (RailBakedLength <= KINDA_SMALL_NUMBER)
+	{
+		RailBakedSampleSpacing = 0.0f;
+		return;
+	}
+
+	// Spread samples evenly so a distance maps straight to a sample index.
+	const int32 SegmentCount = FMath::Max(1,FMath::CeilToInt(RailBakedLength / FMath::Max(RailSampleSpacing,1.0f)));
+	RailBakedSampleSpacing = RailBakedLength / SegmentCount;
+
+	// Samples are stored relative to the actor so the table survives the rail being moved.
+	const FTransform& RailTransform = GetActorTransform();
+	RailSamples.SetNumUninitialized(SegmentCount + 1);
+	for (int32 SampleIndex = 0; SampleIndex <= SegmentCount; SampleIndex++)
+	{
+		const float Distance = SampleIndex * RailBakedSampleSpacing;
+		const FVector Location = RailSpline->GetLocationAtDistanceAlongSpline(Distance,ESplineCoordinateSpace::World);
+		const FVector Tangent = RailSpline->GetTangentAtDistanceAlongSpline(Distance,ESplineCoordinateSpace::World);
+		RailSamples[SampleIndex].Location = FVector3f(RailTransform.InverseTransformPosition(Location));
+		RailSamples[SampleIndex].Tangent = FVector3f(RailTransform.InverseTransformVector(Tangent));
+	}
+
+	// Build the closest point tree breadth first. Children of a node are always stored next to each other.
+	GrindRailTable::BuildBoundsNode(RailBoundsNodes,RailSamples,0,SegmentCount - 1);
+	for (int32 NodeIndex = 0; NodeIndex < RailBoundsNodes.Num(); NodeIndex++)
+	{
+		const int32 FirstSegment = RailBoundsNodes[NodeIndex].FirstSegment;
+		const int32 LastSegment = RailBoundsNodes[NodeIndex].LastSegment;
+		if (LastSegment - FirstSegment + 1 <= GrindRailTable::LeafSegmentCount)
+		{
+			continue;
+		}
+
+		const int32 MidSegment = (FirstSegment + LastSegment) / 2;
+		const int32 FirstChild = GrindRailTable::BuildBoundsNode(RailBoundsNodes,RailSamples,FirstSegment,MidSegment);
+		GrindRailTable::BuildBoundsNode(RailBoundsNodes,RailSamples,MidSegment + 1,LastSegment);
+		RailBoundsNodes[NodeIndex].FirstChild = FirstChild;
+	}
+}
+
+bool AGrindRail::HasRailTable() const
+{
+	return RailSamples.Num() >= 2 && RailBoundsNodes.Num() > 0 && RailBakedSampleSpacing > 0.0f;
+}
+
+void AGrindRail::GetRailPieceBounds(float MaxExtent, TArray<FBox>& OutBounds) const
+{
+	if (!HasRailTable())
+	{
+		OutBounds.Add(GetComponentsBoundingBox(false));
+		return;
+	}
+
+	// Walk down the closest point tree until a node is small enough to be one piece.
+	TArray<int32,TInlineAllocator<32>> NodeStack;
+	NodeStack.Add(0);
+	while (NodeStack.Num() > 0)
+	{
+		const FGrindRailBoundsNode& Node = RailBoundsNodes[NodeStack.Pop(false)];
+		if (Node.FirstChild == INDEX_NONE || Node.Bounds.GetExtent().GetMax() <= MaxExtent)
+		{
+			const FBox LocalBounds(FVector(Node.Bounds.Min),FVector(Node.Bounds.Max));
+			OutBounds.Add(LocalBounds.TransformBy(GetActorTransform()).ExpandBy(RailBroadphaseMargin));
+			continue;
+		}
+
+		NodeStack.Add(Node.FirstChild);
+		NodeStack.Add(Node.FirstChild + 1);
+	}
+}
+
+int32 AGrindRail::GetRailSampleAtDistance(float Distance, float& OutAlpha) const
+{
+	const int32 LastSegment = RailSamples.Num() - 2;
+	const float SampleDistance = FMath::Clamp(Distance / RailBakedSampleSpacing,0.0f,(float)(LastSegment + 1));
+	const int32 SampleIndex = FMath::Min(FMath::FloorToInt(SampleDistance),LastSegment);
+	OutAlpha = SampleDistance - SampleIndex;
+	return SampleIndex;
+}
+
+float AGrindRail::FindRailDistanceClosestToLocalLocation(const FVector3f& LocalLocation, FVector3f& OutLocalPoint) const
+{
+	float BestDistanceSquared = MAX_flt;
+	float BestDistanceAlongRail = 0.0f;
+	OutLocalPoint = RailSamples[0].Location;
+
+	// Nearest child is pushed last so it is searched first, which lets most of the far nodes be pruned.
+	TArray<int32,TInlineAllocator<32>> NodeStack;
+	NodeStack.Add(0);
+	while (NodeStack.Num() > 0)
+	{
+		const FGrindRailBoundsNode& Node = RailBoundsNodes[NodeStack.Pop(false)];
+		if (Node.Bounds.ComputeSquaredDistanceToPoint(LocalLocation) >= BestDistanceSquared)
+		{
+			continue;
+		}
+
+		if (Node.FirstChild == INDEX_NONE)
+		{
+			for (int32 SegmentIndex = Node.FirstSegment; SegmentIndex <= Node.LastSegment; SegmentIndex++)
+			{
+				const FVector3f& SegmentStart = RailSamples[SegmentIndex].Location;
+				const FVector3f& SegmentEnd = RailSamples[SegmentIndex + 1].Location;
+				const FVector3f Segment = SegmentEnd - SegmentStart;
+				const float SegmentLengthSquared = Segment.SizeSquared();
+				const float SegmentAlpha = SegmentLengthSquared > KINDA_SMALL_NUMBER ? FMath::Clamp(FVector3f::DotProduct(LocalLocation - SegmentStart,Segment) / SegmentLengthSquared,0.0f,1.0f) : 0.0f;
+				const FVector3f SegmentPoint = SegmentStart + Segment * SegmentAlpha;
+				const float DistanceSquared = FVector3f::DistSquared(LocalLocation,SegmentPoint);
+				if (DistanceSquared < BestDistanceSquared)
+				{
+					BestDistanceSquared = DistanceSquared;
+					BestDistanceAlongRail = (SegmentIndex + SegmentAlpha) * RailBakedSampleSpacing;
+					OutLocalPoint = SegmentPoint;
+				}
+			}
+			continue;
+		}
+
+		const float FirstChildDistanceSquared = RailBoundsNodes[Node.FirstChild].Bounds.ComputeSquaredDistanceToPoint(LocalLocation);
+		const float SecondChildDistanceSquared = RailBoundsNodes[Node.FirstChild + 1].Bounds.ComputeSquaredDistanceToPoint(LocalLocation);
+		if (FirstChildDistanceSquared <= SecondChildDistanceSquared)
+		{
+			NodeStack.Add(Node.FirstChild + 1);
+			NodeStack.Add(Node.FirstChild);
+		}
+		else
+		{
+			NodeStack.Add(Node.FirstChild);
+			NodeStack.Add(Node.FirstChild + 1);
+		}
+	}
+
+	return BestDistanceAlongRail;
+}
+
+FVector AGrindRail::FindRailTangentNearLocation(const FVector& Location) const
+{
+	if (!HasRailTable())
+	{
+		return RailSpline->FindTangentClosestToWorldLocation(Location,ESplineCoordinateSpace::World);
+	}
+
+	return GetRailTangentAtDistance(GetRailDistanceClosestToLocation(Location));
+}
+
+FVector AGrindRail::GetRailClosestPoint(const FVector& Location) const
+{
+	if (!HasRailTable())
+	{
+		return RailSpline->FindLocationClosestToWorldLocation(Location,ESplineCoordinateSpace::World);
+	}
+
+	FVector3f LocalPoint;
+	FindRailDistanceClosestToLocalLocation(FVector3f(GetActorTransform().InverseTransformPosition(Location)),LocalPoint);
+	return GetActorTransform().TransformPosition(FVector(LocalPoint));
+}
+
+float AGrindRail::GetRailLength() const
+{
+	if (!HasRailTable())
+	{
+		return RailSpline->GetSplineLength();
+	}
+
+	return RailBakedLength;
+}
+
+float AGrindRail::GetRailDistanceClosestToLocation(const FVector& Location) const
+{
+	if (!HasRailTable())
+	{
+		const float InputKey = RailSpline->FindInputKeyClosestToWorldLocation(Location);
+		return RailSpline->GetDistanceAlongSplineAtSplineInputKey(InputKey);
+	}
+
+	FVector3f LocalPoint;
+	return FindRailDistanceClosestToLocalLocation(FVector3f(GetActorTransform().InverseTransformPosition(Location)),LocalPoint);
+}
+
+FVector AGrindRail::GetRailLocationAtDistance(float Distance) const
+{
+	if (!HasRailTable())
+	{
+		return RailSpline->GetLocationAtDistanceAlongSpline(Distance,ESplineCoordinateSpace::World);
+	}
+
+	float Alpha;
+	const int32 SampleIndex = GetRailSampleAtDistance(Distance,Alpha);
+	const FVector3f LocalLocation = FMath::Lerp(RailSamples[SampleIndex].Location,RailSamples[SampleIndex + 1].Location,Alpha);
+	return GetActorTransform().TransformPosition(FVector(LocalLocation));
+}
+
+FVector AGrindRail::GetRailTangentAtDistance(float Distance) const
+{
+	if (!HasRailTable())
+	{
+		return RailSpline->GetTangentAtDistanceAlongSpline(Distance,ESplineCoordinateSpace::World);
+	}
+
+	float Alpha;
+	const int32 SampleIndex = GetRailSampleAtDistance(Distance,Alpha);
+	const FVector3f LocalTangent = FMath::Lerp(RailSamples[SampleIndex].Tangent,RailSamples[SampleIndex + 1].Tangent,Alpha);
+	return GetActorTransform().TransformVector(FVector(LocalTangent));
+}
+
+FVector AGrindRail::FindSplineTangentNearHitLocation_Implementation(FVector NearHitLocation)
+{
+	return FindRailTangentNearLocation(NearHitLocation);
+}
+
+FVector AGrindRail::GetInitialSnapPoint_Implementation(FVector HitLocation)
+{
+	return GetRailClosestPoint(HitLocation);
+}
+
+float AGrindRail::GetSplineLength_Implementation()
+{
+	return GetRailLength();
+}
+
+float AGrindRail::GetInitialHitDistanceAlongSpline_Implementation(FVector HitLocaion)
+{
+	return GetRailDistanceClosestToLocation(HitLocaion);
+}
+
+FVector AGrindRail::GetSnapPointAtDistanceAlongSpline_Implementation(float DistanceAlongSpline)
+{
+	return GetRailLocationAtDistance(DistanceAlongSpline);
+}
+
+FVector AGrindRail::GetTangentAtDistanceAlongSpline_Implementation(float DistanceAlongSpline)
+{
+	return GetRailTangentAtDistance(DistanceAlongSpline);
+}
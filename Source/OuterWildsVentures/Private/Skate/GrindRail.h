@@ -0,0 +1,167 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Grindface.h"
+#include "Components/SplineMeshComponent.h"
+#include "GameFramework/Actor.h"
+#include "GrindRail.generated.h"
+
+class USplineComponent;
+
+/**
+ * Rail sample at a uniform distance along the spline, in actor space.
+ */
+USTRUCT()
+struct FGrindRailSample
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	FVector3f Location = FVector3f::ZeroVector;
+
+	UPROPERTY()
+	FVector3f Tangent = FVector3f::ZeroVector;
+};
+
+/**
+ * Node of the bounding volume tree over the segments between rail samples. Used for closest point search.
+ */
+USTRUCT()
+struct FGrindRailBoundsNode
+{
+	GENERATED_BODY()
+
+	// Bounds of all segments below this node, in actor space
+	UPROPERTY()
+	FBox3f Bounds = FBox3f(ForceInit);
+
+	// First segment covered by this node. Segment i runs from sample i to sample i + 1.
+	UPROPERTY()
+	int32 FirstSegment = 0;
+
+	// Last segment covered by this node
+	UPROPERTY()
+	int32 LastSegment = 0;
+
+	// Index of the first of two consecutive children, or INDEX_NONE for a leaf
+	UPROPERTY()
+	int32 FirstChild = INDEX_NONE;
+};
+
+/**
+ * Native grind rail. Implements IGrindface on a spline component so grinding never has to call into Blueprint.
+ * Can be placed in levels in place of Blueprint grind actors.
+ */
+UCLASS()
+class AGrindRail : public AActor, public IGrindface
+{
+	GENERATED_BODY()
+	
+public:	
+	// Sets default values for this actor's properties
+	AGrindRail();
+
+	// Rebuild rail segment meshes along the spline
+	virtual void OnConstruction(const FTransform& Transform) override;
+
+public:
+	// Components
+
+	// Spline skate physics snaps to while grinding
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Component")
+	USplineComponent* RailSpline;
+
+public:
+	// Config properties
+
+	// Mesh stretched along every spline segment. It blocks the RampLedge trace channel so that grinds can be detected.
+	UPROPERTY(EditAnywhere, Category = "Config")
+	UStaticMesh* RailSegmentMesh;
+
+	// Forward axis of the rail segment mesh
+	UPROPERTY(EditAnywhere, Category = "Config")
+	TEnumAsByte<ESplineMeshAxis::Type> RailSegmentMeshAxis = ESplineMeshAxis::X;
+
+	// Target distance between baked rail samples. Grind sampling interpolates linearly between them.
+	UPROPERTY(EditAnywhere, Category = "Config", meta=(ClampMin="1.0"))
+	float RailSampleSpacing = 10.0f;
+
+	// Padding around the rail centre line registered with the grind broadphase. Should cover the rail mesh.
+	UPROPERTY(EditAnywhere, Category = "Config")
+	float RailBroadphaseMargin = 25.0f;
+
+public:
+	// Bake the rail sample table and closest point tree from the spline. Runs on construction, so tables are saved with the level.
+	void BakeRailTable();
+
+	// Whether the rail table has been baked for the current spline
+	bool HasRailTable() const;
+
+	// World space bounds covering the rail in pieces no larger than MaxExtent where the table allows
+	void GetRailPieceBounds(float MaxExtent, TArray<FBox>& OutBounds) const;
+
+public:
+	// Native rail queries. Skate physics calls these directly when grinding on a native rail.
+
+	// Spline tangent closest to a world location
+	FVector FindRailTangentNearLocation(const FVector& Location) const;
+
+	// Point on spline closest to a world location
+	FVector GetRailClosestPoint(const FVector& Location) const;
+
+	// Spline length
+	float GetRailLength() const;
+
+	// Distance along spline of the point closest to a world location
+	float GetRailDistanceClosestToLocation(const FVector& Location) const;
+
+	// World location at a distance along spline
+	FVector GetRailLocationAtDistance(float Distance) const;
+
+	// World tangent at a distance along spline
+	FVector GetRailTangentAtDistance(float Distance) const;
+
+public:
+	// Interface Functions
+
+	virtual FVector FindSplineTangentNearHitLocation_Implementation(FVector NearHitLocation) override;
+	virtual FVector GetInitialSnapPoint_Implementation(FVector HitLocation) override;
+	virtual float GetSplineLength_Implementation() override;
+	virtual float GetInitialHitDistanceAlongSpline_Implementation(FVector HitLocaion) override;
+	virtual FVector GetSnapPointAtDistanceAlongSpline_Implementation(float DistanceAlongSpline) override;
+	virtual FVector GetTangentAtDistanceAlongSpline_Implementation(float DistanceAlongSpline) override;
+
+protected:
+	// Bake the rail table if the level was saved without one and register with the grind broadphase
+	virtual void BeginPlay() override;
+
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+	// Distance along rail of the point closest to an actor space location, and that point
+	float FindRailDistanceClosestToLocalLocation(const FVector3f& LocalLocation, FVector3f& OutLocalPoint) const;
+
+	// Index of the sample at or before a distance along rail, and the interpolation alpha towards the next sample
+	int32 GetRailSampleAtDistance(float Distance, float& OutAlpha) const;
+
+	// Rail segment meshes built in OnConstruction
+	UPROPERTY(Transient)
+	TArray<USplineMeshComponent*> RailSegments;
+
+	// Samples at uniform distance along the spline
+	UPROPERTY()
+	TArray<FGrindRailSample> RailSamples;
+
+	// Bounding volume tree over the segments between samples. The root is the first node.
+	UPROPERTY()
+	TArray<FGrindRailBoundsNode> RailBoundsNodes;
+
+	// Actual distance between baked samples
+	UPROPERTY()
+	float RailBakedSampleSpacing = 0.0f;
+
+	// Spline length when the table was baked
+	UPROPERTY()
+	float RailBakedLength = 0.0f;
+};
@@ -0,0 +1,245 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Skate/GrindRailSubsystem.h"
+
+#include "EngineUtils.h"
+#include "Engine/Level.h"
+#include "Grindface.h"
+#include "GrindRail.h"
+
+void UGrindRailSubsystem::OnWorldBeginPlay(UWorld& InWorld)
+{
+	Super::OnWorldBeginPlay(InWorld);
+
+	// Native rails register themselves with their segment bounds on BeginPlay.
+	for (TActorIterator<AActor> It(&InWorld); It; ++It)
+	{
+		RegisterIfGrindActor(*It);
+	}
+
+	LevelAddedHandle = FWorldDelegates::LevelAddedToWorld.AddUObject(this,&UGrindRailSubsystem::OnLevelAdded);
+	LevelRemovedHandle = FWorldDelegates::LevelRemovedFromWorld.AddUObject(this,&UGrindRailSubsystem::OnLevelRemoved);
+	ActorSpawnedHandle = InWorld.AddOnActorSpawnedHandler(FOnActorSpawned::FDelegate::CreateUObject(this,&UGrindRailSubsystem::OnActorSpawned));
+}
+
+void UGrindRailSubsystem::Deinitialize()
+{
+	FWorldDelegates::LevelAddedToWorld.Remove(LevelAddedHandle);
+	FWorldDelegates::LevelRemovedFromWorld.Remove(LevelRemovedHandle);
+	GetWorld()->RemoveOnActorSpawnedHandler(ActorSpawnedHandle);
+
+	for (const TWeakObjectPtr<AActor>& GrindActor : WatchedGrindActors)
+	{
+		if (GrindActor.IsValid() && GrindActor->GetRootComponent())
+		{
+			GrindActor->GetRootComponent()->TransformUpdated.RemoveAll(this);
+		}
+	}
+	WatchedGrindActors.Reset();
+
+	Cells.Reset();
+	GrindActorCells.Reset();
+
+	Super::Deinitialize();
+}
+
+void UGrindRailSubsystem::OnLevelAdded(ULevel* Level, UWorld* World)
+{
+	if (World != GetWorld() || !Level)
+	{
+		return;
+	}
+
+	for (AActor* Actor : Level->Actors)
+	{
+		RegisterIfGrindActor(Actor);
+	}
+}
+
+void UGrindRailSubsystem::OnLevelRemoved(ULevel* Level, UWorld* World)
+{
+	if (World != GetWorld() || !Level)
+	{
+		return;
+	}
+
+	for (AActor* Actor : Level->Actors)
+	{
+		if (Actor)
+		{
+			UnregisterGrindActor(Actor);
+		}
+	}
+}
+
+void UGrindRailSubsystem::OnActorSpawned(AActor* Actor)
+{
+	RegisterIfGrindActor(Actor);
+}
+
+void UGrindRailSubsystem::RegisterIfGrindActor(AActor* Actor)
+{
+	if (Actor && Actor->Implements<UGrindface>() && !Actor->IsA<AGrindRail>())
+	{
+		RegisterGrindActorBounds(Actor);
+	}
+}
+
+void UGrindRailSubsystem::RegisterGrindActor(AActor* GrindActor, const TArray<FBox>& Bounds)
+{
+	if (!GrindActor)
+	{
+		return;
+	}
+
+	RemoveFromGrid(GrindActor);
+
+	TArray<FIntVector>& ActorCells = GrindActorCells.Add(GrindActor);
+	for (const FBox& Box : Bounds)
+	{
+		if (!Box.IsValid)
+		{
+			continue;
+		}
+
+		FIntVector MinCell;
+		FIntVector MaxCell;
+		GetCellRange(Box,MinCell,MaxCell);
+		for (int32 X = MinCell.X; X <= MaxCell.X; X++)
+		{
+			for (int32 Y = MinCell.Y; Y <= MaxCell.Y; Y++)
+			{
+				for (int32 Z = MinCell.Z; Z <= MaxCell.Z; Z++)
+				{
+					const FIntVector Cell(X,Y,Z);
+					Cells.FindOrAdd(Cell).Add({GrindActor,Box});
+					ActorCells.AddUnique(Cell);
+				}
+			}
+		}
+	}
+}
+
+void UGrindRailSubsystem::RegisterGrindActorBounds(AActor* GrindActor)
+{
+	if (!GrindActor)
+	{
+		return;
+	}
+
+	TArray<FBox> Bounds;
+	Bounds.Add(GrindActor->GetComponentsBoundingBox(false));
+	RegisterGrindActor(GrindActor,Bounds);
+
+	// Kept registered at its current bounds until it ends play
+	bool bAlreadyWatched = false;
+	WatchedGrindActors.Add(GrindActor,&bAlreadyWatched);
+	if (!bAlreadyWatched)
+	{
+		GrindActor->OnEndPlay.AddUniqueDynamic(this,&UGrindRailSubsystem::OnGrindActorEndPlay);
+		if (USceneComponent* RootComponent = GrindActor->GetRootComponent(); RootComponent && RootComponent->Mobility == EComponentMobility::Movable)
+		{
+			RootComponent->TransformUpdated.AddUObject(this,&UGrindRailSubsystem::OnGrindActorTransformUpdated);
+		}
+	}
+}
+
+void UGrindRailSubsystem::OnGrindActorEndPlay(AActor* Actor, EEndPlayReason::Type EndPlayReason)
+{
+	UnregisterGrindActor(Actor);
+}
+
+void UGrindRailSubsystem::OnGrindActorTransformUpdated(USceneComponent* Component, EUpdateTransformFlags UpdateTransformFlags, ETeleportType Teleport)
+{
+	if (AActor* GrindActor = Component->GetOwner())
+	{
+		TArray<FBox> Bounds;
+		Bounds.Add(GrindActor->GetComponentsBoundingBox(false));
+		RegisterGrindActor(GrindActor,Bounds);
+	}
+}
+
+void UGrindRailSubsystem::UnregisterGrindActor(AActor* GrindActor)
+{
+	RemoveFromGrid(GrindActor);
+
+	if (GrindActor && WatchedGrindActors.Remove(GrindActor) > 0)
+	{
+		GrindActor->OnEndPlay.RemoveDynamic(this,&UGrindRailSubsystem::OnGrindActorEndPlay);
+		if (USceneComponent* RootComponent = GrindActor->GetRootComponent())
+		{
+			RootComponent->TransformUpdated.RemoveAll(this);
+		}
+	}
+}
+
+void UGrindRailSubsystem::RemoveFromGrid(AActor* GrindActor)
+{
+	TArray<FIntVector> ActorCells;
+	if (!GrindActorCells.RemoveAndCopyValue(GrindActor,ActorCells))
+	{
+		return;
+	}
+
+	for (const FIntVector& Cell : ActorCells)
+	{
+		if (TArray<FGrindRailCellEntry>* CellEntries = Cells.Find(Cell))
+		{
+			CellEntries->RemoveAllSwap([GrindActor](const FGrindRailCellEntry& Entry) { return Entry.GrindActor == GrindActor; });
+			if (CellEntries->Num() == 0)
+			{
+				Cells.Remove(Cell);
+			}
+		}
+	}
+}
+
+bool UGrindRailSubsystem::HasGrindCandidate(const FBox& QueryBounds) const
+{
+	// Nothing registered yet. Let the grind trace decide.
+	if (Cells.Num() == 0)
+	{
+		return true;
+	}
+
+	FIntVector MinCell;
+	FIntVector MaxCell;
+	GetCellRange(QueryBounds,MinCell,MaxCell);
+	for (int32 X = MinCell.X; X <= MaxCell.X; X++)
+	{
+		for (int32 Y = MinCell.Y; Y <= MaxCell.Y; Y++)
+		{
+			for (int32 Z = MinCell.Z; Z <= MaxCell.Z; Z++)
+			{
+				const TArray<FGrindRailCellEntry>* CellEntries = Cells.Find(FIntVector(X,Y,Z));
+				if (!CellEntries)
+				{
+					continue;
+				}
+
+				for (const FGrindRailCellEntry& Entry : *CellEntries)
+				{
+					if (Entry.Bounds.Intersect(QueryBounds) && Entry.GrindActor.IsValid())
+					{
+						return true;
+					}
+				}
+			}
+		}
+	}
+
+	return false;
+}
+
+void UGrindRailSubsystem::GetCellRange(const FBox& Bounds, FIntVector& OutMinCell, FIntVector& OutMaxCell)
+{
+	OutMinCell = FIntVector(
+		FMath::FloorToInt(Bounds.Min.X / CellSize),
+		FMath::FloorToInt(Bounds.Min.Y / CellSize),
+		FMath::FloorToInt(Bounds.Min.Z / CellSize));
+	OutMaxCell = FIntVector(
+		FMath::FloorToInt(Bounds.Max.X / CellSize),
+		FMath::FloorToInt(Bounds.Max.Y / CellSize),
+		FMath::FloorToInt(Bounds.Max.Z / CellSize));
+}
@@ -0,0 +1,92 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "GrindRailSubsystem.generated.h"
+
+/**
+ * Bounds of a piece of grind actor stored in a grid cell.
+ */
+struct FGrindRailCellEntry
+{
+	TWeakObjectPtr<AActor> GrindActor;
+	FBox Bounds;
+};
+
+/**
+ * Broadphase for grind detection. Keeps a uniform grid of grind actor bounds so skate physics
+ * only traces for rails when one is within reach.
+ * Native rails register their segment bounds, other grind actors their colliding component bounds. Other grind
+ * actors are picked up as they spawn or their level streams in, and registered again as they move.
+ */
+UCLASS()
+class UGrindRailSubsystem : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	// Register grind actors that were placed in the level, and watch for ones added later
+	virtual void OnWorldBeginPlay(UWorld& InWorld) override;
+
+	virtual void Deinitialize() override;
+
+public:
+	// Functions
+
+	// Register a grind actor with a set of world space bounds. Replaces any previous registration of the actor.
+	void RegisterGrindActor(AActor* GrindActor, const TArray<FBox>& Bounds);
+
+	// Register a grind actor by its colliding component bounds. Kept up to date until the actor ends play.
+	UFUNCTION(BlueprintCallable, Category = "Grind")
+	void RegisterGrindActorBounds(AActor* GrindActor);
+
+	// Remove a grind actor from the grid
+	UFUNCTION(BlueprintCallable, Category = "Grind")
+	void UnregisterGrindActor(AActor* GrindActor);
+
+	// Whether any registered grind actor bounds overlap the box. True when nothing is registered, so grind
+	// detection never depends on a grid that was never filled.
+	bool HasGrindCandidate(const FBox& QueryBounds) const;
+
+protected:
+	// Register grind actors of a level streamed in
+	void OnLevelAdded(ULevel* Level, UWorld* World);
+
+	// Remove grind actors of a level streamed out
+	void OnLevelRemoved(ULevel* Level, UWorld* World);
+
+	void OnActorSpawned(AActor* Actor);
+
+	// Register a grind actor that is not a native rail
+	void RegisterIfGrindActor(AActor* Actor);
+
+	UFUNCTION()
+	void OnGrindActorEndPlay(AActor* Actor, EEndPlayReason::Type EndPlayReason);
+
+	// Register a moved grind actor at its new bounds
+	void OnGrindActorTransformUpdated(USceneComponent* Component, EUpdateTransformFlags UpdateTransformFlags, ETeleportType Teleport);
+
+	// Remove a grind actor from the grid cells only, keeping it watched
+	void RemoveFromGrid(AActor* GrindActor);
+
+	FDelegateHandle LevelAddedHandle;
+	FDelegateHandle LevelRemovedHandle;
+	FDelegateHandle ActorSpawnedHandle;
+
+	// Grind actors registered by their bounds, whose end play and movement are watched
+	TSet<TWeakObjectPtr<AActor>> WatchedGrindActors;
+
+	// Size of a grid cell. Large enough that a rail piece usually touches only a few cells.
+	static constexpr float CellSize = 1000.0f;
+
+	// Range of cells a box covers
+	static void GetCellRange(const FBox& Bounds, FIntVector& OutMinCell, FIntVector& OutMaxCell);
+
+	// Grid cells with the grind actor bounds that overlap them
+	TMap<FIntVector,TArray<FGrindRailCellEntry>> Cells;
+
+	// Cells each grind actor was added to, for unregistering
+	TMap<TWeakObjectPtr<AActor>,TArray<FIntVector>> GrindActorCells;
+};
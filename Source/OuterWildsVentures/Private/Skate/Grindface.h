@@ -22,22 +22,22 @@ class IGrindface
 
 	// Add interface functions to this class. This is the class that will be inherited to implement this interface.
 public:
-	UFUNCTION(BlueprintImplementableEvent)
+	UFUNCTION(BlueprintNativeEvent)
 	FVector FindSplineTangentNearHitLocation(FVector NearHitLocation);
 
-	UFUNCTION(BlueprintImplementableEvent)
+	UFUNCTION(BlueprintNativeEvent)
 	FVector GetInitialSnapPoint(FVector HitLocation);
 
-	UFUNCTION(BlueprintImplementableEvent)
+	UFUNCTION(BlueprintNativeEvent)
 	float GetSplineLength();
 
-	UFUNCTION(BlueprintImplementableEvent)
+	UFUNCTION(BlueprintNativeEvent)
 	float GetInitialHitDistanceAlongSpline(FVector HitLocaion);
 
-	UFUNCTION(BlueprintImplementableEvent)
+	UFUNCTION(BlueprintNativeEvent)
 	FVector GetSnapPointAtDistanceAlongSpline(float DistanceAlongSpline);
 
-	UFUNCTION(BlueprintImplementableEvent)
+	UFUNCTION(BlueprintNativeEvent)
 	FVector GetTangentAtDistanceAlongSpline(float DistanceAlongSpline);
 	
 };
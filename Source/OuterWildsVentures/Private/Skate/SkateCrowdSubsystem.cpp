@@ -0,0 +1,386 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Skate/SkateCrowdSubsystem.h"
+
+#include "Skater.h"
+
+DECLARE_CYCLE_STAT(TEXT("Crowd Gather"),STAT_SkateCrowdGather,STATGROUP_Skate);
+DECLARE_CYCLE_STAT(TEXT("Crowd Simulate"),STAT_SkateCrowdSimulate,STATGROUP_Skate);
+DECLARE_CYCLE_STAT(TEXT("Crowd Apply"),STAT_SkateCrowdApply,STATGROUP_Skate);
+DECLARE_CYCLE_STAT(TEXT("Crowd Check Grinding"),STAT_SkateCrowdCheckGrinding,STATGROUP_Skate);
+DECLARE_CYCLE_STAT(TEXT("Crowd Skaters"),STAT_SkateCrowdSkaters,STATGROUP_Skate);
+
+void FSkateCrowdTickFunction::ExecuteTick(float DeltaTime, ELevelTick TickType, ENamedThreads::Type CurrentThread, const FGraphEventRef& MyCompletionGraphEvent)
+{
+	if (!IsValid(Target) || TickType == LEVELTICK_ViewportsOnly)
+	{
+		return;
+	}
+
+	if (bPostPhysics)
+	{
+		Target->PostPhysicsTick(DeltaTime);
+	}
+	else
+	{
+		Target->PrePhysicsTick(DeltaTime);
+	}
+}
+
+FString FSkateCrowdTickFunction::DiagnosticMessage()
+{
+	const TCHAR* Stage = bPostPhysics ? TEXT("[PostPhysicsTick]") : TEXT("[PrePhysicsTick]");
+	return Target ? Target->GetFullName() + Stage : FString(TEXT("<NULL>")) + Stage;
+}
+
+int32 FSkateCrowdState::Num() const
+{
+	return Skaters.Num();
+}
+
+int32 FSkateCrowdState::Add(ASkater* Skater, ASkatePhysics* InSkatePhysics)
+{
+	const int32 Index = Skaters.Add(Skater);
+	SkatePhysics.Add(InSkatePhysics);
+
+	SkateModes.AddDefaulted();
+	Velocities.AddDefaulted();
+	MaxVelocities.AddDefaulted();
+	bVelocitiesClamped.AddDefaulted();
+	bStickToGround.AddDefaulted();
+	StickToGroundDirections.AddDefaulted();
+
+	GrindCooldownTrackers.AddDefaulted();
+	GrindCooldownTargets.AddDefaulted();
+	bGrindCooldownsComplete.AddDefaulted();
+
+	bGrindStepping.AddDefaulted();
+	GrindStepAccumulators.AddDefaulted();
+	GrindDistances.AddDefaulted();
+	PreviousGrindDistances.AddDefaulted();
+	GrindSpeeds.AddDefaulted();
+	GrindSplineLengths.AddDefaulted();
+	GrindStepSeconds.AddDefaulted();
+	GrindMaxStepsPerTick.AddDefaulted();
+	bGrindStepped.AddDefaulted();
+	bOnRail.AddDefaulted();
+
+	bPumped.AddDefaulted();
+	PumpCooldownTrackers.AddDefaulted();
+	PumpCooldownTargets.AddDefaulted();
+
+	return Index;
+}
+
+void FSkateCrowdState::RemoveAtSwap(int32 Index)
+{
+	Skaters.RemoveAtSwap(Index);
+	SkatePhysics.RemoveAtSwap(Index);
+
+	SkateModes.RemoveAtSwap(Index);
+	Velocities.RemoveAtSwap(Index);
+	MaxVelocities.RemoveAtSwap(Index);
+	bVelocitiesClamped.RemoveAtSwap(Index);
+	bStickToGround.RemoveAtSwap(Index);
+	StickToGroundDirections.RemoveAtSwap(Index);
+
+	GrindCooldownTrackers.RemoveAtSwap(Index);
+	GrindCooldownTargets.RemoveAtSwap(Index);
+	bGrindCooldownsComplete.RemoveAtSwap(Index);
+
+	bGrindStepping.RemoveAtSwap(Index);
+	GrindStepAccumulators.RemoveAtSwap(Index);
+	GrindDistances.RemoveAtSwap(Index);
+	PreviousGrindDistances.RemoveAtSwap(Index);
+	GrindSpeeds.RemoveAtSwap(Index);
+	GrindSplineLengths.RemoveAtSwap(Index);
+	GrindStepSeconds.RemoveAtSwap(Index);
+	GrindMaxStepsPerTick.RemoveAtSwap(Index);
+	bGrindStepped.RemoveAtSwap(Index);
+	bOnRail.RemoveAtSwap(Index);
+
+	bPumped.RemoveAtSwap(Index);
+	PumpCooldownTrackers.RemoveAtSwap(Index);
+	PumpCooldownTargets.RemoveAtSwap(Index);
+}
+
+void USkateCrowdSubsystem::OnWorldBeginPlay(UWorld& InWorld)
+{
+	Super::OnWorldBeginPlay(InWorld);
+
+	// Same groups as skate physics and its skater
+	PrePhysicsTickFunction.bCanEverTick = true;
+	PrePhysicsTickFunction.TickGroup = TG_PrePhysics;
+	PrePhysicsTickFunction.Target = this;
+	PrePhysicsTickFunction.RegisterTickFunction(InWorld.PersistentLevel);
+
+	PostPhysicsTickFunction.bCanEverTick = true;
+	PostPhysicsTickFunction.TickGroup = TG_PostPhysics;
+	PostPhysicsTickFunction.Target = this;
+	PostPhysicsTickFunction.bPostPhysics = true;
+	PostPhysicsTickFunction.AddPrerequisite(this,PrePhysicsTickFunction);
+	PostPhysicsTickFunction.RegisterTickFunction(InWorld.PersistentLevel);
+}
+
+void USkateCrowdSubsystem::Deinitialize()
+{
+	if (PostPhysicsTickFunction.IsTickFunctionRegistered())
+	{
+		PostPhysicsTickFunction.UnRegisterTickFunction();
+	}
+	if (PrePhysicsTickFunction.IsTickFunctionRegistered())
+	{
+		PrePhysicsTickFunction.UnRegisterTickFunction();
+	}
+
+	Super::Deinitialize();
+}
+
+void USkateCrowdSubsystem::PrePhysicsTick(float DeltaTime)
+{
+	RemoveInvalidSkaters();
+	if (CrowdState.Num() == 0)
+	{
+		return;
+	}
+
+	GatherCrowdState(DeltaTime);
+	SimulateCrowdState(DeltaTime);
+	ApplyCrowdState(DeltaTime);
+}
+
+void USkateCrowdSubsystem::PostPhysicsTick(float DeltaTime)
+{
+	RemoveInvalidSkaters();
+	if (CrowdState.Num() == 0)
+	{
+		return;
+	}
+
+	// Skate physics post physics tick, then the skater tick that waits on it
+	CheckCrowdGrinding();
+	ApplySkaterState(DeltaTime);
+}
+
+void USkateCrowdSubsystem::AddSkater(ASkater* Skater)
+{
+	if (!Skater || !Skater->SkatePhysics || CrowdState.Skaters.Contains(Skater))
+	{
+		return;
+	}
+
+	CrowdState.Add(Skater,Skater->SkatePhysics);
+	Skater->SetActorTickEnabled(false);
+	Skater->SkatePhysics->SetActorTickEnabled(false);
+}
+
+void USkateCrowdSubsystem::RemoveSkater(ASkater* Skater)
+{
+	const int32 Index = CrowdState.Skaters.Find(Skater);
+	if (Index != INDEX_NONE)
+	{
+		RemoveSkaterAt(Index);
+	}
+}
+
+void USkateCrowdSubsystem::RemoveSkaterAt(int32 Index)
+{
+	ASkater* Skater = CrowdState.Skaters[Index];
+	ASkatePhysics* SkatePhysics = CrowdState.SkatePhysics[Index];
+	CrowdState.RemoveAtSwap(Index);
+
+	if (IsValid(Skater) && !Skater->IsActorBeingDestroyed())
+	{
+		Skater->SetActorTickEnabled(true);
+	}
+	if (IsValid(SkatePhysics) && !SkatePhysics->IsActorBeingDestroyed())
+	{
+		SkatePhysics->SetActorTickEnabled(true);
+	}
+}
+
+void USkateCrowdSubsystem::RemoveInvalidSkaters()
+{
+	for (int32 Index = CrowdState.Num() - 1; Index >= 0; Index--)
+	{
+		if (!IsValid(CrowdState.Skaters[Index]) || !IsValid(CrowdState.SkatePhysics[Index]))
+		{
+			RemoveSkaterAt(Index);
+		}
+	}
+}
+
+void USkateCrowdSubsystem::GatherCrowdState(float DeltaTime)
+{
+	SCOPE_CYCLE_COUNTER(STAT_SkateCrowdGather);
+
+	for (int32 Index = 0; Index < CrowdState.Num(); Index++)
+	{
+		// Same as skate physics tick, input from a remote owner goes first
+		CrowdState.Skaters[Index]->ApplyQueuedNetInput();
+
+		ASkatePhysics* SkatePhysics = CrowdState.SkatePhysics[Index];
+		SkatePhysics->TickDelta = DeltaTime;
+
+		// Same as skate physics tick. The branch taken is decided by the mode at the start of the tick.
+		CrowdState.SkateModes[Index] = SkatePhysics->CurrentSkateMode;
+
+		CrowdState.Velocities[Index] = SkatePhysics->RootSphere->GetPhysicsLinearVelocity();
+		CrowdState.MaxVelocities[Index] = SkatePhysics->MaxVelocity;
+		CrowdState.bStickToGround[Index] = SkatePhysics->GetStickToGroundDirection(CrowdState.StickToGroundDirections[Index]);
+
+		CrowdState.GrindCooldownTrackers[Index] = SkatePhysics->GrindCurrentCooldownTracker;
+		CrowdState.GrindCooldownTargets[Index] = SkatePhysics->GrindCooldownTargetSeconds;
+		CrowdState.bGrindCooldownsComplete[Index] = SkatePhysics->bGrindCooldownComplete;
+
+		CrowdState.bGrindStepping[Index] = CrowdState.SkateModes[Index] == ESkateMode::Grind && SkatePhysics->bGrindInitialSnapHappened;
+		CrowdState.GrindStepAccumulators[Index] = SkatePhysics->GrindStepAccumulator;
+		CrowdState.GrindDistances[Index] = SkatePhysics->GrindCurrentDistance;
+		CrowdState.PreviousGrindDistances[Index] = SkatePhysics->PreviousGrindDistance;
+		CrowdState.GrindSpeeds[Index] = SkatePhysics->GetGrindSpeed();
+		CrowdState.GrindSplineLengths[Index] = SkatePhysics->GrindSplineLength;
+		CrowdState.GrindStepSeconds[Index] = SkatePhysics->GrindStepSeconds;
+		CrowdState.GrindMaxStepsPerTick[Index] = SkatePhysics->GrindMaxStepsPerTick;
+
+		const ASkater* Skater = CrowdState.Skaters[Index];
+		CrowdState.bPumped[Index] = Skater->bPumped;
+		CrowdState.PumpCooldownTrackers[Index] = Skater->PumpCooldownTracker;
+		CrowdState.PumpCooldownTargets[Index] = Skater->PumpCooldownTarget;
+	}
+}
+
+void USkateCrowdSubsystem::SimulateCrowdState(float DeltaTime)
+{
+	SCOPE_CYCLE_COUNTER(STAT_SkateCrowdSimulate);
+
+	const int32 Count = CrowdState.Num();
+
+	// Velocity clamp
+	for (int32 Index = 0; Index < Count; Index++)
+	{
+		const double Speed = CrowdState.Velocities[Index].Length();
+		CrowdState.bVelocitiesClamped[Index] = CrowdState.SkateModes[Index] != ESkateMode::Grind && Speed > CrowdState.MaxVelocities[Index];
+		if (CrowdState.bVelocitiesClamped[Index])
+		{
+			CrowdState.Velocities[Index] *= CrowdState.MaxVelocities[Index] / Speed;
+		}
+	}
+
+	// Grind cooldown
+	for (int32 Index = 0; Index < Count; Index++)
+	{
+		if (CrowdState.SkateModes[Index] != ESkateMode::Grind)
+		{
+			ASkatePhysics::StepCooldown(DeltaTime,CrowdState.GrindCooldownTargets[Index],CrowdState.GrindCooldownTrackers[Index],CrowdState.bGrindCooldownsComplete[Index]);
+		}
+	}
+
+	// Grind steps
+	for (int32 Index = 0; Index < Count; Index++)
+	{
+		if (CrowdState.bGrindStepping[Index])
+		{
+			CrowdState.bOnRail[Index] = ASkatePhysics::StepGrindDistance(DeltaTime,CrowdState.GrindStepSeconds[Index],CrowdState.GrindMaxStepsPerTick[Index],
+				CrowdState.GrindSpeeds[Index],CrowdState.GrindSplineLengths[Index],CrowdState.GrindStepAccumulators[Index],
+				CrowdState.GrindDistances[Index],CrowdState.PreviousGrindDistances[Index],CrowdState.bGrindStepped[Index]);
+		}
+	}
+
+	// Pump cooldown
+	for (int32 Index = 0; Index < Count; Index++)
+	{
+		if (CrowdState.bPumped[Index])
+		{
+			CrowdState.PumpCooldownTrackers[Index] += DeltaTime;
+			if (CrowdState.PumpCooldownTrackers[Index] > CrowdState.PumpCooldownTargets[Index])
+			{
+				CrowdState.PumpCooldownTrackers[Index] = 0.0f;
+				CrowdState.bPumped[Index] = false;
+			}
+		}
+	}
+}
+
+void USkateCrowdSubsystem::ApplyCrowdState(float DeltaTime)
+{
+	SCOPE_CYCLE_COUNTER(STAT_SkateCrowdApply);
+
+	for (int32 Index = 0; Index < CrowdState.Num(); Index++)
+	{
+		ASkatePhysics* SkatePhysics = CrowdState.SkatePhysics[Index];
+		if (CrowdState.SkateModes[Index] != ESkateMode::Grind)
+		{
+			if (!SkatePhysics->bAsyncPhysicsForces)
+			{
+				if (CrowdState.bVelocitiesClamped[Index])
+				{
+					SkatePhysics->RootSphere->SetPhysicsLinearVelocity(CrowdState.Velocities[Index]);
+				}
+				if (CrowdState.bStickToGround[Index])
+				{
+					SkatePhysics->RootSphere->AddForce(CrowdState.StickToGroundDirections[Index] * 1000,NAME_None,true);
+				}
+				SkatePhysics->ApplyActiveAccelerations();
+			}
+
+			SkatePhysics->GrindCurrentCooldownTracker = CrowdState.GrindCooldownTrackers[Index];
+			SkatePhysics->bGrindCooldownComplete = CrowdState.bGrindCooldownsComplete[Index];
+
+			if (SkatePhysics->bOllieNextFrame)
+			{
+				SkatePhysics->Ollie();
+			}
+		}
+		else if (CrowdState.bGrindStepping[Index])
+		{
+			SkatePhysics->GrindStepAccumulator = CrowdState.GrindStepAccumulators[Index];
+			SkatePhysics->GrindCurrentDistance = CrowdState.GrindDistances[Index];
+			SkatePhysics->PreviousGrindDistance = CrowdState.PreviousGrindDistances[Index];
+			SkatePhysics->FinishGrindStep(CrowdState.bOnRail[Index],CrowdState.bGrindStepped[Index]);
+		}
+		else
+		{
+			// Initial snap onto the grind spline
+			SkatePhysics->Grind();
+		}
+
+		if (SkatePhysics->bAsyncPhysicsForces)
+		{
+			SkatePhysics->SendForceInput();
+		}
+	}
+}
+
+void USkateCrowdSubsystem::ApplySkaterState(float DeltaTime)
+{
+	SCOPE_CYCLE_COUNTER(STAT_SkateCrowdSkaters);
+
+	for (int32 Index = 0; Index < CrowdState.Num(); Index++)
+	{
+		ASkater* Skater = CrowdState.Skaters[Index];
+		Skater->TickDelta = DeltaTime;
+		Skater->bPumped = CrowdState.bPumped[Index];
+		Skater->PumpCooldownTracker = CrowdState.PumpCooldownTrackers[Index];
+
+		Skater->GroundAdjust();
+		Skater->MoveWithSkatePhysics();
+
+		// Crowd skaters have no camera. Mesh follows the rotation tracker without interpolation.
+		Skater->MaxMesh->SetWorldRotation(Skater->RotationTracker->GetComponentRotation());
+	}
+}
+
+void USkateCrowdSubsystem::CheckCrowdGrinding()
+{
+	SCOPE_CYCLE_COUNTER(STAT_SkateCrowdCheckGrinding);
+
+	// Same as skate physics post physics tick. A grind found now starts the skater's next skate physics tick.
+	for (ASkatePhysics* SkatePhysics : CrowdState.SkatePhysics)
+	{
+		if (SkatePhysics->CurrentSkateMode != ESkateMode::Grind)
+		{
+			SkatePhysics->CheckGrinding();
+		}
+	}
+}
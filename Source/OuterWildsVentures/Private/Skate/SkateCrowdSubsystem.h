@@ -0,0 +1,149 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "SkatePhysics.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "SkateCrowdSubsystem.generated.h"
+
+class ASkater;
+class USkateCrowdSubsystem;
+
+/**
+ * Hot simulation state of crowd skaters, one entry per skater in each array.
+ */
+USTRUCT()
+struct FSkateCrowdState
+{
+	GENERATED_BODY()
+
+	// Actors. Referenced so a destroyed actor is nulled rather than left dangling.
+	UPROPERTY()
+	TArray<ASkater*> Skaters;
+
+	UPROPERTY()
+	TArray<ASkatePhysics*> SkatePhysics;
+
+	// Movement
+	TArray<TEnumAsByte<ESkateMode>> SkateModes;
+	TArray<FVector> Velocities;
+	TArray<float> MaxVelocities;
+	TArray<bool> bVelocitiesClamped;
+	TArray<bool> bStickToGround;
+	TArray<FVector> StickToGroundDirections;
+
+	// Grind cooldown
+	TArray<float> GrindCooldownTrackers;
+	TArray<float> GrindCooldownTargets;
+	TArray<bool> bGrindCooldownsComplete;
+
+	// Grind steps
+	TArray<bool> bGrindStepping;
+	TArray<float> GrindStepAccumulators;
+	TArray<float> GrindDistances;
+	TArray<float> PreviousGrindDistances;
+	TArray<float> GrindSpeeds;
+	TArray<float> GrindSplineLengths;
+	TArray<float> GrindStepSeconds;
+	TArray<int32> GrindMaxStepsPerTick;
+	TArray<bool> bGrindStepped;
+	TArray<bool> bOnRail;
+
+	// Pump cooldown
+	TArray<bool> bPumped;
+	TArray<float> PumpCooldownTrackers;
+	TArray<float> PumpCooldownTargets;
+
+	int32 Num() const;
+
+	// Add an entry. Everything but the actors is filled in when gathering.
+	int32 Add(ASkater* Skater, ASkatePhysics* InSkatePhysics);
+
+	void RemoveAtSwap(int32 Index);
+};
+
+/**
+ * One stage of the crowd tick, in the tick group of the skate actor stage it stands in for.
+ */
+USTRUCT()
+struct FSkateCrowdTickFunction : public FTickFunction
+{
+	GENERATED_BODY()
+
+	USkateCrowdSubsystem* Target = nullptr;
+
+	// Post physics stage rather than pre physics
+	bool bPostPhysics = false;
+
+	virtual void ExecuteTick(float DeltaTime, ELevelTick TickType, ENamedThreads::Type CurrentThread, const FGraphEventRef& MyCompletionGraphEvent) override;
+	virtual FString DiagnosticMessage() override;
+};
+
+template<>
+struct TStructOpsTypeTraits<FSkateCrowdTickFunction> : public TStructOpsTypeTraitsBase2<FSkateCrowdTickFunction>
+{
+	enum
+	{
+		WithCopy = false
+	};
+};
+
+/**
+ * Ticks crowd skaters and their skate physics in one batched pass instead of one actor tick each.
+ * State is gathered from the actors into contiguous arrays, simulated per array, then written back.
+ * Forces are applied pre physics and skaters follow post physics, the same frame as skaters ticked by their actors.
+ * Scene queries (grind and ground checks) still run per skater. Blueprint camera and mesh rotation events are skipped.
+ */
+UCLASS()
+class USkateCrowdSubsystem : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	// Register the crowd tick stages
+	virtual void OnWorldBeginPlay(UWorld& InWorld) override;
+	virtual void Deinitialize() override;
+
+	// Gather, simulate and apply skate physics state. Stands in for the skate physics tick.
+	void PrePhysicsTick(float DeltaTime);
+
+	// Check for grinding, then move skaters with their skate physics. Stands in for the skate physics post physics tick and the skater tick.
+	void PostPhysicsTick(float DeltaTime);
+
+public:
+	// Functions
+
+	// Tick a paired skater and its skate physics with the crowd. Their actor ticks are disabled.
+	void AddSkater(ASkater* Skater);
+
+	// Stop ticking a skater with the crowd. Actor ticks are enabled again unless the actors are going away.
+	void RemoveSkater(ASkater* Skater);
+
+protected:
+	void RemoveSkaterAt(int32 Index);
+
+	// Drop entries whose skater or skate physics has been destroyed
+	void RemoveInvalidSkaters();
+
+	// Run per skater queries and read actor state into the crowd arrays
+	void GatherCrowdState(float DeltaTime);
+
+	// Simulate velocity clamps, cooldowns and grind steps over the crowd arrays
+	void SimulateCrowdState(float DeltaTime);
+
+	// Write simulated state back to the skate physics actors
+	void ApplyCrowdState(float DeltaTime);
+
+	// Write skater state back and move skaters with their skate physics
+	void ApplySkaterState(float DeltaTime);
+
+	// Look for rails to grind from this frame's simulated positions
+	void CheckCrowdGrinding();
+
+	UPROPERTY()
+	FSkateCrowdState CrowdState;
+
+	FSkateCrowdTickFunction PrePhysicsTickFunction;
+	FSkateCrowdTickFunction PostPhysicsTickFunction;
+};
@@ -0,0 +1,311 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Skate/SkateGhost.h"
+
+#include "Algo/BinarySearch.h"
+#include "Async/MappedFileHandle.h"
+#include "HAL/FileManager.h"
+#include "HAL/PlatformFileManager.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+
+namespace SkateGhost
+{
+	void SerializePackedFrame(FArchive& Ar, FSkateReplayPackedFrame& Frame)
+	{
+		Ar << Frame.LocationDelta[0] << Frame.LocationDelta[1] << Frame.LocationDelta[2];
+		Ar << Frame.Rotation[0] << Frame.Rotation[1] << Frame.Rotation[2];
+		Ar << Frame.GrindDistanceDelta;
+		Ar << Frame.SkateMode << Frame.SkaterAnimation << Frame.BoardAnimation << Frame.Flags;
+		Ar << Frame.SkaterAnimationTime << Frame.BoardAnimationTime;
+	}
+
+	void SerializeChunkKeyframe(FArchive& Ar, FSkateReplayKeyframe& Keyframe)
+	{
+		Ar << Keyframe.Location.X << Keyframe.Location.Y << Keyframe.Location.Z;
+		Ar << Keyframe.GrindDistance;
+	}
+}
+
+FArchive& operator<<(FArchive& Ar, FSkateGhostHeader& Header)
+{
+	Ar << Header.Magic << Header.Version << Header.StepSeconds;
+	Ar << Header.FrameCount << Header.ChunkCount << Header.AnimationCount;
+	Ar << Header.AnimationTableOffset << Header.ChunkIndexOffset;
+	return Ar;
+}
+
+FArchive& operator<<(FArchive& Ar, FSkateGhostChunkIndexEntry& Entry)
+{
+	Ar << Entry.FirstFrame << Entry.FrameCount << Entry.Offset << Entry.Size;
+	return Ar;
+}
+
+FSkateGhostWriter::~FSkateGhostWriter()
+{
+	if (IsWriting())
+	{
+		End();
+	}
+}
+
+bool FSkateGhostWriter::Begin(const FString& FilePath, float StepSeconds, int32 InFramesPerChunk)
+{
+	FileWriter.Reset(IFileManager::Get().CreateFileWriter(*FilePath));
+	if (!FileWriter)
+	{
+		return false;
+	}
+
+	Header = FSkateGhostHeader();
+	Header.StepSeconds = StepSeconds;
+	Codec = FSkateReplayCodec();
+	ChunkIndex.Reset();
+	ChunkFrameCount = 0;
+	FramesPerChunk = FMath::Max(1,InFramesPerChunk);
+
+	// Placeholder, rewritten with counts and offsets on End
+	*FileWriter << Header;
+	return true;
+}
+
+void FSkateGhostWriter::WriteFrame(const FSkateReplayFrame& Frame)
+{
+	if (!IsWriting())
+	{
+		return;
+	}
+
+	FSkateReplayPackedFrame Packed;
+	if (ChunkFrameCount > 0 && ChunkFrameCount < static_cast<uint32>(FramesPerChunk) && Codec.EncodeDelta(Frame,Packed))
+	{
+		FMemoryWriter ChunkWriter(ChunkData,false,true);
+		SkateGhost::SerializePackedFrame(ChunkWriter,Packed);
+	}
+	else
+	{
+		// Full chunk, or a delta too large to pack. Either way the frame starts a new chunk.
+		FlushChunk();
+
+		Codec.EncodeKeyframe(Frame,Header.FrameCount,Packed,ChunkKeyframe);
+		ChunkData.Reset();
+		FMemoryWriter ChunkWriter(ChunkData);
+		SkateGhost::SerializeChunkKeyframe(ChunkWriter,ChunkKeyframe);
+		SkateGhost::SerializePackedFrame(ChunkWriter,Packed);
+	}
+
+	ChunkFrameCount++;
+	Header.FrameCount++;
+}
+
+bool FSkateGhostWriter::End()
+{
+	if (!IsWriting())
+	{
+		return false;
+	}
+
+	FlushChunk();
+
+	Header.AnimationTableOffset = FileWriter->Tell();
+	Header.AnimationCount = Codec.Animations.Num();
+	for (const TWeakObjectPtr<UAnimationAsset>& Animation : Codec.Animations)
+	{
+		FString AnimationPath = FSoftObjectPath(Animation.Get()).ToString();
+		*FileWriter << AnimationPath;
+	}
+
+	Header.ChunkIndexOffset = FileWriter->Tell();
+	Header.ChunkCount = ChunkIndex.Num();
+	for (FSkateGhostChunkIndexEntry& Entry : ChunkIndex)
+	{
+		*FileWriter << Entry;
+	}
+
+	FileWriter->Seek(0);
+	*FileWriter << Header;
+
+	const bool bSuccess = FileWriter->Close();
+	FileWriter.Reset();
+	return bSuccess;
+}
+
+bool FSkateGhostWriter::IsWriting() const
+{
+	return FileWriter.IsValid();
+}
+
+void FSkateGhostWriter::FlushChunk()
+{
+	if (ChunkFrameCount == 0)
+	{
+		return;
+	}
+
+	FSkateGhostChunkIndexEntry& Entry = ChunkIndex.AddDefaulted_GetRef();
+	Entry.FirstFrame = Header.FrameCount - ChunkFrameCount;
+	Entry.FrameCount = ChunkFrameCount;
+	Entry.Offset = FileWriter->Tell();
+	Entry.Size = ChunkData.Num();
+	FileWriter->Serialize(ChunkData.GetData(),ChunkData.Num());
+
+	ChunkData.Reset();
+	ChunkFrameCount = 0;
+}
+
+FSkateGhostReader::~FSkateGhostReader()
+{
+	// Regions have to be released before the file handle
+	ChunkReader.Reset();
+	MappedChunk.Reset();
+	MappedFile.Reset();
+}
+
+bool FSkateGhostReader::Open(const FString& FilePath)
+{
+	ChunkReader.Reset();
+	MappedChunk.Reset();
+	MappedFile.Reset(FPlatformFileManager::Get().GetPlatformFile().OpenMapped(*FilePath));
+	if (!MappedFile || MappedFile->GetFileSize() < FSkateGhostHeader::SerializedSize)
+	{
+		return false;
+	}
+
+	{
+		const TUniquePtr<IMappedFileRegion> HeaderRegion(MappedFile->MapRegion(0,FSkateGhostHeader::SerializedSize));
+		if (!HeaderRegion)
+		{
+			return false;
+		}
+		FMemoryReaderView HeaderReader(FMemoryView(HeaderRegion->GetMappedPtr(),HeaderRegion->GetMappedSize()));
+		HeaderReader << Header;
+	}
+
+	if (Header.Magic != FSkateGhostHeader::ExpectedMagic || Header.Version != FSkateGhostHeader::CurrentVersion
+		|| Header.ChunkIndexOffset < Header.AnimationTableOffset || Header.ChunkIndexOffset > MappedFile->GetFileSize())
+	{
+		return false;
+	}
+
+	// Animation table and chunk index are read once and unmapped again
+	{
+		const TUniquePtr<IMappedFileRegion> TableRegion(MappedFile->MapRegion(Header.AnimationTableOffset,MappedFile->GetFileSize() - Header.AnimationTableOffset));
+		if (!TableRegion)
+		{
+			return false;
+		}
+		FMemoryReaderView TableReader(FMemoryView(TableRegion->GetMappedPtr(),TableRegion->GetMappedSize()));
+
+		Codec = FSkateReplayCodec();
+		LoadedAnimations.Reset();
+		for (uint32 AnimationIndex = 0; AnimationIndex < Header.AnimationCount && !TableReader.IsError(); AnimationIndex++)
+		{
+			FString AnimationPath;
+			TableReader << AnimationPath;
+			UAnimationAsset* Animation = Cast<UAnimationAsset>(FSoftObjectPath(AnimationPath).TryLoad());
+			LoadedAnimations.Emplace(Animation);
+			if (Codec.Animations.Num() < FSkateReplayCodec::MaxAnimations)
+			{
+				Codec.Animations.Add(Animation);
+			}
+		}
+
+		TableReader.Seek(Header.ChunkIndexOffset - Header.AnimationTableOffset);
+		Chunks.SetNum(Header.ChunkCount);
+		for (FSkateGhostChunkIndexEntry& Entry : Chunks)
+		{
+			TableReader << Entry;
+		}
+		if (TableReader.IsError())
+		{
+			return false;
+		}
+	}
+
+	return Seek(0);
+}
+
+int32 FSkateGhostReader::GetFrameCount() const
+{
+	return Header.FrameCount;
+}
+
+float FSkateGhostReader::GetStepSeconds() const
+{
+	return Header.StepSeconds;
+}
+
+bool FSkateGhostReader::Seek(int32 FrameNumber)
+{
+	// Last chunk starting at or before the frame
+	const int32 ChunkIndex = Algo::UpperBoundBy(Chunks,static_cast<uint32>(FrameNumber),&FSkateGhostChunkIndexEntry::FirstFrame) - 1;
+	if (FrameNumber < 0 || static_cast<uint32>(FrameNumber) >= Header.FrameCount || !Chunks.IsValidIndex(ChunkIndex) || !MapChunk(ChunkIndex))
+	{
+		return false;
+	}
+
+	// Deltas have to be decoded from the chunk start
+	FSkateReplayFrame SkippedFrame;
+	while (NextFrameNumber < static_cast<uint32>(FrameNumber))
+	{
+		ReadFrame(SkippedFrame);
+	}
+	return true;
+}
+
+bool FSkateGhostReader::ReadFrame(FSkateReplayFrame& OutFrame)
+{
+	if (!MappedFile || NextFrameNumber >= Header.FrameCount)
+	{
+		return false;
+	}
+
+	const FSkateGhostChunkIndexEntry& Chunk = Chunks[CurrentChunk];
+	if (NextFrameNumber >= Chunk.FirstFrame + Chunk.FrameCount && !MapChunk(CurrentChunk + 1))
+	{
+		return false;
+	}
+
+	FSkateReplayPackedFrame Packed;
+	SkateGhost::SerializePackedFrame(*ChunkReader,Packed);
+	if (ChunkReader->IsError())
+	{
+		return false;
+	}
+
+	Codec.Decode(Packed,&CurrentChunkKeyframe,OutFrame);
+	NextFrameNumber++;
+	return true;
+}
+
+bool FSkateGhostReader::MapChunk(int32 ChunkIndex)
+{
+	if (!Chunks.IsValidIndex(ChunkIndex))
+	{
+		return false;
+	}
+
+	ChunkReader.Reset();
+	MappedChunk.Reset();
+
+	const FSkateGhostChunkIndexEntry& Chunk = Chunks[ChunkIndex];
+	if (Chunk.Offset < FSkateGhostHeader::SerializedSize || Chunk.Offset + Chunk.Size > MappedFile->GetFileSize())
+	{
+		return false;
+	}
+
+	MappedChunk.Reset(MappedFile->MapRegion(Chunk.Offset,Chunk.Size,true));
+	if (!MappedChunk)
+	{
+		return false;
+	}
+
+	ChunkReader = MakeUnique<FMemoryReaderView>(FMemoryView(MappedChunk->GetMappedPtr(),MappedChunk->GetMappedSize()));
+	SkateGhost::SerializeChunkKeyframe(*ChunkReader,CurrentChunkKeyframe);
+	CurrentChunkKeyframe.FrameNumber = Chunk.FirstFrame;
+
+	CurrentChunk = ChunkIndex;
+	NextFrameNumber = Chunk.FirstFrame;
+	return !ChunkReader->IsError();
+}
@@ -0,0 +1,129 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "SkateReplay.h"
+#include "UObject/StrongObjectPtr.h"
+
+class IMappedFileHandle;
+class IMappedFileRegion;
+
+/**
+ * Ghost run file header. A ghost file is laid out as
+ * [Header][Chunk]...[Chunk][Animation table][Chunk index]
+ * Each chunk starts with a full precision keyframe followed by packed replay frames, so chunks decode independently.
+ */
+struct FSkateGhostHeader
+{
+	// "SKGH"
+	static constexpr uint32 ExpectedMagic = 0x48474B53;
+
+	// Bump when the layout changes. Readers reject other versions.
+	static constexpr uint32 CurrentVersion = 1;
+
+	uint32 Magic = ExpectedMagic;
+	uint32 Version = CurrentVersion;
+
+	// Seconds between frames
+	float StepSeconds = 0.0f;
+
+	uint32 FrameCount = 0;
+	uint32 ChunkCount = 0;
+	uint32 AnimationCount = 0;
+
+	int64 AnimationTableOffset = 0;
+	int64 ChunkIndexOffset = 0;
+
+	// Size of the header on disk
+	static constexpr int64 SerializedSize = 4 * 6 + 8 * 2;
+
+	friend FArchive& operator<<(FArchive& Ar, FSkateGhostHeader& Header);
+};
+
+/**
+ * Where a chunk is in the file and which frames it holds.
+ */
+struct FSkateGhostChunkIndexEntry
+{
+	uint32 FirstFrame = 0;
+	uint32 FrameCount = 0;
+	int64 Offset = 0;
+	int64 Size = 0;
+
+	friend FArchive& operator<<(FArchive& Ar, FSkateGhostChunkIndexEntry& Entry);
+};
+
+/**
+ * Streams a ghost run to disk as it is recorded. Only the chunk being filled is held in memory.
+ */
+class FSkateGhostWriter
+{
+public:
+	~FSkateGhostWriter();
+
+	// Create the ghost file. Frames are written every StepSeconds, grouped into chunks of at most FramesPerChunk.
+	bool Begin(const FString& FilePath, float StepSeconds, int32 FramesPerChunk = 256);
+
+	// Append a frame
+	void WriteFrame(const FSkateReplayFrame& Frame);
+
+	// Write the last chunk, animation table and index, and close the file
+	bool End();
+
+	bool IsWriting() const;
+
+protected:
+	// Write the chunk being filled to the file and add it to the index
+	void FlushChunk();
+
+	TUniquePtr<FArchive> FileWriter;
+	FSkateGhostHeader Header;
+	FSkateReplayCodec Codec;
+	TArray<FSkateGhostChunkIndexEntry> ChunkIndex;
+
+	// Chunk being filled. Reused for every chunk.
+	TArray<uint8> ChunkData;
+	FSkateReplayKeyframe ChunkKeyframe;
+	uint32 ChunkFrameCount = 0;
+	int32 FramesPerChunk = 256;
+};
+
+/**
+ * Plays back a ghost file by memory mapping it. Only the chunk being read is mapped, so many ghosts can run at once.
+ */
+class FSkateGhostReader : public FSkateReplayFrameSource
+{
+public:
+	~FSkateGhostReader();
+
+	// Map a ghost file and read its header, animation table and chunk index
+	bool Open(const FString& FilePath);
+
+	int32 GetFrameCount() const;
+	float GetStepSeconds() const;
+
+	// Move to a frame. The next read returns it.
+	bool Seek(int32 FrameNumber);
+
+	virtual bool ReadFrame(FSkateReplayFrame& OutFrame) override;
+
+protected:
+	// Map a chunk and position at its first frame, releasing the previous chunk
+	bool MapChunk(int32 ChunkIndex);
+
+	TUniquePtr<IMappedFileHandle> MappedFile;
+	TUniquePtr<IMappedFileRegion> MappedChunk;
+	TUniquePtr<FArchive> ChunkReader;
+
+	FSkateGhostHeader Header;
+	TArray<FSkateGhostChunkIndexEntry> Chunks;
+	FSkateReplayCodec Codec;
+
+	// Keeps animations referenced by the ghost loaded
+	TArray<TStrongObjectPtr<UAnimationAsset>> LoadedAnimations;
+
+	int32 CurrentChunk = INDEX_NONE;
+	FSkateReplayKeyframe CurrentChunkKeyframe;
+	uint32 NextFrameNumber = 0;
+};
@@ -0,0 +1,673 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Skate/SkateHarnessSubsystem.h"
+
+#include "EnhancedInputSubsystems.h"
+#include "Skater.h"
+#include "Algo/StableSort.h"
+#include "Misc/App.h"
+#include "Dom/JsonObject.h"
+#include "Misc/FileHelper.h"
+#include "Serialization/JsonSerializer.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogSkateHarness,Log,All);
+
+namespace SkateHarness
+{
+	const TCHAR* ActionNames[] = { TEXT("Pump"), TEXT("Lean"), TEXT("Ollie") };
+	static_assert(UE_ARRAY_COUNT(ActionNames) == static_cast<int32>(ESkateHarnessAction::Num),"Name every harness action");
+
+	bool ParseAction(const FString& Name, ESkateHarnessAction& OutAction)
+	{
+		for (int32 Index = 0; Index < static_cast<int32>(ESkateHarnessAction::Num); Index++)
+		{
+			if (Name.Equals(ActionNames[Index],ESearchCase::IgnoreCase))
+			{
+				OutAction = static_cast<ESkateHarnessAction>(Index);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// Skater counts benchmarked when -SkateBenchmark has no list
+	const int32 DefaultBenchmarkSkaterCounts[] = { 1, 10, 50, 200 };
+
+	TSharedRef<FJsonObject> StatToJson(const FSkateBenchmarkStat& Stat)
+	{
+		TSharedRef<FJsonObject> JsonObject = MakeShared<FJsonObject>();
+		JsonObject->SetNumberField(TEXT("Mean"),Stat.Mean);
+		JsonObject->SetNumberField(TEXT("P95"),Stat.P95);
+		JsonObject->SetNumberField(TEXT("P99"),Stat.P99);
+		return JsonObject;
+	}
+
+	// Benchmark asked for by RequestBenchmark
+	struct FBenchmarkRequest
+	{
+		bool bPending = false;
+		bool bDone = false;
+		bool bSucceeded = false;
+		FString ScriptName;
+		FString ScriptText;
+		TArray<int32> SkaterCounts;
+		bool bWithCrowd = false;
+	};
+	FBenchmarkRequest BenchmarkRequest;
+}
+
+FSkateBenchmarkStat FSkateBenchmarkStat::FromSamples(TArray<double> Samples)
+{
+	FSkateBenchmarkStat Stat;
+	if (Samples.IsEmpty())
+	{
+		return Stat;
+	}
+
+	Samples.Sort();
+	double Sum = 0.0;
+	for (const double Sample : Samples)
+	{
+		Sum += Sample;
+	}
+	Stat.Mean = Sum / Samples.Num();
+
+	// Nearest rank
+	Stat.P95 = Samples[FMath::Clamp(FMath::CeilToInt(0.95 * Samples.Num()) - 1,0,Samples.Num() - 1)];
+	Stat.P99 = Samples[FMath::Clamp(FMath::CeilToInt(0.99 * Samples.Num()) - 1,0,Samples.Num() - 1)];
+	return Stat;
+}
+
+bool USkateHarnessSubsystem::ShouldCreateSubsystem(UObject* Outer) const
+{
+	FString ScriptFile;
+	return Super::ShouldCreateSubsystem(Outer) && (SkateHarness::BenchmarkRequest.bPending || FParse::Value(FCommandLine::Get(),TEXT("SkateHarness="),ScriptFile));
+}
+
+void USkateHarnessSubsystem::RequestBenchmark(const FString& InScriptName, const FString& ScriptText, const TArray<int32>& SkaterCounts, bool bWithCrowd)
+{
+	SkateHarness::BenchmarkRequest = SkateHarness::FBenchmarkRequest();
+	SkateHarness::BenchmarkRequest.bPending = true;
+	SkateHarness::BenchmarkRequest.ScriptName = InScriptName;
+	SkateHarness::BenchmarkRequest.ScriptText = ScriptText;
+	SkateHarness::BenchmarkRequest.SkaterCounts = SkaterCounts;
+	SkateHarness::BenchmarkRequest.bWithCrowd = bWithCrowd;
+}
+
+void USkateHarnessSubsystem::CancelRequestedBenchmark()
+{
+	SkateHarness::BenchmarkRequest.bPending = false;
+}
+
+bool USkateHarnessSubsystem::IsRequestedBenchmarkDone(bool& bOutSucceeded)
+{
+	bOutSucceeded = SkateHarness::BenchmarkRequest.bSucceeded;
+	return SkateHarness::BenchmarkRequest.bDone;
+}
+
+void USkateHarnessSubsystem::OnWorldBeginPlay(UWorld& InWorld)
+{
+	Super::OnWorldBeginPlay(InWorld);
+
+	if (!InWorld.IsGameWorld())
+	{
+		return;
+	}
+
+	FString ScriptFile;
+	FString ScriptText;
+	bool bScriptLoaded;
+	if (SkateHarness::BenchmarkRequest.bPending)
+	{
+		SkateHarness::BenchmarkRequest.bPending = false;
+		bRequestedRun = true;
+		ScriptFile = SkateHarness::BenchmarkRequest.ScriptName;
+		ScriptText = SkateHarness::BenchmarkRequest.ScriptText;
+		bScriptLoaded = true;
+	}
+	else
+	{
+		FParse::Value(FCommandLine::Get(),TEXT("SkateHarness="),ScriptFile);
+		if (FPaths::IsRelative(ScriptFile) && !FPaths::FileExists(ScriptFile))
+		{
+			ScriptFile = FPaths::ProjectSavedDir() / TEXT("SkateHarness") / ScriptFile;
+		}
+		bScriptLoaded = FFileHelper::LoadFileToString(ScriptText,*ScriptFile);
+	}
+
+	if (!bScriptLoaded || !ParseScript(ScriptText,Keys,EndFrame))
+	{
+		UE_LOG(LogSkateHarness,Error,TEXT("Cannot run skate harness script %s"),*ScriptFile);
+		Exit(false);
+		return;
+	}
+	ScriptName = FPaths::GetBaseFilename(ScriptFile);
+
+	// Same delta every frame, whatever the machine
+	FParse::Value(FCommandLine::Get(),TEXT("SkateHarnessStep="),StepSeconds);
+	FParse::Value(FCommandLine::Get(),TEXT("SkateHarnessTimeout="),SkaterTimeoutSeconds);
+	FApp::SetUseFixedTimeStep(true);
+	FApp::SetFixedDeltaTime(StepSeconds);
+	FMath::RandInit(0);
+	FMath::SRandInit(0);
+
+	FString BenchmarkCounts;
+	bBenchmark = bRequestedRun || FParse::Param(FCommandLine::Get(),TEXT("SkateBenchmark")) || FParse::Value(FCommandLine::Get(),TEXT("SkateBenchmark="),BenchmarkCounts);
+	if (bBenchmark)
+	{
+		if (bRequestedRun)
+		{
+			// Every count ticked by actors, then every count again ticked by the crowd
+			for (const bool bCrowd : { false, true })
+			{
+				if (bCrowd && !SkateHarness::BenchmarkRequest.bWithCrowd)
+				{
+					continue;
+				}
+				for (const int32 SkaterCount : SkateHarness::BenchmarkRequest.SkaterCounts)
+				{
+					FSkateBenchmarkCase& BenchmarkCase = BenchmarkCases.AddDefaulted_GetRef();
+					BenchmarkCase.SkaterCount = FMath::Max(SkaterCount,1);
+					BenchmarkCase.bCrowd = bCrowd;
+				}
+			}
+		}
+		else
+		{
+			TArray<FString> CountStrings;
+			BenchmarkCounts.ParseIntoArray(CountStrings,TEXT(","));
+			for (const FString& CountString : CountStrings)
+			{
+				BenchmarkCases.AddDefaulted_GetRef().SkaterCount = FMath::Max(FCString::Atoi(*CountString),1);
+			}
+			if (BenchmarkCases.IsEmpty())
+			{
+				for (const int32 SkaterCount : SkateHarness::DefaultBenchmarkSkaterCounts)
+				{
+					BenchmarkCases.AddDefaulted_GetRef().SkaterCount = SkaterCount;
+				}
+			}
+
+			const bool bCrowd = FParse::Param(FCommandLine::Get(),TEXT("SkateBenchmarkCrowd"));
+			for (FSkateBenchmarkCase& BenchmarkCase : BenchmarkCases)
+			{
+				BenchmarkCase.bCrowd = bCrowd;
+			}
+		}
+		FParse::Value(FCommandLine::Get(),TEXT("SkateBenchmarkWarmup="),BenchmarkWarmupFrames);
+
+		WorldTickStartHandle = FWorldDelegates::OnWorldTickStart.AddUObject(this,&USkateHarnessSubsystem::OnWorldTickStart);
+		WorldPostActorTickHandle = FWorldDelegates::OnWorldPostActorTick.AddUObject(this,&USkateHarnessSubsystem::OnWorldPostActorTick);
+	}
+	else
+	{
+		Frames.Reserve(EndFrame);
+	}
+
+	FSkateProfiling::SetEnabled(true);
+	bRunning = true;
+
+	UE_LOG(LogSkateHarness,Display,TEXT("Running skate harness script %s for %d frames at %f seconds per frame"),*ScriptFile,EndFrame,StepSeconds);
+}
+
+void USkateHarnessSubsystem::Deinitialize()
+{
+	if (bRunning)
+	{
+		FSkateProfiling::SetEnabled(false);
+
+		// World went away before the run was done
+		if (bRequestedRun)
+		{
+			Exit(false);
+		}
+		bRunning = false;
+	}
+
+	FWorldDelegates::OnWorldTickStart.Remove(WorldTickStartHandle);
+	FWorldDelegates::OnWorldPostActorTick.Remove(WorldPostActorTickHandle);
+
+	Super::Deinitialize();
+}
+
+void USkateHarnessSubsystem::Tick(float DeltaTime)
+{
+	ASkater* Skater = FindSkater();
+	if (!Skater)
+	{
+		// Wait for the player skater and its skate physics, but not forever. A pawn that is not a skater never becomes one.
+		FSkateProfiling::Reset();
+		const double Now = FPlatformTime::Seconds();
+		if (SkaterWaitStartSeconds == 0.0)
+		{
+			SkaterWaitStartSeconds = Now;
+		}
+		else if (Now - SkaterWaitStartSeconds > SkaterTimeoutSeconds)
+		{
+			const APlayerController* PlayerController = GetWorld()->GetFirstPlayerController();
+			const APawn* Pawn = PlayerController ? PlayerController->GetPawn() : nullptr;
+			UE_LOG(LogSkateHarness,Error,TEXT("No player skater with skate physics after %.0f seconds. Possessed pawn is %s."),SkaterTimeoutSeconds,*GetNameSafe(Pawn));
+			Exit(false);
+		}
+		return;
+	}
+	SkaterWaitStartSeconds = 0.0;
+
+	if (bBenchmark && BenchmarkCaseIndex == INDEX_NONE)
+	{
+		StartBenchmarkCase(Skater);
+	}
+
+	// Actor ticks for this frame are done. Input injected now is applied by the player controller next frame.
+	if (Frame > 0)
+	{
+		if (bBenchmark)
+		{
+			RecordBenchmarkFrame();
+		}
+		else
+		{
+			RecordFrame(Skater);
+		}
+	}
+	FSkateProfiling::Reset();
+
+	if (Frame >= EndFrame)
+	{
+		if (!bBenchmark)
+		{
+			Finish();
+		}
+		else if (BenchmarkCaseIndex + 1 < BenchmarkCases.Num())
+		{
+			StartBenchmarkCase(Skater);
+		}
+		else
+		{
+			FinishBenchmark();
+		}
+		return;
+	}
+
+	// Benchmark cases settle before the script starts
+	if (Frame >= 0)
+	{
+		InjectInput(Skater);
+		DriveBenchmarkSkaters();
+	}
+	Frame++;
+}
+
+TStatId USkateHarnessSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(USkateHarnessSubsystem,STATGROUP_Tickables);
+}
+
+bool USkateHarnessSubsystem::IsTickable() const
+{
+	return bRunning;
+}
+
+bool USkateHarnessSubsystem::ParseScript(const FString& ScriptText, TArray<FSkateHarnessKey>& OutKeys, int32& OutEndFrame)
+{
+	OutKeys.Reset();
+	OutEndFrame = 0;
+
+	TArray<FString> Lines;
+	ScriptText.ParseIntoArrayLines(Lines);
+	for (const FString& RawLine : Lines)
+	{
+		const FString Line = RawLine.TrimStartAndEnd();
+		if (Line.IsEmpty() || Line.StartsWith(TEXT("#")))
+		{
+			continue;
+		}
+
+		TArray<FString> Tokens;
+		Line.ParseIntoArrayWS(Tokens);
+		if (Tokens.Num() < 2 || !Tokens[0].IsNumeric())
+		{
+			UE_LOG(LogSkateHarness,Error,TEXT("Bad skate harness script line: %s"),*Line);
+			return false;
+		}
+
+		const int32 KeyFrame = FCString::Atoi(*Tokens[0]);
+		if (Tokens[1].Equals(TEXT("End"),ESearchCase::IgnoreCase))
+		{
+			OutEndFrame = KeyFrame;
+			continue;
+		}
+
+		FSkateHarnessKey Key;
+		Key.Frame = KeyFrame;
+		if (Tokens.Num() != 3 || !SkateHarness::ParseAction(Tokens[1],Key.Action))
+		{
+			UE_LOG(LogSkateHarness,Error,TEXT("Bad skate harness script line: %s"),*Line);
+			return false;
+		}
+		Key.Value = FCString::Atof(*Tokens[2]);
+		OutKeys.Add(Key);
+		OutEndFrame = FMath::Max(OutEndFrame,KeyFrame + 1);
+	}
+
+	// Stable, so keys on the same frame apply in script order
+	Algo::StableSortBy(OutKeys,&FSkateHarnessKey::Frame);
+	return OutEndFrame > 0;
+}
+
+ASkater* USkateHarnessSubsystem::FindSkater() const
+{
+	const APlayerController* PlayerController = GetWorld()->GetFirstPlayerController();
+	ASkater* Skater = PlayerController ? Cast<ASkater>(PlayerController->GetPawn()) : nullptr;
+	return Skater && Skater->SkatePhysics ? Skater : nullptr;
+}
+
+const UInputAction* USkateHarnessSubsystem::GetInputAction(const ASkater* Skater, ESkateHarnessAction Action)
+{
+	switch (Action)
+	{
+	case ESkateHarnessAction::Pump: return Skater->PumpAction;
+	case ESkateHarnessAction::Lean: return Skater->LeanAction;
+	case ESkateHarnessAction::Ollie: return Skater->OllieAction;
+	default: return nullptr;
+	}
+}
+
+void USkateHarnessSubsystem::InjectInput(ASkater* Skater)
+{
+	FMemory::Memcpy(PreviousActionValues,ActionValues);
+	while (NextKey < Keys.Num() && Keys[NextKey].Frame <= Frame)
+	{
+		ActionValues[static_cast<int32>(Keys[NextKey].Action)] = Keys[NextKey].Value;
+		NextKey++;
+	}
+
+	const APlayerController* PlayerController = Cast<APlayerController>(Skater->GetController());
+	UEnhancedInputLocalPlayerSubsystem* InputSubsystem = PlayerController ? ULocalPlayer::GetSubsystem<UEnhancedInputLocalPlayerSubsystem>(PlayerController->GetLocalPlayer()) : nullptr;
+	if (!InputSubsystem)
+	{
+		return;
+	}
+
+	for (int32 Index = 0; Index < static_cast<int32>(ESkateHarnessAction::Num); Index++)
+	{
+		const UInputAction* InputAction = GetInputAction(Skater,static_cast<ESkateHarnessAction>(Index));
+		if (InputAction && ActionValues[Index] != 0.0f)
+		{
+			// Not injecting on a frame releases the action
+			InputSubsystem->InjectInputForAction(InputAction,FInputActionValue(InputAction->ValueType,FVector(ActionValues[Index],0.0,0.0)));
+		}
+	}
+}
+
+void USkateHarnessSubsystem::DriveBenchmarkSkaters()
+{
+	const float Pump = ActionValues[static_cast<int32>(ESkateHarnessAction::Pump)];
+	const float Lean = ActionValues[static_cast<int32>(ESkateHarnessAction::Lean)];
+	const bool bLeanReleased = Lean == 0.0f && PreviousActionValues[static_cast<int32>(ESkateHarnessAction::Lean)] != 0.0f;
+	const bool bOllieReleased = ActionValues[static_cast<int32>(ESkateHarnessAction::Ollie)] == 0.0f && PreviousActionValues[static_cast<int32>(ESkateHarnessAction::Ollie)] != 0.0f;
+
+	// Same trigger events the player skater gets from Enhanced Input
+	for (ASkater* BenchmarkSkater : BenchmarkSkaters)
+	{
+		if (!BenchmarkSkater)
+		{
+			continue;
+		}
+		if (Pump != 0.0f)
+		{
+			BenchmarkSkater->PumpActionTriggered(FInputActionValue(Pump));
+		}
+		if (Lean != 0.0f)
+		{
+			BenchmarkSkater->LeanActionTriggered(FInputActionValue(Lean));
+		}
+		else if (bLeanReleased)
+		{
+			BenchmarkSkater->LeanActionCompleted(FInputActionValue(0.0f));
+		}
+		if (bOllieReleased)
+		{
+			BenchmarkSkater->OllieActionCompleted(FInputActionValue(0.0f));
+		}
+	}
+}
+
+void USkateHarnessSubsystem::RecordFrame(const ASkater* Skater)
+{
+	FSkateHarnessFrame& HarnessFrame = Frames.AddDefaulted_GetRef();
+	HarnessFrame.Frame = Frame - 1;
+	HarnessFrame.Location = Skater->SkatePhysics->GetActorLocation();
+	HarnessFrame.Velocity = Skater->SkatePhysics->GetSkatePhysicsVelocity();
+	HarnessFrame.SkateMode = Skater->SkatePhysics->GetCurrentSkateMode();
+	HarnessFrame.bGrounded = Skater->bGrounded;
+	HarnessFrame.GrindDistance = Skater->SkatePhysics->GrindCurrentDistance;
+	for (int32 Index = 0; Index < static_cast<int32>(ESkateTimer::Num); Index++)
+	{
+		HarnessFrame.TimerSeconds[Index] = FSkateProfiling::GetSeconds(static_cast<ESkateTimer>(Index));
+	}
+}
+
+void USkateHarnessSubsystem::RecordBenchmarkFrame()
+{
+	FSkateBenchmarkCase& BenchmarkCase = BenchmarkCases[BenchmarkCaseIndex];
+	BenchmarkCase.WorldTickMilliseconds.Add(LastWorldTickSeconds * 1000.0);
+	for (int32 Index = 0; Index < static_cast<int32>(ESkateTimer::Num); Index++)
+	{
+		BenchmarkCase.TimerMilliseconds[Index].Add(FSkateProfiling::GetSeconds(static_cast<ESkateTimer>(Index)) * 1000.0);
+	}
+	BenchmarkCase.Queries.Add(FSkateProfiling::GetQueries());
+}
+
+void USkateHarnessSubsystem::StartBenchmarkCase(ASkater* Skater)
+{
+	DestroyBenchmarkSkaters();
+
+	BenchmarkCaseIndex++;
+	if (BenchmarkCaseIndex == 0)
+	{
+		BenchmarkStartSkaterTransform = Skater->GetActorTransform();
+		BenchmarkStartPhysicsTransform = Skater->SkatePhysics->GetActorTransform();
+		BenchmarkStartTrackerRotation = Skater->RotationTracker->GetComponentRotation();
+	}
+	else
+	{
+		// Otherwise a case would start wherever the last one ended, at speed and maybe mid air
+		ResetBenchmarkPlayerSkater(Skater);
+	}
+	const int32 SkaterCount = BenchmarkCases[BenchmarkCaseIndex].SkaterCount;
+
+	// The player skater is the first of the case. The rest stand on a grid behind it.
+	const int32 GridSide = FMath::CeilToInt(FMath::Sqrt(static_cast<float>(SkaterCount)));
+	const float GridSpacing = 400.0f;
+	for (int32 Index = 1; Index < SkaterCount; Index++)
+	{
+		const FVector GridOffset((Index / GridSide) * -GridSpacing,(Index % GridSide) * GridSpacing,0.0);
+		const FTransform SpawnTransform(Skater->GetActorRotation(),Skater->GetActorTransform().TransformPosition(GridOffset));
+		ASkater* BenchmarkSkater = GetWorld()->SpawnActorDeferred<ASkater>(Skater->GetClass(),SpawnTransform,nullptr,nullptr,ESpawnActorCollisionHandlingMethod::AlwaysSpawn);
+		if (!BenchmarkSkater)
+		{
+			continue;
+		}
+
+		// Each spawned skater brings its own skate physics instead of taking one placed in the level
+		if (!BenchmarkSkater->SkatePhysicsClass)
+		{
+			BenchmarkSkater->SkatePhysicsClass = Skater->SkatePhysics->GetClass();
+		}
+		BenchmarkSkater->bCrowdSkater = BenchmarkCases[BenchmarkCaseIndex].bCrowd;
+		BenchmarkSkater->bRecordReplay = false;
+		BenchmarkSkater->FinishSpawning(SpawnTransform);
+		BenchmarkSkaters.Add(BenchmarkSkater);
+	}
+
+	// Restart the script after warming up
+	Frame = -BenchmarkWarmupFrames;
+	NextKey = 0;
+	FMemory::Memzero(ActionValues);
+	FMemory::Memzero(PreviousActionValues);
+
+	FSkateBenchmarkCase& BenchmarkCase = BenchmarkCases[BenchmarkCaseIndex];
+	BenchmarkCase.WorldTickMilliseconds.Reserve(EndFrame);
+	for (TArray<double>& TimerMilliseconds : BenchmarkCase.TimerMilliseconds)
+	{
+		TimerMilliseconds.Reserve(EndFrame);
+	}
+	BenchmarkCase.Queries.Reserve(EndFrame);
+
+	UE_LOG(LogSkateHarness,Display,TEXT("Skate benchmark case %d of %d: %d skaters%s"),BenchmarkCaseIndex + 1,BenchmarkCases.Num(),SkaterCount,
+		BenchmarkCases[BenchmarkCaseIndex].bCrowd ? TEXT(", crowd") : TEXT(""));
+}
+
+void USkateHarnessSubsystem::ResetBenchmarkPlayerSkater(ASkater* Skater)
+{
+	ASkatePhysics* SkatePhysics = Skater->SkatePhysics;
+	if (SkatePhysics->GetCurrentSkateMode() != ESkateMode::Skate)
+	{
+		SkatePhysics->ChangeSkateMode(ESkateMode::Skate);
+	}
+	SkatePhysics->SetActorRotation(BenchmarkStartPhysicsTransform.GetRotation(),ETeleportType::TeleportPhysics);
+	Skater->SetSkatePhysicsState(BenchmarkStartPhysicsTransform.GetLocation(),FVector::ZeroVector);
+	if (SkatePhysics->RootSphere->IsSimulatingPhysics())
+	{
+		SkatePhysics->RootSphere->SetPhysicsAngularVelocityInDegrees(FVector::ZeroVector);
+	}
+
+	Skater->SetActorTransform(BenchmarkStartSkaterTransform,false,nullptr,ETeleportType::TeleportPhysics);
+	Skater->RotationTracker->SetWorldRotation(BenchmarkStartTrackerRotation,false,nullptr,ETeleportType::TeleportPhysics);
+}
+
+void USkateHarnessSubsystem::DestroyBenchmarkSkaters()
+{
+	for (ASkater* BenchmarkSkater : BenchmarkSkaters)
+	{
+		if (BenchmarkSkater)
+		{
+			BenchmarkSkater->Destroy();
+		}
+	}
+	BenchmarkSkaters.Reset();
+}
+
+void USkateHarnessSubsystem::Finish()
+{
+	bRunning = false;
+	FSkateProfiling::SetEnabled(false);
+
+	// One row per frame. Timer columns are in microseconds.
+	FString Csv = TEXT("Frame,LocationX,LocationY,LocationZ,VelocityX,VelocityY,VelocityZ,SkateMode,Grounded,GrindDistance");
+	for (int32 Index = 0; Index < static_cast<int32>(ESkateTimer::Num); Index++)
+	{
+		Csv += FString::Printf(TEXT(",%sUs"),FSkateProfiling::GetTimerName(static_cast<ESkateTimer>(Index)));
+	}
+	Csv += LINE_TERMINATOR;
+
+	double TotalSeconds[static_cast<int32>(ESkateTimer::Num)] = {};
+	for (const FSkateHarnessFrame& HarnessFrame : Frames)
+	{
+		Csv += FString::Printf(TEXT("%d,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%d,%d,%.3f"),HarnessFrame.Frame,
+			HarnessFrame.Location.X,HarnessFrame.Location.Y,HarnessFrame.Location.Z,
+			HarnessFrame.Velocity.X,HarnessFrame.Velocity.Y,HarnessFrame.Velocity.Z,
+			HarnessFrame.SkateMode,HarnessFrame.bGrounded ? 1 : 0,HarnessFrame.GrindDistance);
+		for (int32 Index = 0; Index < static_cast<int32>(ESkateTimer::Num); Index++)
+		{
+			Csv += FString::Printf(TEXT(",%.2f"),HarnessFrame.TimerSeconds[Index] * 1000000.0);
+			TotalSeconds[Index] += HarnessFrame.TimerSeconds[Index];
+		}
+		Csv += LINE_TERMINATOR;
+	}
+
+	const FString OutputFile = FPaths::ProjectSavedDir() / TEXT("SkateHarness") / ScriptName + TEXT(".csv");
+	const bool bSaved = FFileHelper::SaveStringToFile(Csv,*OutputFile);
+	UE_LOG(LogSkateHarness,Display,TEXT("Skate harness recorded %d frames to %s"),Frames.Num(),*OutputFile);
+
+	for (int32 Index = 0; Index < static_cast<int32>(ESkateTimer::Num); Index++)
+	{
+		UE_LOG(LogSkateHarness,Display,TEXT("  %s: %.2f us per frame"),FSkateProfiling::GetTimerName(static_cast<ESkateTimer>(Index)),
+			Frames.Num() > 0 ? TotalSeconds[Index] * 1000000.0 / Frames.Num() : 0.0);
+	}
+
+	Exit(bSaved);
+}
+
+void USkateHarnessSubsystem::FinishBenchmark()
+{
+	bRunning = false;
+	FSkateProfiling::SetEnabled(false);
+	DestroyBenchmarkSkaters();
+
+	TSharedRef<FJsonObject> JsonObject = MakeShared<FJsonObject>();
+	JsonObject->SetStringField(TEXT("Script"),ScriptName);
+	JsonObject->SetStringField(TEXT("Map"),GetWorld()->GetMapName());
+	JsonObject->SetNumberField(TEXT("StepSeconds"),StepSeconds);
+	JsonObject->SetNumberField(TEXT("WarmupFrames"),BenchmarkWarmupFrames);
+	JsonObject->SetNumberField(TEXT("Frames"),EndFrame);
+
+	TArray<TSharedPtr<FJsonValue>> CaseValues;
+	for (const FSkateBenchmarkCase& BenchmarkCase : BenchmarkCases)
+	{
+		TSharedRef<FJsonObject> CaseObject = MakeShared<FJsonObject>();
+		CaseObject->SetNumberField(TEXT("Skaters"),BenchmarkCase.SkaterCount);
+		CaseObject->SetBoolField(TEXT("CrowdSkaters"),BenchmarkCase.bCrowd);
+		CaseObject->SetObjectField(TEXT("WorldTickMs"),SkateHarness::StatToJson(FSkateBenchmarkStat::FromSamples(BenchmarkCase.WorldTickMilliseconds)));
+
+		TSharedRef<FJsonObject> TimersObject = MakeShared<FJsonObject>();
+		for (int32 Index = 0; Index < static_cast<int32>(ESkateTimer::Num); Index++)
+		{
+			TimersObject->SetObjectField(FSkateProfiling::GetTimerName(static_cast<ESkateTimer>(Index)),
+				SkateHarness::StatToJson(FSkateBenchmarkStat::FromSamples(BenchmarkCase.TimerMilliseconds[Index])));
+		}
+		CaseObject->SetObjectField(TEXT("TimersMs"),TimersObject);
+		CaseObject->SetObjectField(TEXT("QueriesPerFrame"),SkateHarness::StatToJson(FSkateBenchmarkStat::FromSamples(BenchmarkCase.Queries)));
+
+		CaseValues.Add(MakeShared<FJsonValueObject>(CaseObject));
+
+		const FSkateBenchmarkStat WorldTick = FSkateBenchmarkStat::FromSamples(BenchmarkCase.WorldTickMilliseconds);
+		UE_LOG(LogSkateHarness,Display,TEXT("  %d skaters%s: world tick mean %.3f ms, p95 %.3f ms, p99 %.3f ms"),BenchmarkCase.SkaterCount,
+			BenchmarkCase.bCrowd ? TEXT(" (crowd)") : TEXT(""),WorldTick.Mean,WorldTick.P95,WorldTick.P99);
+	}
+	JsonObject->SetArrayField(TEXT("Cases"),CaseValues);
+
+	FString Json;
+	const TSharedRef<TJsonWriter<>> JsonWriter = TJsonWriterFactory<>::Create(&Json);
+	FJsonSerializer::Serialize(JsonObject,JsonWriter);
+
+	const FString OutputFile = FPaths::ProjectSavedDir() / TEXT("SkateHarness") / ScriptName + TEXT("-Benchmark.json");
+	const bool bSaved = FFileHelper::SaveStringToFile(Json,*OutputFile);
+	UE_LOG(LogSkateHarness,Display,TEXT("Skate benchmark wrote %d cases to %s"),BenchmarkCases.Num(),*OutputFile);
+
+	Exit(bSaved);
+}
+
+void USkateHarnessSubsystem::Exit(bool bSucceeded)
+{
+	bRunning = false;
+	FSkateProfiling::SetEnabled(false);
+	if (!bRequestedRun)
+	{
+		FPlatformMisc::RequestExitWithStatus(false,bSucceeded ? 0 : 1);
+		return;
+	}
+
+	// The process carries on after a requested run, so it gets its normal frame timing back
+	FApp::SetUseFixedTimeStep(false);
+	SkateHarness::BenchmarkRequest.bSucceeded = bSucceeded;
+	SkateHarness::BenchmarkRequest.bDone = true;
+}
+
+void USkateHarnessSubsystem::OnWorldTickStart(UWorld* InWorld, ELevelTick TickType, float DeltaSeconds)
+{
+	if (InWorld == GetWorld())
+	{
+		WorldTickStartCycles = FPlatformTime::Cycles64();
+	}
+}
+
+void USkateHarnessSubsystem::OnWorldPostActorTick(UWorld* InWorld, ELevelTick TickType, float DeltaSeconds)
+{
+	if (InWorld == GetWorld() && WorldTickStartCycles != 0)
+	{
+		LastWorldTickSeconds = FPlatformTime::ToSeconds64(FPlatformTime::Cycles64() - WorldTickStartCycles);
+	}
+}
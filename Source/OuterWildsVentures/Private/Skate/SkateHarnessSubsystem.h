@@ -0,0 +1,207 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "SkateProfiling.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "SkateHarnessSubsystem.generated.h"
+
+class ASkater;
+class UInputAction;
+
+// Skater input actions a harness script can drive
+enum class ESkateHarnessAction : uint8
+{
+	Pump,
+	Lean,
+	Ollie,
+
+	Num
+};
+
+// Sets an action's value from a frame on. The value is held until the next key for the action.
+struct FSkateHarnessKey
+{
+	int32 Frame = 0;
+	ESkateHarnessAction Action = ESkateHarnessAction::Pump;
+	float Value = 0.0f;
+};
+
+// Skater state and skate timings at the end of a harness frame
+struct FSkateHarnessFrame
+{
+	int32 Frame = 0;
+	FVector Location = FVector::ZeroVector;
+	FVector Velocity = FVector::ZeroVector;
+	uint8 SkateMode = 0;
+	bool bGrounded = false;
+	float GrindDistance = 0.0f;
+	double TimerSeconds[static_cast<int32>(ESkateTimer::Num)] = {};
+};
+
+// Mean and tail of a benchmark measurement over the frames of a case
+struct FSkateBenchmarkStat
+{
+	double Mean = 0.0;
+	double P95 = 0.0;
+	double P99 = 0.0;
+
+	static FSkateBenchmarkStat FromSamples(TArray<double> Samples);
+};
+
+// Per frame samples of one benchmark skater count
+struct FSkateBenchmarkCase
+{
+	int32 SkaterCount = 0;
+
+	// Extra skaters are ticked by the skate crowd instead of their actors
+	bool bCrowd = false;
+
+	TArray<double> WorldTickMilliseconds;
+	TArray<double> TimerMilliseconds[static_cast<int32>(ESkateTimer::Num)];
+	TArray<double> Queries;
+};
+
+/**
+ * Headless skate harness. Drives the player skater with a scripted input timeline at a fixed delta, then writes
+ * per frame skater state and skate function timings to Saved/SkateHarness and quits.
+ * Only created when the command line has -SkateHarness=<ScriptFile>, e.g.
+ *   UnrealEditor-Cmd OuterWildsVentures.uproject /Game/OWV/Maps/Test -game -nullrhi -nosound -unattended -SkateHarness=Carve.txt
+ * Optional -SkateHarnessStep=<Seconds> sets the fixed delta (default 1/60). The run fails if no player skater with skate
+ * physics is possessed for -SkateHarnessTimeout=<Seconds> (default 60).
+ *
+ * With -SkateBenchmark[=1,10,50,200] the script is run once per skater count instead. Extra skaters of the player
+ * skater's class are spawned around it, each paired with its own skate physics, and driven by calling their input
+ * handlers with the same timeline. -SkateBenchmarkWarmup=<Frames> (default 60) frames settle each case before
+ * measuring, and -SkateBenchmarkCrowd ticks the extra skaters with the skate crowd. Mean, p95 and p99 of world tick
+ * time, skate function time and skate scene queries per frame go to Saved/SkateHarness/<Script>-Benchmark.json.
+ * The player skater is put back at its starting point, at rest, before every case. The automation test
+ * OuterWildsVentures.Skate.Benchmark runs the same benchmark through RequestBenchmark, with and without the crowd.
+ *
+ * Script lines are "<Frame> <Pump|Lean|Ollie> <Value>" or "<Frame> End". Lines starting with # are ignored.
+ * Input is injected through Enhanced Input, so it reaches the skater through the bindings in SetupPlayerInputComponent.
+ * A nonzero value is injected every frame (Triggered). Setting it back to 0 releases the action (Completed).
+ */
+UCLASS()
+class USkateHarnessSubsystem : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	virtual bool ShouldCreateSubsystem(UObject* Outer) const override;
+	virtual void OnWorldBeginPlay(UWorld& InWorld) override;
+	virtual void Deinitialize() override;
+	virtual void Tick(float DeltaTime) override;
+	virtual TStatId GetStatId() const override;
+	virtual bool IsTickable() const override;
+
+public:
+	// Functions
+
+	// Read a script into keys sorted by frame. Returns false if the file cannot be read or has a bad line.
+	static bool ParseScript(const FString& ScriptText, TArray<FSkateHarnessKey>& OutKeys, int32& OutEndFrame);
+
+	// Benchmark a script in the next game world to begin play, reporting back instead of quitting. Used by the automation test.
+	// With bWithCrowd every skater count is run a second time with the extra skaters ticked by the skate crowd.
+	static void RequestBenchmark(const FString& InScriptName, const FString& ScriptText, const TArray<int32>& SkaterCounts, bool bWithCrowd);
+
+	// Drop a requested benchmark that has not started yet
+	static void CancelRequestedBenchmark();
+
+	// Whether the requested benchmark is done, and whether it wrote its results
+	static bool IsRequestedBenchmarkDone(bool& bOutSucceeded);
+
+	// Input action on the skater for a script action
+	static const UInputAction* GetInputAction(const ASkater* Skater, ESkateHarnessAction Action);
+
+protected:
+	// Skater driven by the script
+	ASkater* FindSkater() const;
+
+	// Apply keys for the current frame and inject the held action values
+	void InjectInput(ASkater* Skater);
+
+	// Drive the spawned benchmark skaters through their input handlers
+	void DriveBenchmarkSkaters();
+
+	// Record the skater state and timings of the frame that just ticked
+	void RecordFrame(const ASkater* Skater);
+
+	// Record world tick time, skate timings and queries of the frame that just ticked
+	void RecordBenchmarkFrame();
+
+	// Spawn the skaters of the next benchmark case and restart the script
+	void StartBenchmarkCase(ASkater* Skater);
+
+	// Put the player skater back where the first benchmark case started, at rest
+	void ResetBenchmarkPlayerSkater(ASkater* Skater);
+
+	// Destroy the skaters spawned for a benchmark case
+	void DestroyBenchmarkSkaters();
+
+	// Write recorded frames and a timing summary, then quit
+	void Finish();
+
+	// Write benchmark statistics, then quit
+	void FinishBenchmark();
+
+	// Quit with an exit code, or report back to the automation test that requested the run
+	void Exit(bool bSucceeded);
+
+	// World tick timing
+	void OnWorldTickStart(UWorld* InWorld, ELevelTick TickType, float DeltaSeconds);
+	void OnWorldPostActorTick(UWorld* InWorld, ELevelTick TickType, float DeltaSeconds);
+
+	// Script name, used for the output file
+	FString ScriptName;
+
+	// Fixed frame delta
+	float StepSeconds = 1.0f / 60.0f;
+
+	// Input timeline
+	TArray<FSkateHarnessKey> Keys;
+	int32 NextKey = 0;
+	int32 EndFrame = 0;
+
+	// Value held by each action, this frame and last frame
+	float ActionValues[static_cast<int32>(ESkateHarnessAction::Num)] = {};
+	float PreviousActionValues[static_cast<int32>(ESkateHarnessAction::Num)] = {};
+
+	// Frames since the skater was found
+	int32 Frame = 0;
+
+	// Real time the harness waits for the player skater before failing
+	float SkaterTimeoutSeconds = 60.0f;
+
+	// When the harness started waiting for the player skater, or 0 while it has one
+	double SkaterWaitStartSeconds = 0.0;
+
+	bool bRunning = false;
+
+	// Started by RequestBenchmark rather than the command line
+	bool bRequestedRun = false;
+
+	TArray<FSkateHarnessFrame> Frames;
+
+	// Benchmark
+
+	bool bBenchmark = false;
+	int32 BenchmarkWarmupFrames = 60;
+	TArray<FSkateBenchmarkCase> BenchmarkCases;
+	int32 BenchmarkCaseIndex = INDEX_NONE;
+
+	// Skaters spawned for the running case
+	UPROPERTY(Transient)
+	TArray<ASkater*> BenchmarkSkaters;
+
+	// Player skater state at the start of the first case. Every case starts from it.
+	FTransform BenchmarkStartSkaterTransform;
+	FTransform BenchmarkStartPhysicsTransform;
+	FRotator BenchmarkStartTrackerRotation;
+
+	uint64 WorldTickStartCycles = 0;
+	double LastWorldTickSeconds = 0.0;
+	FDelegateHandle WorldTickStartHandle;
+	FDelegateHandle WorldPostActorTickHandle;
+};
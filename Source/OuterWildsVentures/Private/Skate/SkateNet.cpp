@@ -0,0 +1,133 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Skate/SkateNet.h"
+
+#include "Engine/NetSerialization.h"
+
+namespace
+{
+	// Grind distance quantum, matching location
+	constexpr float GrindDistanceScale = 10.0f;
+}
+
+float FSkateNetInput::GetLeanAxis() const
+{
+	return LeanAxis / 127.0f;
+}
+
+void FSkateNetInput::SetLeanAxis(float AxisValue)
+{
+	LeanAxis = static_cast<int8>(FMath::RoundToInt(FMath::Clamp(AxisValue,-1.0f,1.0f) * 127.0f));
+}
+
+bool FSkateNetInput::NetSerialize(FArchive& Ar, UPackageMap* Map, bool& bOutSuccess)
+{
+	Ar << Sequence;
+	Ar << LeanAxis;
+
+	uint8 Flags = Ar.IsSaving() ? (bPump ? 1 : 0) | (bOllie ? 2 : 0) : 0;
+	Ar.SerializeBits(&Flags,2);
+	bPump = (Flags & 1) != 0;
+	bOllie = (Flags & 2) != 0;
+
+	bOutSuccess = !Ar.IsError();
+	return true;
+}
+
+void FSkateNetInputQueue::Add(const FSkateNetInput& Input)
+{
+	if (Input.Sequence == 0 || (LastTaken.Sequence != 0 && !IsNewerSkateNetSequence(Input.Sequence,LastTaken.Sequence)))
+	{
+		return;
+	}
+
+	int32 Index = Queued.Num();
+	while (Index > 0 && IsNewerSkateNetSequence(Queued[Index - 1].Sequence,Input.Sequence))
+	{
+		Index--;
+	}
+	if (Index > 0 && Queued[Index - 1].Sequence == Input.Sequence)
+	{
+		return;
+	}
+	Queued.Insert(Input,Index);
+
+	// Falling behind the client. Presses of the oldest frame are kept so no pump or ollie is lost.
+	if (Queued.Num() > MaxQueued)
+	{
+		Queued[1].bPump |= Queued[0].bPump;
+		Queued[1].bOllie |= Queued[0].bOllie;
+		Queued.RemoveAt(0);
+	}
+}
+
+bool FSkateNetInputQueue::Pop(FSkateNetInput& OutInput)
+{
+	if (Queued.Num() > 0)
+	{
+		LastTaken = Queued[0];
+		Queued.RemoveAt(0);
+		OutInput = LastTaken;
+		return true;
+	}
+
+	if (LastTaken.Sequence == 0)
+	{
+		return false;
+	}
+
+	// Nothing arrived in time. Held buttons stay held, a release happens once.
+	OutInput = LastTaken;
+	OutInput.bOllie = false;
+	return true;
+}
+
+int32 FSkateNetInputQueue::Num() const
+{
+	return Queued.Num();
+}
+
+uint16 FSkateNetInputQueue::GetLastSequence() const
+{
+	return LastTaken.Sequence;
+}
+
+FSkateNetState FSkateNetState::Capture(const ASkatePhysics* SkatePhysics, uint16 AckedInputSequence)
+{
+	FSkateNetState State;
+	State.Location = SkatePhysics->GetActorLocation();
+	State.Velocity = SkatePhysics->RootSphere->GetPhysicsLinearVelocity();
+	State.SkateMode = SkatePhysics->GetCurrentSkateMode();
+	State.GrindDistance = SkatePhysics->GrindCurrentDistance;
+	State.AckedInputSequence = AckedInputSequence;
+	return State;
+}
+
+bool FSkateNetState::NetSerialize(FArchive& Ar, UPackageMap* Map, bool& bOutSuccess)
+{
+	// Both at 0.1cm. Location covers +-8.4km. Velocity covers +-524m/s, far past MaxVelocity (22.5m/s) and terminal velocity (40m/s).
+	bOutSuccess = SerializePackedVector<10,24>(Location,Ar);
+	bOutSuccess &= SerializePackedVector<10,20>(Velocity,Ar);
+
+	uint8 Mode = Ar.IsSaving() ? static_cast<uint8>(SkateMode.GetValue()) : 0;
+	Ar.SerializeBits(&Mode,2);
+	SkateMode = static_cast<ESkateMode>(Mode);
+
+	// Grind distance only means anything while grinding
+	if (SkateMode == ESkateMode::Grind)
+	{
+		uint32 QuantizedGrindDistance = Ar.IsSaving() ? static_cast<uint32>(FMath::RoundToInt(FMath::Max(GrindDistance,0.0f) * GrindDistanceScale)) : 0;
+		Ar.SerializeIntPacked(QuantizedGrindDistance);
+		GrindDistance = QuantizedGrindDistance / GrindDistanceScale;
+	}
+	else
+	{
+		GrindDistance = 0.0f;
+	}
+
+	Ar << AckedInputSequence;
+
+	bOutSuccess &= !Ar.IsError();
+	return true;
+}
@@ -0,0 +1,146 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "SkatePhysics.h"
+#include "SkateNet.generated.h"
+
+/**
+ * Networked skating. The server owns the skate simulation. The owning client predicts with its own skate physics,
+ * sends its input every frame and corrects its prediction against the snapshots the server replicates.
+ *
+ * To try it on one machine, run a listen server and clients with emulated latency and loss, for example
+ *   UnrealEditor OuterWildsVentures.uproject <Map>?listen -game -PktLag=100 -PktLoss=5
+ *   UnrealEditor OuterWildsVentures.uproject 127.0.0.1 -game -PktLag=100 -PktLoss=5
+ * or set NetEmulation.PktLag and NetEmulation.PktLoss from the console. skate.Net.ShowCorrections shows how often
+ * the prediction is corrected.
+ */
+
+// Whether sequence A comes after sequence B, allowing for wrap around
+inline bool IsNewerSkateNetSequence(uint16 A, uint16 B)
+{
+	return static_cast<int16>(A - B) > 0;
+}
+
+/**
+ * One frame of skater input, sent from the owning client to the server. Packs to 26 bits.
+ */
+USTRUCT()
+struct FSkateNetInput
+{
+	GENERATED_BODY()
+
+	// Input frame number. 0 is never sent.
+	UPROPERTY()
+	uint16 Sequence = 0;
+
+	// Lean axis in 1/127ths. 0 when lean is not held.
+	UPROPERTY()
+	int8 LeanAxis = 0;
+
+	// Pump held this frame
+	UPROPERTY()
+	bool bPump = false;
+
+	// Ollie released this frame
+	UPROPERTY()
+	bool bOllie = false;
+
+	float GetLeanAxis() const;
+	void SetLeanAxis(float AxisValue);
+
+	bool NetSerialize(FArchive& Ar, UPackageMap* Map, bool& bOutSuccess);
+};
+
+template<>
+struct TStructOpsTypeTraits<FSkateNetInput> : public TStructOpsTypeTraitsBase2<FSkateNetInput>
+{
+	enum
+	{
+		WithNetSerializer = true
+	};
+};
+
+/**
+ * Input frames received from the owning client, in sequence order. The server takes at most one a tick, so frames
+ * sent twice or bunched into one packet are still applied one tick apiece.
+ */
+struct FSkateNetInputQueue
+{
+	// Frames queued before the oldest is folded into the next one
+	static constexpr int32 MaxQueued = 8;
+
+	// Queue a frame newer than the last one taken. Frames already queued or taken are dropped.
+	void Add(const FSkateNetInput& Input);
+
+	// Take the oldest queued frame. With none queued the last frame taken is held, without its ollie.
+	// Returns false until a frame has been taken.
+	bool Pop(FSkateNetInput& OutInput);
+
+	int32 Num() const;
+
+	// Sequence of the last frame taken. 0 for none.
+	uint16 GetLastSequence() const;
+
+private:
+	TArray<FSkateNetInput, TInlineAllocator<MaxQueued + 1>> Queued;
+	FSkateNetInput LastTaken;
+};
+
+/**
+ * Server skate state, replicated to every client. Location and velocity are quantized to 0.1 units, the mode to 2
+ * bits and the grind distance to 0.1 units only while grinding.
+ */
+USTRUCT()
+struct FSkateNetState
+{
+	GENERATED_BODY()
+
+	// Skate physics location
+	UPROPERTY()
+	FVector Location = FVector::ZeroVector;
+
+	// Skate physics velocity
+	UPROPERTY()
+	FVector Velocity = FVector::ZeroVector;
+
+	UPROPERTY()
+	TEnumAsByte<ESkateMode> SkateMode = Skate;
+
+	// Distance along grind spline. Only meaningful while grinding.
+	UPROPERTY()
+	float GrindDistance = 0.0f;
+
+	// Last owning client input applied on the server when this state was taken
+	UPROPERTY()
+	uint16 AckedInputSequence = 0;
+
+	// Read the state of skate physics
+	static FSkateNetState Capture(const ASkatePhysics* SkatePhysics, uint16 AckedInputSequence);
+
+	bool NetSerialize(FArchive& Ar, UPackageMap* Map, bool& bOutSuccess);
+};
+
+template<>
+struct TStructOpsTypeTraits<FSkateNetState> : public TStructOpsTypeTraitsBase2<FSkateNetState>
+{
+	enum
+	{
+		WithNetSerializer = true
+	};
+};
+
+/**
+ * Client skate state predicted after sending an input frame. Kept until the server acknowledges that frame.
+ */
+struct FSkatePredictedState
+{
+	// Input frame this state followed. 0 for none.
+	uint16 Sequence = 0;
+
+	FVector Location = FVector::ZeroVector;
+	FVector Velocity = FVector::ZeroVector;
+	TEnumAsByte<ESkateMode> SkateMode = Skate;
+	float GrindDistance = 0.0f;
+};
@@ -4,9 +4,78 @@
 #include "Skate/SkatePhysics.h"
 
 #include "Grindface.h"
+#include "GrindRail.h"
+#include "GrindRailSubsystem.h"
 #include "Skater.h"
-#include "Kismet/GameplayStatics.h"
+#include "SkateProfiling.h"
+#include "SkateWorldSubsystem.h"
+#include "Debug/QueryDebugDraw.h"
 #include "Kismet/KismetMathLibrary.h"
+#include "Query/QueryBudgetSubsystem.h"
+#include "PhysicsEngine/PhysicsSettings.h"
+#include "PhysicsProxy/SingleParticlePhysicsProxy.h"
+
+DECLARE_CYCLE_STAT(TEXT("SkatePhysics Tick"),STAT_SkatePhysicsTick,STATGROUP_Skate);
+DECLARE_CYCLE_STAT(TEXT("SkatePhysics PostPhysicsTick"),STAT_SkatePhysicsPostPhysicsTick,STATGROUP_Skate);
+DECLARE_CYCLE_STAT(TEXT("SkatePhysics AsyncPhysicsTick"),STAT_SkatePhysicsAsyncPhysicsTick,STATGROUP_Skate);
+DECLARE_CYCLE_STAT(TEXT("CheckGrinding"),STAT_SkateCheckGrinding,STATGROUP_Skate);
+DECLARE_CYCLE_STAT(TEXT("StickToGround"),STAT_SkateStickToGround,STATGROUP_Skate);
+DECLARE_CYCLE_STAT(TEXT("Grind"),STAT_SkateGrind,STATGROUP_Skate);
+DECLARE_CYCLE_STAT(TEXT("AirTrajectoryPrediction"),STAT_SkateAirTrajectoryPrediction,STATGROUP_Skate);
+DECLARE_CYCLE_STAT(TEXT("ReportGroundCondition"),STAT_SkateReportGroundCondition,STATGROUP_Skate);
+
+static TAutoConsoleVariable<int32> CVarSkateAsyncLandingPrediction(
+	TEXT("skate.AsyncLandingPrediction"),
+	0,
+	TEXT("0: Landing prediction traces run synchronously on the game thread.\n")
+	TEXT("1: Coarse landing prediction segments are submitted as one async batch and refined on the next frame."),
+	ECVF_Cheat);
+
+static TAutoConsoleVariable<int32> CVarSkateGroundProbeMode(
+	TEXT("skate.GroundProbe.Mode"),
+	1,
+	TEXT("0: Ground check fans up to 18 line traces around skate physics.\n")
+	TEXT("1: Ground check sweeps a sphere towards the last ground, with at most one fallback sweep straight down."),
+	ECVF_Cheat);
+
+static TAutoConsoleVariable<bool> CVarSkateGroundContact(
+	TEXT("skate.GroundContact"),
+	true,
+	TEXT("Use the physics sphere's hit notifications for ground condition and only trace for ground after contact is lost."),
+	ECVF_Cheat);
+
+static TAutoConsoleVariable<bool> CVarSkateGrindBroadphase(
+	TEXT("skate.GrindBroadphase"),
+	true,
+	TEXT("Only trace for grind actors when the grind rail grid has one within reach."),
+	ECVF_Cheat);
+
+static TAutoConsoleVariable<bool> CVarSkateAsyncPhysicsForces(
+	TEXT("skate.AsyncPhysicsForces"),
+	false,
+	TEXT("Run the skate force model (stick to ground, lean, timed accelerations, velocity clamp) in the fixed step async physics tick.\n")
+	TEXT("Requires bTickPhysicsAsync in physics settings. Read when skate physics begins play."),
+	ECVF_Cheat);
+
+static TAutoConsoleVariable<bool> CVarSkateGroundProbeShowQueryCount(
+	TEXT("skate.GroundProbe.ShowQueryCount"),
+	false,
+	TEXT("Show the number of scene queries issued by the ground check each frame."),
+	ECVF_Cheat);
+
+void FSkatePhysicsPostPhysicsTickFunction::ExecuteTick(float DeltaTime, ELevelTick TickType, ENamedThreads::Type CurrentThread, const FGraphEventRef& MyCompletionGraphEvent)
+{
+	// Follows the primary tick, which the crowd subsystem turns off when it takes over.
+	if (IsValid(Target) && Target->IsActorTickEnabled() && TickType != LEVELTICK_ViewportsOnly)
+	{
+		Target->PostPhysicsTick(DeltaTime);
+	}
+}
+
+FString FSkatePhysicsPostPhysicsTickFunction::DiagnosticMessage()
+{
+	return Target ? Target->GetFullName() + TEXT("[PostPhysicsTick]") : TEXT("<NULL>[PostPhysicsTick]");
+}
 
 // Sets default values
 ASkatePhysics::ASkatePhysics()
@@ -14,6 +83,11 @@ ASkatePhysics::ASkatePhysics()
  	// Set this actor to call Tick() every frame.  You can turn this off to improve performance if you don't need it.
 	PrimaryActorTick.bCanEverTick = true;
 
+	// Forces are applied before physics, queries run after it. The skater ticks after both.
+	PrimaryActorTick.TickGroup = TG_PrePhysics;
+	PostPhysicsTickFunction.bCanEverTick = true;
+	PostPhysicsTickFunction.TickGroup = TG_PostPhysics;
+
 	RootSphere = CreateDefaultSubobject<UStaticMeshComponent>("PhysicsSphere");
 	RootComponent = RootSphere;
 	RootSphere->SetSimulatePhysics(true);
@@ -25,44 +99,85 @@ ASkatePhysics::ASkatePhysics()
 	RootSphere->SetCollisionObjectType(ECollisionChannel::ECC_PhysicsBody);
 	RootSphere->SetHiddenInGame(true);
 	RootSphere->SetCollisionResponseToChannel(ECC_Camera,ECollisionResponse::ECR_Overlap);
+	RootSphere->SetNotifyRigidBodyCollision(true);
 
 }
 
 // Called when the game starts or when spawned
 void ASkatePhysics::BeginPlay()
 {
+	// Async physics tick registration happens in Super::BeginPlay.
+	bAsyncPhysicsForces = CVarSkateAsyncPhysicsForces.GetValueOnGameThread() && UPhysicsSettings::Get()->bTickPhysicsAsync;
+	bAsyncPhysicsTickEnabled = bAsyncPhysicsForces;
+
 	Super::BeginPlay();
 
-	SkaterRef =  Cast<ASkater>(UGameplayStatics::GetPlayerPawn(GetWorld(),0));
+	RootSphere->OnComponentHit.AddDynamic(this,&ASkatePhysics::OnRootSphereHit);
+
+	// Skater reference is set when the subsystem pairs this with a skater
+	GetWorld()->GetSubsystem<USkateWorldSubsystem>()->RegisterSkatePhysics(this);
+
+	// Skate physics spawned for a crowd skater is paired before its tick is registered
+	if (SkaterRef && SkaterRef->bCrowdSkater)
+	{
+		SetActorTickEnabled(false);
+	}
+}
+
+void ASkatePhysics::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	if (USkateWorldSubsystem* SkateWorldSubsystem = GetWorld()->GetSubsystem<USkateWorldSubsystem>())
+	{
+		SkateWorldSubsystem->UnregisterSkatePhysics(this);
+	}
+
+	Super::EndPlay(EndPlayReason);
+}
+
+ASkater* ASkatePhysics::GetSkater() const
+{
+	return SkaterRef;
+}
+
+void ASkatePhysics::SetSkater(ASkater* InSkater)
+{
+	SkaterRef = InSkater;
 }
 
 // Called every frame
 void ASkatePhysics::Tick(float DeltaTime)
 {
+	SCOPE_CYCLE_COUNTER(STAT_SkatePhysicsTick);
+
 	Super::Tick(DeltaTime);
 
 	TickDelta = DeltaTime;
 
+	// Nothing to drive until paired with a skater
+	if (!SkaterRef)
+	{
+		return;
+	}
+
+	// One input frame from a remote owner per tick, the same as its own skate physics took it
+	SkaterRef->ApplyQueuedNetInput();
+
 	switch (CurrentSkateMode)
 	{
 	case Skate:
+	case Air:
 		{
 			{
-				CheckGrinding();
-				ClampVelocity();
-				StickToGround();
-
-				// Perform grind cooldown
-				if (!bGrindCooldownComplete)
+				if (!bAsyncPhysicsForces)
 				{
-					GrindCurrentCooldownTracker += TickDelta;
-					if(GrindCurrentCooldownTracker>GrindCooldownTargetSeconds)
-					{
-						bGrindCooldownComplete = true;
-						GrindCurrentCooldownTracker = 0.0;
-					}
+					ClampVelocity();
+					StickToGround();
+					ApplyActiveAccelerations();
 				}
 
+				// Perform grind cooldown
+				StepCooldown(TickDelta,GrindCooldownTargetSeconds,GrindCurrentCooldownTracker,bGrindCooldownComplete);
+
 				// Perform ollie when grinding
 				if (bOllieNextFrame)
 				{
@@ -83,20 +198,192 @@ void ASkatePhysics::Tick(float DeltaTime)
 	default: break;
 	}
 
+	if (bAsyncPhysicsForces)
+	{
+		SendForceInput();
+	}
+}
+
+void ASkatePhysics::PostPhysicsTick(float DeltaTime)
+{
+	SCOPE_CYCLE_COUNTER(STAT_SkatePhysicsPostPhysicsTick);
+
+	if (!SkaterRef)
+	{
+		return;
+	}
+
+	if (CurrentSkateMode != ESkateMode::Grind)
+	{
+		CheckGrinding();
+	}
+}
+
+void ASkatePhysics::RegisterActorTickFunctions(bool bRegister)
+{
+	Super::RegisterActorTickFunctions(bRegister);
+
+	if (bRegister)
+	{
+		PostPhysicsTickFunction.Target = this;
+		PostPhysicsTickFunction.AddPrerequisite(this,PrimaryActorTick);
+		PostPhysicsTickFunction.RegisterTickFunction(GetLevel());
+	}
+	else if (PostPhysicsTickFunction.IsTickFunctionRegistered())
+	{
+		PostPhysicsTickFunction.UnRegisterTickFunction();
+	}
+}
+
+void ASkatePhysics::AsyncPhysicsTickActor(float DeltaTime, float SimTime)
+{
+	SCOPE_CYCLE_COUNTER(STAT_SkatePhysicsAsyncPhysicsTick);
+
+	Super::AsyncPhysicsTickActor(DeltaTime,SimTime);
+
+	// Only the latest force input matters. Timed accelerations all start on this step.
+	while (ForceInputCommands.Dequeue(PhysicsThreadForceInput))
+	{
+	}
+	FSkateTimedAcceleration TimedAcceleration;
+	while (AccelerationCommands.Dequeue(TimedAcceleration))
+	{
+		PhysicsThreadAccelerations.Add(TimedAcceleration);
+	}
+
+	const FBodyInstance* BodyInstance = RootSphere->GetBodyInstance();
+	const FPhysicsActorHandle ActorHandle = BodyInstance ? BodyInstance->GetPhysicsActorHandle() : nullptr;
+	Chaos::FRigidBodyHandle_Internal* RigidHandle = ActorHandle ? ActorHandle->GetPhysicsThreadAPI() : nullptr;
+
+	// Grinding moves skate physics kinematically
+	if (!RigidHandle || PhysicsThreadForceInput.SkateMode == ESkateMode::Grind)
+	{
+		return;
+	}
+
+	const FVector Velocity = RigidHandle->V();
+	FVector Acceleration = FVector::ZeroVector;
+
+	if (PhysicsThreadForceInput.bStickToGround)
+	{
+		Acceleration += PhysicsThreadForceInput.StickToGroundDirection * 1000;
+	}
+
+	if (PhysicsThreadForceInput.SkateMode == Skate && PhysicsThreadForceInput.LeanAxisValue != 0.0f)
+	{
+		const FVector LeanDirection = FVector::CrossProduct(FVector{0.0,0.0,1.0},Velocity.GetSafeNormal()).GetSafeNormal();
+		const float LeanMagnitude = FMath::Clamp(Velocity.Length()/PhysicsThreadForceInput.MaxVelocity,0.25,2.0) * PhysicsThreadForceInput.LeanAxisValue * PhysicsThreadForceInput.LeanForce;
+		Acceleration += LeanDirection*LeanMagnitude;
+	}
+
+	for (int32 AccelerationIndex = PhysicsThreadAccelerations.Num() - 1; AccelerationIndex >= 0; AccelerationIndex--)
+	{
+		FSkateTimedAcceleration& ActiveAcceleration = PhysicsThreadAccelerations[AccelerationIndex];
+		Acceleration += ActiveAcceleration.Acceleration;
+		ActiveAcceleration.RemainingSeconds -= DeltaTime;
+		if (ActiveAcceleration.RemainingSeconds <= 0.0f)
+		{
+			PhysicsThreadAccelerations.RemoveAtSwap(AccelerationIndex);
+		}
+	}
+
+	RigidHandle->AddForce(Acceleration * RigidHandle->M());
+
+	if (Velocity.Length() > PhysicsThreadForceInput.MaxVelocity)
+	{
+		RigidHandle->SetV(Velocity.GetSafeNormal()*PhysicsThreadForceInput.MaxVelocity);
+	}
+}
+
+void ASkatePhysics::SendForceInput()
+{
+	FSkateForceInput ForceInput;
+	ForceInput.SkateMode = CurrentSkateMode;
+	ForceInput.LeanAxisValue = PendingLeanAxisValue;
+	ForceInput.LeanForce = LeanForce;
+	ForceInput.MaxVelocity = MaxVelocity;
+
+	// Same decision as StickToGround, made here where ground state lives.
+	ForceInput.bStickToGround = GetStickToGroundDirection(ForceInput.StickToGroundDirection);
+
+	ForceInputCommands.Enqueue(ForceInput);
+
+	// Lean input is resent every frame it is held.
+	PendingLeanAxisValue = 0.0f;
+}
+
+void ASkatePhysics::AddSkateAcceleration(FVector Acceleration, float Duration)
+{
+	if (Duration <= 0.0f)
+	{
+		return;
+	}
+
+	if (bAsyncPhysicsForces)
+	{
+		AccelerationCommands.Enqueue({Acceleration,Duration});
+	}
+	else
+	{
+		ActiveAccelerations.Add({Acceleration,Duration});
+	}
+}
+
+void ASkatePhysics::ApplyActiveAccelerations()
+{
+	for (int32 AccelerationIndex = ActiveAccelerations.Num() - 1; AccelerationIndex >= 0; AccelerationIndex--)
+	{
+		FSkateTimedAcceleration& ActiveAcceleration = ActiveAccelerations[AccelerationIndex];
+		RootSphere->AddForce(ActiveAcceleration.Acceleration,NAME_None,true);
+		ActiveAcceleration.RemainingSeconds -= TickDelta;
+		if (ActiveAcceleration.RemainingSeconds <= 0.0f)
+		{
+			ActiveAccelerations.RemoveAtSwap(AccelerationIndex);
+		}
+	}
+}
+
+bool ASkatePhysics::UsesAsyncPhysicsForces() const
+{
+	return bAsyncPhysicsForces;
 }
 
 void ASkatePhysics::CheckGrinding()
 {
+	SCOPE_CYCLE_COUNTER(STAT_SkateCheckGrinding);
+	SKATE_SCOPE_TIMER(CheckGrinding);
+
 	if (bGrindCooldownComplete)
 	{
+		// Hits beyond reach are never grabbed, so trace no further than that.
+		const FVector GrindTraceStart = this->GetActorLocation();
+		const FVector GrindTraceEnd = this->GetActorLocation()+RootSphere->GetPhysicsLinearVelocity().GetClampedToMaxSize(GrindDetectionReach);
+
+		// Skip the trace when no grind actor is near
+		const UGrindRailSubsystem* GrindRailSubsystem = GetWorld()->GetSubsystem<UGrindRailSubsystem>();
+		if (CVarSkateGrindBroadphase.GetValueOnGameThread() && GrindRailSubsystem && !GrindRailSubsystem->HasGrindCandidate(FBox(GrindTraceStart.ComponentMin(GrindTraceEnd),GrindTraceStart.ComponentMax(GrindTraceEnd))))
+		{
+			return;
+		}
+
+		// Out of grind traces for this frame. The rail is still there next frame.
+		if (UQueryBudgetSubsystem::GetRemainingBudget(GetWorld(),EQueryDebugCategory::SkateGrind,this) <= 0)
+		{
+			return;
+		}
+
 		// Perform a trace towards velocity to find a grind actor
 		FHitResult GrindHitResult;
-		if (GetWorld()->LineTraceSingleByChannel(GrindHitResult,this->GetActorLocation(),this->GetActorLocation()+RootSphere->GetPhysicsLinearVelocity(),ECC_GameTraceChannel1))
+		SKATE_COUNT_LINE_TRACES(1);
+		const bool bGrindTraceHit = UQueryBudgetSubsystem::LineTraceSingle(GetWorld(),EQueryDebugCategory::SkateGrind,this,GrindHitResult,GrindTraceStart,GrindTraceEnd,ECC_GameTraceChannel1);
+		if (bGrindTraceHit)
 		{
-			if (GrindHitResult.bBlockingHit && GrindHitResult.Distance<50.0)
+			if (GrindHitResult.bBlockingHit && GrindHitResult.Distance<GrindDetectionReach)
 			{
 				GrindActor = GrindHitResult.GetActor();
+				GrindRail = Cast<AGrindRail>(GrindActor);
 
+				SKATE_COUNT_BLUEPRINT_CALLS(1);
 				const FVector SplineTangent = IGrindface::Execute_FindSplineTangentNearHitLocation(GrindActor,GrindHitResult.ImpactPoint).GetSafeNormal();
 
 				// Check 1 = has enough velocity to grind
@@ -110,6 +397,7 @@ void ASkatePhysics::CheckGrinding()
 					// Decide if Skater intends to move in direction of grind spline or opposite of it.
 					bMovingInSplineDirection =  FVector::DotProduct(SplineTangent,RootSphere->GetPhysicsLinearVelocity().GetSafeNormal()) > (0.0);
 					
+					SKATE_COUNT_BLUEPRINT_CALLS(3);
 					GrindSnapPoint = IGrindface::Execute_GetInitialSnapPoint(GrindActor,GrindHitResult.ImpactPoint);
 					GrindSplineLength = IGrindface::Execute_GetSplineLength(GrindActor);
 					GrindCurrentDistance = IGrindface::Execute_GetInitialHitDistanceAlongSpline(GrindActor,GrindHitResult.ImpactPoint);
@@ -132,20 +420,50 @@ void ASkatePhysics::ClampVelocity()
 
 void ASkatePhysics::StickToGround()
 {
-	if (Cast<ASkater>(UGameplayStatics::GetPlayerPawn(GetWorld(),0))->GetGrounded())
+	SCOPE_CYCLE_COUNTER(STAT_SkateStickToGround);
+
+	FVector StickToGroundDirection;
+	if (GetStickToGroundDirection(StickToGroundDirection))
 	{
-		const FVector Force =  SkaterRef->RotationTracker->GetUpVector() * -1000;
+		const FVector Force = StickToGroundDirection * 1000;
 		RootSphere->AddForce(Force,NAME_None,true);
 	}
 }
 
+bool ASkatePhysics::GetStickToGroundDirection(FVector& OutDirection) const
+{
+	if (HasGroundContact())
+	{
+		// Push into the surface physics sphere is touching
+		OutDirection = GroundContactHit.ImpactNormal * -1;
+		return true;
+	}
+	if (SkaterRef && SkaterRef->GetGrounded())
+	{
+		OutDirection = SkaterRef->RotationTracker->GetUpVector() * -1;
+		return true;
+	}
+	return false;
+}
+
 void ASkatePhysics::ChangeSkateMode(TEnumAsByte<ESkateMode> NewSkateMode)
 {
+	const TEnumAsByte<ESkateMode> PreviousSkateMode = CurrentSkateMode;
 	CurrentSkateMode = NewSkateMode;
+
+	// Any landing predicted so far belongs to the previous mode.
+	InvalidateLandingPrediction();
+
 	switch (CurrentSkateMode)
 	{
 	case Skate:
 		{
+			// Landing from air needs no setup. Coming off a grind, hand physics back with the grind velocity.
+			if (PreviousSkateMode != ESkateMode::Grind)
+			{
+				break;
+			}
+
 			RootSphere->SetSimulatePhysics(true);
 			const FVector NewVelocity = SkaterRef->GetRotationTrackerForwardVector()*GrindInitialVelocity.Length();
 			RootSphere->SetPhysicsLinearVelocity(NewVelocity);
@@ -170,58 +488,24 @@ void ASkatePhysics::ChangeSkateMode(TEnumAsByte<ESkateMode> NewSkateMode)
 
 void ASkatePhysics::Grind()
 {
+	SCOPE_CYCLE_COUNTER(STAT_SkateGrind);
+	SKATE_SCOPE_TIMER(Grind);
+
 	if (bGrindInitialSnapHappened)
 	{
-		if (bMovingInSplineDirection)
-		{
-			// try to move in positive direction of grind spline
-			GrindCurrentDistance +=GrindInitialVelocity.Length()*TickDelta;
-			if (GrindCurrentDistance>GrindSplineLength)
-			{
-				// Abandon grind
-				ChangeSkateMode(Skate);
-			}
-			else
-			{
-				// Continue to grind
-				const FVector SplineSnapPoint = IGrindface::Execute_GetSnapPointAtDistanceAlongSpline(GrindActor,GrindCurrentDistance);
-
-				// apply z offset to snap point
-				GrindSnapPoint = FVector{SplineSnapPoint.X, SplineSnapPoint.Y,SplineSnapPoint.Z + GrindZOffset};
-
-				SetActorLocation(GrindSnapPoint,false,nullptr,ETeleportType::TeleportPhysics);
-				
-				// Set Skater's rotation tracker's rotation in tangential direction
-				Cast<ASkater>(UGameplayStatics::GetPlayerPawn(GetWorld(),0))->RotationTracker->SetWorldRotation(UKismetMathLibrary::MakeRotFromX(IGrindface::Execute_GetTangentAtDistanceAlongSpline(GrindActor,GrindCurrentDistance)));  
-			}
-		}
-		else
-		{
-			// try to move in opposite direction of grind spline
-			GrindCurrentDistance -=GrindInitialVelocity.Length()*TickDelta;
-			if (GrindCurrentDistance<0.0)
-			{
-				// Abandon grind
-				ChangeSkateMode(Skate);
-			}
-			else
-			{
-				// Continue to grind
-				const FVector SplineSnapPoint = IGrindface::Execute_GetSnapPointAtDistanceAlongSpline(GrindActor,GrindCurrentDistance);
-
-				// apply z offset to snap point
-				GrindSnapPoint = FVector{SplineSnapPoint.X, SplineSnapPoint.Y,SplineSnapPoint.Z + GrindZOffset};
-
-				SetActorLocation(GrindSnapPoint,false,nullptr,ETeleportType::TeleportPhysics);
-				// Set Skater's rotation tracker's rotation in tangential direction
-				Cast<ASkater>(UGameplayStatics::GetPlayerPawn(GetWorld(),0))->RotationTracker->SetWorldRotation(UKismetMathLibrary::MakeRotFromX(IGrindface::Execute_GetTangentAtDistanceAlongSpline(GrindActor,GrindCurrentDistance)*-1));  
-			}
-		}
+		// Grind advances in fixed steps so speed and end of rail do not depend on frame rate.
+		bool bGrindStepped;
+		const bool bOnRail = StepGrindDistance(TickDelta,GrindStepSeconds,GrindMaxStepsPerTick,GetGrindSpeed(),GrindSplineLength,
+			GrindStepAccumulator,GrindCurrentDistance,PreviousGrindDistance,bGrindStepped);
+		FinishGrindStep(bOnRail,bGrindStepped);
 	}
 	else
 	{
 		SetActorLocation(FVector{GrindSnapPoint.X,GrindSnapPoint.Y,GrindSnapPoint.Z+GrindZOffset},false,nullptr,ETeleportType::TeleportPhysics);
 		bGrindInitialSnapHappened = true;
+		GrindStepAccumulator = 0.0f;
+		PreviousGrindDistance = GrindCurrentDistance;
+		GrindRenderLocation = GetActorLocation();
 		
 		//TODO Temp anim
 		if (GrindAnim && GrindBoardAnim)
@@ -232,11 +516,104 @@ void ASkatePhysics::Grind()
 	}
 }
 
+bool ASkatePhysics::StepGrindDistance(float DeltaTime, float StepSeconds, int32 MaxSteps, float Speed, float SplineLength,
+	float& InOutAccumulator, float& InOutDistance, float& OutPreviousDistance, bool& bOutStepped)
+{
+	InOutAccumulator = FMath::Min(InOutAccumulator + DeltaTime,StepSeconds * MaxSteps);
+
+	bOutStepped = false;
+	while (InOutAccumulator >= StepSeconds)
+	{
+		InOutAccumulator -= StepSeconds;
+		OutPreviousDistance = InOutDistance;
+		InOutDistance += Speed*StepSeconds;
+		bOutStepped = true;
+
+		if (InOutDistance>SplineLength || InOutDistance<0.0)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+void ASkatePhysics::StepCooldown(float DeltaTime, float TargetSeconds, float& InOutTracker, bool& bInOutComplete)
+{
+	if (!bInOutComplete)
+	{
+		InOutTracker += DeltaTime;
+		if(InOutTracker>TargetSeconds)
+		{
+			bInOutComplete = true;
+			InOutTracker = 0.0;
+		}
+	}
+}
+
+float ASkatePhysics::GetGrindSpeed() const
+{
+	return (bMovingInSplineDirection ? 1.0f : -1.0f) * GrindInitialVelocity.Length();
+}
+
+void ASkatePhysics::FinishGrindStep(bool bOnRail, bool bGrindStepped)
+{
+	if (!bOnRail)
+	{
+		// Abandon grind
+		ChangeSkateMode(Skate);
+		return;
+	}
+
+	// Continue to grind. Physics only moves on steps, the skater is shown between the last two steps.
+	if (bGrindStepped)
+	{
+		const FVector SplineSnapPoint = GetGrindSnapPointAtDistance(GrindCurrentDistance);
+
+		// apply z offset to snap point
+		GrindSnapPoint = FVector{SplineSnapPoint.X, SplineSnapPoint.Y,SplineSnapPoint.Z + GrindZOffset};
+
+		SetActorLocation(GrindSnapPoint,false,nullptr,ETeleportType::TeleportPhysics);
+	}
+
+	const float GrindRenderDistance = FMath::Lerp(PreviousGrindDistance,GrindCurrentDistance,GrindStepAccumulator/GrindStepSeconds);
+	GrindRenderLocation = GetGrindSnapPointAtDistance(GrindRenderDistance) + FVector{0.0,0.0,GrindZOffset};
+
+	// Set Skater's rotation tracker's rotation in tangential direction
+	const float GrindDirection = bMovingInSplineDirection ? 1.0f : -1.0f;
+	SkaterRef->RotationTracker->SetWorldRotation(UKismetMathLibrary::MakeRotFromX(GetGrindTangentAtDistance(GrindRenderDistance)*GrindDirection));
+}
+
+FVector ASkatePhysics::GetRenderLocation() const
+{
+	return CurrentSkateMode == ESkateMode::Grind && bGrindInitialSnapHappened ? GrindRenderLocation : GetActorLocation();
+}
+
+FVector ASkatePhysics::GetGrindSnapPointAtDistance(float Distance) const
+{
+	if (GrindRail)
+	{
+		return GrindRail->GetRailLocationAtDistance(Distance);
+	}
+	SKATE_COUNT_BLUEPRINT_CALLS(1);
+	return IGrindface::Execute_GetSnapPointAtDistanceAlongSpline(GrindActor,Distance);
+}
+
+FVector ASkatePhysics::GetGrindTangentAtDistance(float Distance) const
+{
+	if (GrindRail)
+	{
+		return GrindRail->GetRailTangentAtDistance(Distance);
+	}
+	SKATE_COUNT_BLUEPRINT_CALLS(1);
+	return IGrindface::Execute_GetTangentAtDistanceAlongSpline(GrindActor,Distance);
+}
+
 void ASkatePhysics::Ollie()
 {
 	switch (CurrentSkateMode)
 	{
 	case ESkateMode::Skate:
+	case ESkateMode::Air:
 		{
 			const FVector ForwardVec =SkaterRef->RotationTracker->GetForwardVector();
 			const FVector UpVec = SkaterRef->RotationTracker->GetUpVector();
@@ -244,6 +621,9 @@ void ASkatePhysics::Ollie()
 			RootSphere->AddImpulse(Impulse,NAME_None,true);
 			bOllieNextFrame = false;
 
+			// Leaving the ground, so contact from before the ollie no longer counts.
+			GroundContactFrame = 0;
+
 			//TODO temp anim
 			if (OllieAnim && OllieJumpAnim)
 			{
@@ -267,6 +647,13 @@ void ASkatePhysics::Ollie()
 
 void ASkatePhysics::Lean(bool bAtRest, float AxisValue)
 {
+	if (bAsyncPhysicsForces)
+	{
+		// Lean force is applied on the physics thread
+		PendingLeanAxisValue = bAtRest ? 0.0f : AxisValue;
+		return;
+	}
+
 	if(!bAtRest && CurrentSkateMode == Skate)
 	{
 		const FVector LeanDirection = FVector::CrossProduct(FVector{0.0,0.0,1.0},RootSphere->GetPhysicsLinearVelocity().GetSafeNormal()).GetSafeNormal();
@@ -278,66 +665,228 @@ void ASkatePhysics::Lean(bool bAtRest, float AxisValue)
 
 void ASkatePhysics::AirTrajectoryPrediction()
 {
-	// Populate a time step array
-	TArray<float> TimeStepArray;
-	TimeStepArray.SetNum(100);
-	for(int i=0;i<100;i++)
+	SCOPE_CYCLE_COUNTER(STAT_SkateAirTrajectoryPrediction);
+	SKATE_SCOPE_TIMER(AirTrajectoryPrediction);
+
+	// Skater does not orient to landings while grinding.
+	if (CurrentSkateMode == ESkateMode::Grind)
+	{
+		return;
+	}
+
+	const bool bAsync = CVarSkateAsyncLandingPrediction.GetValueOnGameThread() > 0;
+
+	// A batch submitted last frame is the freshest prediction available, so use it as is.
+	// Otherwise the cached landing is re-validated, and only solved again when it is no longer valid.
+	const bool bPredictionReady = (bAsync && ConsumeAsyncLandingPrediction()) || RevalidateCachedLandingPrediction();
+	if (!bPredictionReady)
+	{
+		if (bAsync)
+		{
+			SubmitAsyncLandingPrediction();
+			return;
+		}
+		SolveLandingPredictionSync();
+	}
+
+	if (CachedLandingPrediction.bHit)
+	{
+		OrientSkaterToLanding(CachedLandingPrediction,CachedLandingArc);
+	}
+}
+
+FSkateTrajectorySolverSettings ASkatePhysics::GetLandingSolverSettings() const
+{
+	FSkateTrajectorySolverSettings Settings;
+	Settings.Horizon = LandingPredictionHorizon;
+	Settings.CoarseStep = LandingPredictionCoarseStep;
+	Settings.Tolerance = LandingPredictionTolerance;
+	Settings.QueryRequester = this;
+
+	// Over budget, the landing is looked for over a shorter horizon
+	FSkateTrajectorySolver::FitToQueryBudget(Settings,UQueryBudgetSubsystem::GetRemainingBudget(GetWorld(),EQueryDebugCategory::SkateLanding,this));
+	return Settings;
+}
+
+FSkateBallisticArc ASkatePhysics::GetCurrentAirTrajectory() const
+{
+	// We use the current physics velocity and gravitational acceleration to 'predict' where the skater will be.
+	// This way, we can easily align the skater properly before hitting ground.
+	return FSkateBallisticArc(GetActorLocation(),RootSphere->GetPhysicsLinearVelocity(),GetWorld()->GetTimeSeconds());
+}
+
+void ASkatePhysics::OrientSkaterToLanding(const FSkateLandingPrediction& Prediction, const FSkateBallisticArc& Arc) const
+{
+	// following is the direction that the skater will move in just after landing
+	const FVector ProjectedVelocityDirectionOnLanding = UKismetMathLibrary::ProjectVectorOnToPlane(Prediction.VelocityAtHit,Prediction.Normal).GetSafeNormal();
+
+	// The arc may have been sampled on an earlier frame, so time to hit is measured from now.
+	const float TimeToHit = FMath::Max(0.0f, Prediction.ArcTimeToHit - static_cast<float>(GetWorld()->GetTimeSeconds() - Arc.StartWorldTime));
+
+	// Finally tell rotation tracker to use this information to rotate mid air for smooth landing.
+	SkaterRef->OrientToLanding(Prediction.HitResult,TimeToHit,ProjectedVelocityDirectionOnLanding);
+}
+
+void ASkatePhysics::CacheLandingPrediction(const FSkateLandingPrediction& Prediction, const FSkateBallisticArc& Arc, float SearchedUntil)
+{
+	bLandingPredictionCached = true;
+	CachedLandingPrediction = Prediction;
+	CachedLandingArc = Arc;
+	CachedLandingSearchedUntil = SearchedUntil;
+}
+
+void ASkatePhysics::InvalidateLandingPrediction()
+{
+	bLandingPredictionCached = false;
+	CachedLandingPrediction = FSkateLandingPrediction();
+}
+
+bool ASkatePhysics::RevalidateCachedLandingPrediction()
+{
+	// Only an uninterrupted air state follows a single arc.
+	if (!bLandingPredictionCached || CurrentSkateMode != ESkateMode::Air)
+	{
+		return false;
+	}
+
+	// An external force has pushed skate physics off the cached arc.
+	const float ArcTime = GetWorld()->GetTimeSeconds() - CachedLandingArc.StartWorldTime;
+	if (!GetActorLocation().Equals(CachedLandingArc.GetLocationAtTime(ArcTime),LandingCacheLocationTolerance) ||
+		!RootSphere->GetPhysicsLinearVelocity().Equals(CachedLandingArc.GetVelocityAtTime(ArcTime),LandingCacheVelocityTolerance))
 	{
-		if (i==0)
+		return false;
+	}
+
+	const FSkateTrajectorySolverSettings Settings = GetLandingSolverSettings();
+	int32 QueryCount = 0;
+
+	if (CachedLandingPrediction.bHit)
+	{
+		// Skater should have landed by now but is still in air.
+		if (ArcTime > CachedLandingPrediction.ArcTimeToHit)
 		{
-			TimeStepArray[0] = 0.0;
+			return false;
 		}
-		else
+
+		// Trace a short segment around the cached landing and check the surface is still there.
+		const float WindowStartTime = FMath::Max(ArcTime,CachedLandingPrediction.ArcTimeToHit - LandingCacheRevalidationWindow);
+		const float WindowEndTime = CachedLandingPrediction.ArcTimeToHit + LandingCacheRevalidationWindow;
+
+		FHitResult WindowHit;
+		if (!FSkateTrajectorySolver::TraceChord(GetWorld(),CachedLandingArc,Settings,FCollisionQueryParams::DefaultQueryParam,WindowStartTime,WindowEndTime,WindowHit,QueryCount) ||
+			!WindowHit.ImpactPoint.Equals(CachedLandingPrediction.Location,LandingCacheLocationTolerance))
 		{
-			TimeStepArray[i] = TimeStepArray[i-1] + 0.05;
+			return false;
 		}
+
+		FSkateTrajectorySolver::SetPredictionFromChordHit(CachedLandingArc,WindowStartTime,WindowEndTime,WindowHit,CachedLandingPrediction);
+		return true;
 	}
 
-	// We use this time step array and current physics velocity to 'predict' where the skater will be after each step.
-	// This way, we can easily align the skater properly before hitting ground.
-	// We use the velocity and acceleration (gravitational acceleration) equations to do these predictions.
+	// No landing within the horizon so far. Only the part of the arc that has come into the horizon since then needs a look.
+	const float SearchEndTime = ArcTime + Settings.Horizon;
+	if (SearchEndTime - CachedLandingSearchedUntil < Settings.CoarseStep)
+	{
+		return true;
+	}
+
+	FHitResult SegmentHit;
+	if (FSkateTrajectorySolver::TraceChord(GetWorld(),CachedLandingArc,Settings,FCollisionQueryParams::DefaultQueryParam,CachedLandingSearchedUntil,SearchEndTime,SegmentHit,QueryCount))
+	{
+		FSkateTrajectorySolver::RefineSegment(GetWorld(),CachedLandingArc,Settings,FCollisionQueryParams::DefaultQueryParam,CachedLandingSearchedUntil,SearchEndTime,SegmentHit,CachedLandingPrediction);
+	}
+	CachedLandingSearchedUntil = SearchEndTime;
 
-	FVector InitialVelocity = RootSphere->GetPhysicsLinearVelocity();
+	return true;
+}
+
+void ASkatePhysics::SolveLandingPredictionSync()
+{
+	const FSkateBallisticArc Arc = GetCurrentAirTrajectory();
+	const FSkateTrajectorySolverSettings Settings = GetLandingSolverSettings();
 
-	for (auto TimeStep : TimeStepArray)
+	FSkateLandingPrediction Prediction;
+	FSkateTrajectorySolver::Solve(GetWorld(),Arc,Settings,FCollisionQueryParams::DefaultQueryParam,Prediction);
+	CacheLandingPrediction(Prediction,Arc,Settings.Horizon);
+}
+
+bool ASkatePhysics::ConsumeAsyncLandingPrediction()
+{
+	// Async trace results are only available on the frame after they were requested. Anything older was submitted
+	// before the last landing and is dropped.
+	if (PendingLandingTraceHandles.IsEmpty() || PendingLandingTraceFrame + 1 != GFrameCounter)
 	{
-		FVector Gravity = FVector{0.0,0.0,-980.0};
-		float t = TimeStep - 0.1;
-		FVector Displacement = InitialVelocity*t + (0.5 * Gravity * t * t);
-		FVector FinalVelocity = InitialVelocity + Gravity*t;
+		PendingLandingTraceHandles.Reset();
+		return false;
+	}
 
-		// Predicted trace
-		FHitResult PredictionTraceResult;
-		FVector TraceStart = GetActorLocation() + Displacement;
-		FVector TraceEnd = TraceStart + (FinalVelocity.Length()*0.05 + (0.5*0.05*0.05*980))*FinalVelocity.GetSafeNormal();  // This is TraceStart + s { = ((u * t) + (1/2 * a * t^2) }.
-		//Here, t is 0.05 as we are only considering the displacement during that small time step.
+	const FSkateTrajectorySolverSettings Settings = GetLandingSolverSettings();
 
-		if(GetWorld()->LineTraceSingleByChannel(PredictionTraceResult,TraceStart,TraceEnd,ECC_Visibility))
+	FSkateLandingPrediction Prediction;
+	for (int32 SegmentIndex = 0; SegmentIndex < PendingLandingTraceHandles.Num(); SegmentIndex++)
+	{
+		FTraceDatum SegmentTraceDatum;
+		if (!GetWorld()->QueryTraceData(PendingLandingTraceHandles[SegmentIndex],SegmentTraceDatum))
 		{
-			//DrawDebugLine(GetWorld(),TraceStart,TraceEnd,FColor::Silver,true,-1);
-			
-			if(PredictionTraceResult.bBlockingHit)
-			{
-				//GEngine->AddOnScreenDebugMessage(-1,5.0,FColor::Blue,PredictionTraceResult.GetActor()->GetName());
+			continue;
+		}
+
+		// Segments are in arc time order, so the first blocking hit that survives refinement is the landing.
+		const FHitResult* SegmentHit = SegmentTraceDatum.OutHits.FindByPredicate([](const FHitResult& Hit)
+		{
+			return Hit.bBlockingHit;
+		});
+		FQueryDebugDraw::RecordLine(GetWorld(),EQueryDebugCategory::SkateLanding,SegmentTraceDatum.Start,SegmentTraceDatum.End,SegmentHit);
+		if (!SegmentHit)
+		{
+			continue;
+		}
 
-				// following is the direction that the skater will move in just after landing
-				FVector ProjectedVelocityDirectionOnLanding = UKismetMathLibrary::ProjectVectorOnToPlane(FinalVelocity,PredictionTraceResult.Normal).GetSafeNormal();
+		const TPair<float, float>& Segment = PendingLandingTraceSegments[SegmentIndex];
+		if (FSkateTrajectorySolver::RefineSegment(GetWorld(),PendingLandingArc,Settings,FCollisionQueryParams::DefaultQueryParam,Segment.Key,Segment.Value,*SegmentHit,Prediction))
+		{
+			break;
+		}
+	}
 
-				// Finally tell rotation tracker to use this information to rotate mid air for smooth landing.
-				Cast<ASkater>(UGameplayStatics::GetPlayerPawn(GetWorld(),0))->OrientToLanding(PredictionTraceResult,0.0,ProjectedVelocityDirectionOnLanding);
+	PendingLandingTraceHandles.Reset();
 
-				// Successful so break the loop
-				break;
-			}
+	// Searched as far as the segments submitted, whatever the budget allows now
+	CacheLandingPrediction(Prediction,PendingLandingArc,PendingLandingSearchedUntil);
+	return true;
+}
+
+void ASkatePhysics::SubmitAsyncLandingPrediction()
+{
+	// Submit the coarse segments of the whole trajectory as one batch. The traces run alongside the rest of the frame and are consumed next frame.
+	PendingLandingArc = GetCurrentAirTrajectory();
+	const FSkateTrajectorySolverSettings Settings = GetLandingSolverSettings();
+	FSkateTrajectorySolver::GetCoarseSegments(Settings,PendingLandingTraceSegments);
+
+	PendingLandingTraceHandles.Reset();
+	PendingLandingSearchedUntil = Settings.StartTime;
+	for (const TPair<float, float>& Segment : PendingLandingTraceSegments)
+	{
+		const FTraceHandle Handle = UQueryBudgetSubsystem::AsyncLineTrace(GetWorld(),EQueryDebugCategory::SkateLanding,this,EAsyncTraceType::Single,
+			PendingLandingArc.GetLocationAtTime(Segment.Key),PendingLandingArc.GetLocationAtTime(Segment.Value),ECC_Visibility);
+
+		// Refused by the query budget. The rest of the arc is left for revalidation to search.
+		if (!Handle.IsValid())
+		{
+			break;
 		}
-		
-		DrawDebugDirectionalArrow(GetWorld(),TraceStart,TraceEnd,10,FColor::Emerald,true);
+		PendingLandingTraceHandles.Add(Handle);
+		PendingLandingSearchedUntil = Segment.Value;
 	}
-	
+	PendingLandingTraceSegments.SetNum(PendingLandingTraceHandles.Num());
+	PendingLandingTraceFrame = GFrameCounter;
+	SKATE_COUNT_LINE_TRACES(PendingLandingTraceHandles.Num());
 }
 
 void ASkatePhysics::FlipJump()
 {
+	// GroundTraceHitNormal is the normal of the last ground contact or ground trace, i.e. the ramp being left.
+
 	// When performing this move, we remove the part of velocity that that pushes into the ramp so that skater will land back on the ramp
 	
 	// Direction of unnecessary velocity points inward of the ramp
@@ -359,6 +908,78 @@ FVector ASkatePhysics::GetSkatePhysicsVelocity()
 }
 
 FHitResult ASkatePhysics::ReportGroundCondition()
+{
+	SCOPE_CYCLE_COUNTER(STAT_SkateReportGroundCondition);
+	SKATE_SCOPE_TIMER(ReportGroundCondition);
+
+	GroundProbeQueryCount = 0;
+
+	// While the physics sphere is touching ground, its last contact is the ground condition and no query is needed.
+	if (HasGroundContact())
+	{
+		GroundTraceHitNormal = GroundContactHit.ImpactNormal;
+		bGroundProbeHitLastFrame = true;
+		return GroundContactHit;
+	}
+
+	const FHitResult HitResult = CVarSkateGroundProbeMode.GetValueOnGameThread() > 0 ? ReportGroundConditionSweep() : ReportGroundConditionRays();
+	bGroundProbeHitLastFrame = HitResult.bBlockingHit;
+	LastGroundProbeHit = HitResult;
+
+	if (CVarSkateGroundProbeShowQueryCount.GetValueOnGameThread())
+	{
+		GEngine->AddOnScreenDebugMessage(2,0.0f,FColor::Yellow,FString::Printf(TEXT("Ground check queries: %d"),GroundProbeQueryCount));
+	}
+
+	return HitResult;
+}
+
+FHitResult ASkatePhysics::ReportGroundConditionSweep()
+{
+	FHitResult HitResult;
+
+	// The probe sphere stays inside the physics sphere so it does not start out penetrating the ground skate physics rests on.
+	const float ProbeRadius = FMath::Min(GroundProbeRadius,RootSphere->Bounds.SphereRadius*0.9f);
+	const FCollisionShape ProbeShape = FCollisionShape::MakeSphere(ProbeRadius);
+	const FVector TraceStart = GetActorLocation();
+
+	// Ground last found is the most likely place to find it again. This keeps steep ramp walls that are beside
+	// skate physics rather than below it grounded, which the line trace fan covers with its near horizontal traces.
+	TArray<FVector, TInlineAllocator<2>> ProbeDirections;
+	if (bGroundProbeHitLastFrame && !GroundTraceHitNormal.IsNearlyZero())
+	{
+		ProbeDirections.Add(-GroundTraceHitNormal.GetSafeNormal());
+	}
+	if (ProbeDirections.IsEmpty() || !ProbeDirections[0].Equals(-GetActorUpVector(),0.05))
+	{
+		ProbeDirections.Add(-GetActorUpVector());
+	}
+
+	for (const FVector& ProbeDirection : ProbeDirections)
+	{
+		const FVector TraceEnd = TraceStart + ProbeDirection*(GroundCheckDistance - ProbeRadius);
+
+		// Out of ground probes for this frame. Ground found last is the best guess.
+		if (UQueryBudgetSubsystem::GetRemainingBudget(GetWorld(),EQueryDebugCategory::SkateGround,this) <= 0)
+		{
+			return LastGroundProbeHit;
+		}
+
+		GroundProbeQueryCount++;
+		SKATE_COUNT_SWEEPS(1);
+		const bool bGroundSweepHit = UQueryBudgetSubsystem::SweepSingle(GetWorld(),EQueryDebugCategory::SkateGround,this,HitResult,TraceStart,TraceEnd,FQuat::Identity,ECC_Visibility,ProbeShape);
+
+		if (bGroundSweepHit && HitResult.bBlockingHit)
+		{
+			GroundTraceHitNormal = HitResult.ImpactNormal;
+			return HitResult;
+		}
+	}
+
+	return HitResult;
+}
+
+FHitResult ASkatePhysics::ReportGroundConditionRays()
 {
 	// To check for grounded, we perform 9 traces in the XZ plane and 9 traces in the YZ plane to make sure that ground trace is not missed on inclined surfaces
 
@@ -371,9 +992,18 @@ FHitResult ASkatePhysics::ReportGroundCondition()
 
 		// Finding trace end locations based on angles
 		FVector TraceEnd = ((GetActorUpVector() * (-1) * UKismetMathLibrary::DegCos(Angle)) +
-			(SkaterRef->CameraBoom->GetForwardVector()* UKismetMathLibrary::DegSin(Angle))) * 65 + TraceStart;
+			(SkaterRef->CameraBoom->GetForwardVector()* UKismetMathLibrary::DegSin(Angle))) * GroundCheckDistance + TraceStart;
 
-		if(GetWorld()->LineTraceSingleByChannel(HitResult,TraceStart,TraceEnd,ECC_Visibility))
+		// Out of ground probes for this frame. Ground found last is the best guess.
+		if (UQueryBudgetSubsystem::GetRemainingBudget(GetWorld(),EQueryDebugCategory::SkateGround,this) <= 0)
+		{
+			return LastGroundProbeHit;
+		}
+
+		GroundProbeQueryCount++;
+		SKATE_COUNT_LINE_TRACES(1);
+		const bool bGroundTraceHit = UQueryBudgetSubsystem::LineTraceSingle(GetWorld(),EQueryDebugCategory::SkateGround,this,HitResult,TraceStart,TraceEnd,ECC_Visibility);
+		if(bGroundTraceHit)
 		{
 			if(HitResult.bBlockingHit)
 			{
@@ -391,9 +1021,18 @@ FHitResult ASkatePhysics::ReportGroundCondition()
 
 		// Finding trace end locations based on angles
 		FVector TraceEnd = ((GetActorUpVector() * (-1) * UKismetMathLibrary::DegCos(Angle)) +
-			(SkaterRef->CameraBoom->GetRightVector()* UKismetMathLibrary::DegSin(Angle))) * 65 + TraceStart;
+			(SkaterRef->CameraBoom->GetRightVector()* UKismetMathLibrary::DegSin(Angle))) * GroundCheckDistance + TraceStart;
+
+		// Out of ground probes for this frame. Ground found last is the best guess.
+		if (UQueryBudgetSubsystem::GetRemainingBudget(GetWorld(),EQueryDebugCategory::SkateGround,this) <= 0)
+		{
+			return LastGroundProbeHit;
+		}
 
-		if(GetWorld()->LineTraceSingleByChannel(HitResult,TraceStart,TraceEnd,ECC_Visibility))
+		GroundProbeQueryCount++;
+		SKATE_COUNT_LINE_TRACES(1);
+		const bool bGroundTraceHit = UQueryBudgetSubsystem::LineTraceSingle(GetWorld(),EQueryDebugCategory::SkateGround,this,HitResult,TraceStart,TraceEnd,ECC_Visibility);
+		if(bGroundTraceHit)
 		{
 			if(HitResult.bBlockingHit)
 			{
@@ -410,3 +1049,36 @@ TEnumAsByte<ESkateMode> ASkatePhysics::GetCurrentSkateMode() const
 	return  CurrentSkateMode;
 }
 
+bool ASkatePhysics::HasGroundContact() const
+{
+	if (!CVarSkateGroundContact.GetValueOnGameThread() || GroundContactFrame == 0 || CurrentSkateMode == ESkateMode::Grind)
+	{
+		return false;
+	}
+
+	// Contact lost for too long. Ground traces take over.
+	if (GFrameCounter - GroundContactFrame > static_cast<uint64>(GroundContactGraceFrames))
+	{
+		return false;
+	}
+
+	// Moving away from the contact surface, e.g. bouncing off a ramp lip.
+	return FVector::DotProduct(RootSphere->GetPhysicsLinearVelocity(),GroundContactHit.ImpactNormal) < GroundContactSeparationSpeed;
+}
+
+void ASkatePhysics::OnRootSphereHit(UPrimitiveComponent* HitComponent, AActor* OtherActor, UPrimitiveComponent* OtherComp, FVector NormalImpulse, const FHitResult& Hit)
+{
+	// Ceilings are not ground. Walls are, the same as for ground traces, so skater stays grounded up ramp walls.
+	// Up is the skater's, not the root sphere's, which rolls.
+	const FVector UpVector = SkaterRef ? SkaterRef->RotationTracker->GetUpVector() : FVector::UpVector;
+	if (FVector::DotProduct(Hit.ImpactNormal,UpVector) < -0.1)
+	{
+		return;
+	}
+
+	GroundContactHit = Hit;
+	GroundContactHit.bBlockingHit = true;
+	GroundContactTime = GetWorld()->GetTimeSeconds();
+	GroundContactFrame = GFrameCounter;
+}
+
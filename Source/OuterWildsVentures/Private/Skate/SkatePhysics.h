@@ -3,22 +3,82 @@
 #pragma once
 
 #include "CoreMinimal.h"
+#include "Containers/Queue.h"
 #include "Skaterface.h"
+#include "SkateTrajectory.h"
+#include "WorldCollision.h"
 #include "GameFramework/Actor.h"
 #include "SkatePhysics.generated.h"
 
+class AGrindRail;
 class ASkater;
 UENUM(BlueprintType)
 enum ESkateMode
 {
 	Skate UMETA(DisplayName = "Skate"),
-	Grind UMETA(DisplayName = "Grind")
+	Grind UMETA(DisplayName = "Grind"),
+	Air UMETA(DisplayName = "Air")
+};
+
+class ASkatePhysics;
+
+/**
+ * Post physics stage of skate physics. Runs the grind query against this frame's simulated position.
+ */
+USTRUCT()
+struct FSkatePhysicsPostPhysicsTickFunction : public FTickFunction
+{
+	GENERATED_BODY()
+
+	ASkatePhysics* Target = nullptr;
+
+	virtual void ExecuteTick(float DeltaTime, ELevelTick TickType, ENamedThreads::Type CurrentThread, const FGraphEventRef& MyCompletionGraphEvent) override;
+	virtual FString DiagnosticMessage() override;
+};
+
+template<>
+struct TStructOpsTypeTraits<FSkatePhysicsPostPhysicsTickFunction> : public TStructOpsTypeTraitsBase2<FSkatePhysicsPostPhysicsTickFunction>
+{
+	enum
+	{
+		WithCopy = false
+	};
+};
+
+/**
+ * Force model input sent from the game thread to the async physics tick once per frame.
+ */
+struct FSkateForceInput
+{
+	TEnumAsByte<ESkateMode> SkateMode = Skate;
+
+	// Whether to push into the ground, and the direction to push in
+	bool bStickToGround = false;
+	FVector StickToGroundDirection = FVector::ZeroVector;
+
+	// Lean input this frame. Zero when not leaning.
+	float LeanAxisValue = 0.0f;
+
+	float LeanForce = 0.0f;
+	float MaxVelocity = 0.0f;
+};
+
+/**
+ * Acceleration applied to skate physics over a span of simulated time.
+ */
+struct FSkateTimedAcceleration
+{
+	FVector Acceleration = FVector::ZeroVector;
+	float RemainingSeconds = 0.0f;
 };
 
 UCLASS()
 class ASkatePhysics : public AActor, public ISkaterface
 {
 	GENERATED_BODY()
+
+	// Ticks crowd skate physics in batches
+	friend class USkateCrowdSubsystem;
 	
 public:	
 	// Sets default values for this actor's properties
@@ -28,13 +88,27 @@ protected:
 	// Called when the game starts or when spawned
 	virtual void BeginPlay() override;
 
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
 	UPROPERTY(BlueprintReadOnly)
 	ASkater* SkaterRef;
 
 public:	
-	// Called every frame
+	// Called every frame before physics. Applies the force model and advances grinding.
 	virtual void Tick(float DeltaTime) override;
 
+	// Called every frame after physics, before the skater ticks. Runs grind detection.
+	void PostPhysicsTick(float DeltaTime);
+
+	// Registers the post physics tick along with the primary tick
+	virtual void RegisterActorTickFunctions(bool bRegister) override;
+
+	// Post physics stage. The skater's tick depends on it.
+	FSkatePhysicsPostPhysicsTickFunction PostPhysicsTickFunction;
+
+	// Called on the physics thread every fixed physics step when async physics forces are enabled
+	virtual void AsyncPhysicsTickActor(float DeltaTime, float SimTime) override;
+
 public:
 	// Components
 
@@ -69,6 +143,42 @@ public:
 	UPROPERTY(EditAnywhere, Category="Config")
 	float GrindCooldownTargetSeconds = 1.0f;
 
+	// Grind advances in fixed steps of this length, in seconds
+	UPROPERTY(EditAnywhere, Category="Config", meta=(ClampMin="0.001"))
+	float GrindStepSeconds = 1.0f / 60.0f;
+
+	// Most grind steps taken in one tick. Time beyond that is dropped after a hitch.
+	UPROPERTY(EditAnywhere, Category="Config", meta=(ClampMin="1"))
+	int32 GrindMaxStepsPerTick = 8;
+
+	// Grind actors further than this along velocity are not grabbed
+	UPROPERTY(EditAnywhere, Category="Config")
+	float GrindDetectionReach = 50.0f;
+
+	// How far ahead along the air trajectory to look for a landing, in seconds
+	UPROPERTY(EditAnywhere, Category = "Config")
+	float LandingPredictionHorizon = 5.0f;
+
+	// Duration of the long segments swept along the air trajectory before refining, in seconds
+	UPROPERTY(EditAnywhere, Category = "Config")
+	float LandingPredictionCoarseStep = 0.5f;
+
+	// Landing refinement stops once a traced segment is within this distance of the actual air trajectory
+	UPROPERTY(EditAnywhere, Category = "Config")
+	float LandingPredictionTolerance = 2.0f;
+
+	// A cached landing is solved again once skate physics drifts this far from the predicted air trajectory
+	UPROPERTY(EditAnywhere, Category = "Config")
+	float LandingCacheLocationTolerance = 25.0f;
+
+	// A cached landing is solved again once skate physics velocity differs this much from the predicted air trajectory
+	UPROPERTY(EditAnywhere, Category = "Config")
+	float LandingCacheVelocityTolerance = 50.0f;
+
+	// Half width in seconds of the air trajectory segment traced around a cached landing to re-validate it
+	UPROPERTY(EditAnywhere, Category = "Config")
+	float LandingCacheRevalidationWindow = 0.1f;
+
 public:
 	// Properties
 
@@ -92,6 +202,10 @@ public:
 	UPROPERTY(BlueprintReadWrite, EditDefaultsOnly, Category = "Grind")
 	AActor* GrindActor;
 
+	// Grind actor if it is a native rail, otherwise null
+	UPROPERTY(BlueprintReadOnly, Category = "Grind")
+	AGrindRail* GrindRail;
+
 	// When grinding, whether skate physics is moving along or against the grind actor's spline direction.
 	UPROPERTY(BlueprintReadWrite, EditDefaultsOnly, Category = "Grind")
 	bool bMovingInSplineDirection;
@@ -100,6 +214,18 @@ public:
 	UPROPERTY(BlueprintReadWrite, EditDefaultsOnly, Category = "Grind")
 	bool bGrindInitialSnapHappened;
 
+	// Time not yet consumed by grind steps
+	UPROPERTY(BlueprintReadOnly, Category = "Grind")
+	float GrindStepAccumulator;
+
+	// Distance along grind spline before the last grind step
+	UPROPERTY(BlueprintReadOnly, Category = "Grind")
+	float PreviousGrindDistance;
+
+	// Where the skater is shown while grinding, between the last two grind steps
+	UPROPERTY(BlueprintReadOnly, Category = "Grind")
+	FVector GrindRenderLocation;
+
 	// Direction for pumping on input
 	UPROPERTY(BlueprintReadWrite, EditDefaultsOnly, Category = "Movement")
 	FVector PumpDirection;
@@ -128,10 +254,103 @@ public:
 	UPROPERTY(BlueprintReadWrite, EditDefaultsOnly, Category = "GroundCheck")
 	FVector GroundTraceHitNormal;
 
+	// How far from skate physics' center ground is searched for
+	UPROPERTY(BlueprintReadWrite, EditDefaultsOnly, Category = "GroundCheck")
+	float GroundCheckDistance = 65.0f;
+
+	// Radius of the ground probe sweep. Clamped to stay inside the physics sphere.
+	UPROPERTY(BlueprintReadWrite, EditDefaultsOnly, Category = "GroundCheck")
+	float GroundProbeRadius = 30.0f;
+
+	// Scene queries issued by the last ground condition check
+	UPROPERTY(BlueprintReadOnly, VisibleInstanceOnly, Category = "GroundCheck")
+	int32 GroundProbeQueryCount;
+
+	// Whether the last ground condition check found ground
+	UPROPERTY(BlueprintReadOnly, VisibleInstanceOnly, Category = "GroundCheck")
+	bool bGroundProbeHitLastFrame;
+
+	// Result of the last ground condition check that issued queries. Reused when the ground probe budget is spent.
+	FHitResult LastGroundProbeHit;
+
+	// Last ground contact reported by the physics sphere's hit notifications. Holds contact normal, point and surface.
+	UPROPERTY(BlueprintReadOnly, VisibleInstanceOnly, Category = "GroundCheck")
+	FHitResult GroundContactHit;
+
+	// World time the last ground contact was reported at
+	UPROPERTY(BlueprintReadOnly, VisibleInstanceOnly, Category = "GroundCheck")
+	float GroundContactTime;
+
+	// Frame the last ground contact was reported on. Zero when there is no contact.
+	uint64 GroundContactFrame = 0;
+
+	// Ground contact is kept for these many frames without a new hit notification before ground traces take over
+	UPROPERTY(BlueprintReadWrite, EditDefaultsOnly, Category = "GroundCheck")
+	int32 GroundContactGraceFrames = 3;
+
+	// Moving away from the contact surface faster than this ends ground contact right away
+	UPROPERTY(BlueprintReadWrite, EditDefaultsOnly, Category = "GroundCheck")
+	float GroundContactSeparationSpeed = 100.0f;
+
 	// Tick delta
 	UPROPERTY(BlueprintReadOnly)
 	float TickDelta;
 
+protected:
+	// Async landing prediction. Traces are submitted on one frame and consumed on the next.
+
+	// Handles of the segment traces in flight, in time step order.
+	TArray<FTraceHandle> PendingLandingTraceHandles;
+
+	// Arc time span of each pending segment, in the same order as the handles.
+	TArray<TPair<float, float>> PendingLandingTraceSegments;
+
+	// Air trajectory the pending segments were generated from.
+	FSkateBallisticArc PendingLandingArc;
+
+	// Arc time up to which the pending segments reach. Shorter than the horizon when the query budget cut them off.
+	float PendingLandingSearchedUntil = 0.0f;
+
+	// Frame on which the pending landing traces were submitted.
+	uint64 PendingLandingTraceFrame = 0;
+
+	// Landing cache. While in air, the landing is predicted once and re-validated on following frames.
+
+	// Whether CachedLandingPrediction and CachedLandingArc hold a prediction for the current air state.
+	bool bLandingPredictionCached = false;
+
+	// Cached landing. bHit is false if no landing was found within the horizon.
+	FSkateLandingPrediction CachedLandingPrediction;
+
+	// Air trajectory the cached landing was predicted on.
+	FSkateBallisticArc CachedLandingArc;
+
+	// Arc time up to which the cached air trajectory was searched without finding a landing.
+	float CachedLandingSearchedUntil = 0.0f;
+
+	// Async physics forces. The game thread queues commands, the physics thread applies them every fixed step.
+
+	// Whether the force model runs in the async physics tick. Decided on BeginPlay.
+	bool bAsyncPhysicsForces = false;
+
+	// Lean input received this frame, sent with the next force input
+	float PendingLeanAxisValue = 0.0f;
+
+	// Timed accelerations applied on tick when the force model runs on the game thread
+	TArray<FSkateTimedAcceleration> ActiveAccelerations;
+
+	// Force input commands from the game thread
+	TQueue<FSkateForceInput,EQueueMode::Spsc> ForceInputCommands;
+
+	// Timed acceleration commands from the game thread
+	TQueue<FSkateTimedAcceleration,EQueueMode::Spsc> AccelerationCommands;
+
+	// Latest force input. Physics thread only.
+	FSkateForceInput PhysicsThreadForceInput;
+
+	// Timed accelerations in progress. Physics thread only.
+	TArray<FSkateTimedAcceleration> PhysicsThreadAccelerations;
+
 public:
 	// Functions
 
@@ -147,6 +366,17 @@ public:
 	UFUNCTION(BlueprintCallable, Category = "Movement")
 	void StickToGround();
 
+	// Direction StickToGround pushes in. Returns false if skate physics should not be pushed.
+	bool GetStickToGroundDirection(FVector& OutDirection) const;
+
+	// Accelerate skate physics for a span of simulated time, e.g. for pumping. Runs on the physics thread when async physics forces are enabled.
+	UFUNCTION(BlueprintCallable, Category = "Movement")
+	void AddSkateAcceleration(FVector Acceleration, float Duration);
+
+	// Whether the skate force model runs in the async physics tick
+	UFUNCTION(BlueprintPure, Category = "Movement")
+	bool UsesAsyncPhysicsForces() const;
+
 	// Change skate mode and perform related operations
 	UFUNCTION(BlueprintCallable, Category = "Movement")
 	void ChangeSkateMode(TEnumAsByte<ESkateMode> NewSkateMode);
@@ -155,10 +385,99 @@ public:
 	UFUNCTION(BlueprintCallable, Category = "Grind")
 	void Grind();
 
+	// Advance a grind distance by whole fixed steps. Returns false if a step went past either end of the spline.
+	static bool StepGrindDistance(float DeltaTime, float StepSeconds, int32 MaxSteps, float Speed, float SplineLength,
+		float& InOutAccumulator, float& InOutDistance, float& OutPreviousDistance, bool& bOutStepped);
+
+	// Advance a cooldown tracker while the cooldown is not complete
+	static void StepCooldown(float DeltaTime, float TargetSeconds, float& InOutTracker, bool& bInOutComplete);
+
+	// Signed grind speed along the spline
+	float GetGrindSpeed() const;
+
+	// Snap to the grind spline after grind steps, or abandon the grind if the end of the spline was passed
+	void FinishGrindStep(bool bOnRail, bool bGrindStepped);
+
+	// Skater paired with this skate physics by the skate world subsystem
+	ASkater* GetSkater() const;
+
+	// Called by the skate world subsystem when pairing or unpairing
+	void SetSkater(ASkater* InSkater);
+
+	// Location the skater should be shown at. Interpolated between grind steps while grinding.
+	UFUNCTION(BlueprintPure, Category = "Getter")
+	FVector GetRenderLocation() const;
+
 	// Get skate mode of SkatePhysics.
 	UFUNCTION(Category = "Getter")
 	TEnumAsByte<ESkateMode> GetCurrentSkateMode() const;
 
+	// Whether the physics sphere is touching ground according to its hit notifications.
+	UFUNCTION(BlueprintPure, Category = "GroundCheck")
+	bool HasGroundContact() const;
+
+protected:
+	// Records ground contacts from the physics sphere's hit notifications
+	UFUNCTION()
+	void OnRootSphereHit(UPrimitiveComponent* HitComponent, AActor* OtherActor, UPrimitiveComponent* OtherComp, FVector NormalImpulse, const FHitResult& Hit);
+
+protected:
+	// Grind spline helpers. Native rails are queried directly, other grind actors through IGrindface.
+
+	// Snap point at a distance along the grind spline
+	FVector GetGrindSnapPointAtDistance(float Distance) const;
+
+	// Tangent at a distance along the grind spline
+	FVector GetGrindTangentAtDistance(float Distance) const;
+
+protected:
+	// Async physics force helpers
+
+	// Send this frame's force model input to the physics thread
+	void SendForceInput();
+
+	// Apply timed accelerations on the game thread
+	void ApplyActiveAccelerations();
+
+protected:
+	// Ground check helpers
+
+	// Ground check with a fan of line traces in the XZ and YZ planes of the camera boom.
+	FHitResult ReportGroundConditionRays();
+
+	// Ground check with a sphere sweep towards the last ground, falling back to a sweep straight down.
+	FHitResult ReportGroundConditionSweep();
+
+protected:
+	// Landing prediction helpers
+
+	// Landing solver settings built from config.
+	FSkateTrajectorySolverSettings GetLandingSolverSettings() const;
+
+	// Air trajectory starting at the current location and physics velocity.
+	FSkateBallisticArc GetCurrentAirTrajectory() const;
+
+	// Tell skater to orient for landing on a predicted hit.
+	void OrientSkaterToLanding(const FSkateLandingPrediction& Prediction, const FSkateBallisticArc& Arc) const;
+
+	// Store a landing prediction for reuse on following air frames.
+	void CacheLandingPrediction(const FSkateLandingPrediction& Prediction, const FSkateBallisticArc& Arc, float SearchedUntil);
+
+	// Drop the cached landing so the next prediction solves from scratch.
+	void InvalidateLandingPrediction();
+
+	// Check the cached landing with a single trace. Returns false if it has to be solved again.
+	bool RevalidateCachedLandingPrediction();
+
+	// Solve the landing on the game thread and cache it.
+	void SolveLandingPredictionSync();
+
+	// Consume the coarse segments submitted last frame and refine the first one that hit. Returns true if a batch was consumed.
+	bool ConsumeAsyncLandingPrediction();
+
+	// Submit the coarse segments of the current air trajectory as one async batch.
+	void SubmitAsyncLandingPrediction();
+
 public:
 
 	// Interface Functions
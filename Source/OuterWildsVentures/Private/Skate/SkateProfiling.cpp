@@ -0,0 +1,56 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Skate/SkateProfiling.h"
+
+DEFINE_STAT(STAT_SkateLineTraces);
+DEFINE_STAT(STAT_SkateSweeps);
+DEFINE_STAT(STAT_SkateBlueprintCalls);
+
+bool FSkateProfiling::bEnabled = false;
+uint64 FSkateProfiling::Cycles[static_cast<int32>(ESkateTimer::Num)] = {};
+int32 FSkateProfiling::Calls[static_cast<int32>(ESkateTimer::Num)] = {};
+int32 FSkateProfiling::Queries = 0;
+
+void FSkateProfiling::SetEnabled(bool bInEnabled)
+{
+	bEnabled = bInEnabled;
+	Reset();
+}
+
+void FSkateProfiling::Reset()
+{
+	FMemory::Memzero(Cycles);
+	FMemory::Memzero(Calls);
+	Queries = 0;
+}
+
+void FSkateProfiling::AddTime(ESkateTimer Timer, uint64 InCycles)
+{
+	check(IsInGameThread());
+	Cycles[static_cast<int32>(Timer)] += InCycles;
+	Calls[static_cast<int32>(Timer)]++;
+}
+
+double FSkateProfiling::GetSeconds(ESkateTimer Timer)
+{
+	return FPlatformTime::ToSeconds64(Cycles[static_cast<int32>(Timer)]);
+}
+
+int32 FSkateProfiling::GetCalls(ESkateTimer Timer)
+{
+	return Calls[static_cast<int32>(Timer)];
+}
+
+const TCHAR* FSkateProfiling::GetTimerName(ESkateTimer Timer)
+{
+	switch (Timer)
+	{
+	case ESkateTimer::GroundAdjust: return TEXT("GroundAdjust");
+	case ESkateTimer::ReportGroundCondition: return TEXT("ReportGroundCondition");
+	case ESkateTimer::CheckGrinding: return TEXT("CheckGrinding");
+	case ESkateTimer::Grind: return TEXT("Grind");
+	case ESkateTimer::AirTrajectoryPrediction: return TEXT("AirTrajectoryPrediction");
+	default: return TEXT("Unknown");
+	}
+}
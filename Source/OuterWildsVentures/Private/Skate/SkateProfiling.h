@@ -0,0 +1,96 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Stats/Stats.h"
+
+// stat Skate
+DECLARE_STATS_GROUP(TEXT("Skate"),STATGROUP_Skate,STATCAT_Advanced);
+
+// Per frame counts of work issued by skate code
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Line traces"),STAT_SkateLineTraces,STATGROUP_Skate,);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Sweeps"),STAT_SkateSweeps,STATGROUP_Skate,);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Blueprint calls"),STAT_SkateBlueprintCalls,STATGROUP_Skate,);
+
+// Skate timers compile out of Shipping builds
+#define SKATE_PROFILING !UE_BUILD_SHIPPING
+
+// Skate functions that can be timed. Times include nested timed functions.
+enum class ESkateTimer : uint8
+{
+	GroundAdjust,
+	ReportGroundCondition,
+	CheckGrinding,
+	Grind,
+	AirTrajectoryPrediction,
+
+	Num
+};
+
+/**
+ * Game thread timers and scene query counts for skate functions, read by the skate harness.
+ * Time, calls and queries accumulate until reset. Nothing is counted unless enabled.
+ */
+class FSkateProfiling
+{
+public:
+	static void SetEnabled(bool bInEnabled);
+	static bool IsEnabled() { return bEnabled; }
+
+	// Clear accumulated time and calls
+	static void Reset();
+
+	static void AddTime(ESkateTimer Timer, uint64 Cycles);
+	static double GetSeconds(ESkateTimer Timer);
+	static int32 GetCalls(ESkateTimer Timer);
+	static const TCHAR* GetTimerName(ESkateTimer Timer);
+
+	// Scene queries issued by skate code
+	static void AddQueries(int32 Count) { if (bEnabled) { Queries += Count; } }
+	static int32 GetQueries() { return Queries; }
+
+private:
+	static bool bEnabled;
+	static int32 Queries;
+	static uint64 Cycles[static_cast<int32>(ESkateTimer::Num)];
+	static int32 Calls[static_cast<int32>(ESkateTimer::Num)];
+};
+
+/**
+ * Adds the time spent in a scope to a skate timer.
+ */
+class FSkateScopeTimer
+{
+public:
+	explicit FSkateScopeTimer(ESkateTimer InTimer)
+		: Timer(InTimer)
+		, StartCycles(FSkateProfiling::IsEnabled() ? FPlatformTime::Cycles64() : 0)
+	{
+	}
+
+	~FSkateScopeTimer()
+	{
+		if (StartCycles != 0)
+		{
+			FSkateProfiling::AddTime(Timer,FPlatformTime::Cycles64() - StartCycles);
+		}
+	}
+
+private:
+	ESkateTimer Timer;
+	uint64 StartCycles;
+};
+
+#if SKATE_PROFILING
+#define SKATE_SCOPE_TIMER(Timer) FSkateScopeTimer PREPROCESSOR_JOIN(SkateScopeTimer,__LINE__)(ESkateTimer::Timer)
+#define SKATE_COUNT_QUERIES(Count) FSkateProfiling::AddQueries(Count)
+#else
+#define SKATE_SCOPE_TIMER(Timer)
+#define SKATE_COUNT_QUERIES(Count)
+#endif
+
+// Count scene queries and Blueprint calls for stat Skate and the skate harness
+#define SKATE_COUNT_LINE_TRACES(Count) do { INC_DWORD_STAT_BY(STAT_SkateLineTraces,Count); SKATE_COUNT_QUERIES(Count); } while (0)
+#define SKATE_COUNT_SWEEPS(Count) do { INC_DWORD_STAT_BY(STAT_SkateSweeps,Count); SKATE_COUNT_QUERIES(Count); } while (0)
+#define SKATE_COUNT_BLUEPRINT_CALLS(Count) INC_DWORD_STAT_BY(STAT_SkateBlueprintCalls,Count)
@@ -0,0 +1,237 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Skate/SkateReplay.h"
+
+#include "Skater.h"
+#include "Animation/AnimSingleNodeInstance.h"
+
+namespace SkateReplay
+{
+	void CaptureAnimation(const USkeletalMeshComponent* Mesh, UAnimationAsset*& OutAnimation, float& OutTime)
+	{
+		if (const UAnimSingleNodeInstance* SingleNodeInstance = Mesh ? Mesh->GetSingleNodeInstance() : nullptr)
+		{
+			OutAnimation = SingleNodeInstance->GetAnimationAsset();
+			OutTime = SingleNodeInstance->GetCurrentTime();
+		}
+	}
+
+	bool QuantizeDelta(double Delta, int16& OutQuantized)
+	{
+		const double Quantized = FMath::RoundToDouble(Delta / FSkateReplayCodec::LocationQuantum);
+		if (Quantized < MIN_int16 || Quantized > MAX_int16)
+		{
+			return false;
+		}
+		OutQuantized = static_cast<int16>(Quantized);
+		return true;
+	}
+
+	uint16 QuantizeAnimationTime(float Time)
+	{
+		return static_cast<uint16>(FMath::Clamp(FMath::RoundToInt(Time * 1000.0f),0,MAX_uint16));
+	}
+}
+
+FSkateReplayFrame FSkateReplayFrame::Capture(const ASkater* Skater)
+{
+	FSkateReplayFrame Frame;
+	Frame.Location = Skater->GetActorLocation();
+	Frame.Rotation = Skater->RotationTracker->GetComponentRotation();
+	if (const ASkatePhysics* SkatePhysics = Skater->SkatePhysics)
+	{
+		Frame.SkateMode = SkatePhysics->CurrentSkateMode;
+		Frame.GrindDistance = SkatePhysics->GrindCurrentDistance;
+	}
+	SkateReplay::CaptureAnimation(Skater->MaxMesh,Frame.SkaterAnimation,Frame.SkaterAnimationTime);
+	SkateReplay::CaptureAnimation(Skater->BoardMesh,Frame.BoardAnimation,Frame.BoardAnimationTime);
+	return Frame;
+}
+
+bool FSkateReplayCodec::EncodeDelta(const FSkateReplayFrame& Frame, FSkateReplayPackedFrame& OutPacked)
+{
+	const FVector LocationDelta = Frame.Location - ReconstructedLocation;
+	if (!SkateReplay::QuantizeDelta(LocationDelta.X,OutPacked.LocationDelta[0])
+		|| !SkateReplay::QuantizeDelta(LocationDelta.Y,OutPacked.LocationDelta[1])
+		|| !SkateReplay::QuantizeDelta(LocationDelta.Z,OutPacked.LocationDelta[2])
+		|| !SkateReplay::QuantizeDelta(Frame.GrindDistance - ReconstructedGrindDistance,OutPacked.GrindDistanceDelta))
+	{
+		return false;
+	}
+
+	EncodeCommon(Frame,OutPacked);
+	OutPacked.Flags = 0;
+
+	// Track what the decoder will see, not the exact values
+	ReconstructedLocation += FVector(OutPacked.LocationDelta[0],OutPacked.LocationDelta[1],OutPacked.LocationDelta[2]) * LocationQuantum;
+	ReconstructedGrindDistance += OutPacked.GrindDistanceDelta * LocationQuantum;
+	return true;
+}
+
+void FSkateReplayCodec::EncodeKeyframe(const FSkateReplayFrame& Frame, uint64 FrameNumber, FSkateReplayPackedFrame& OutPacked, FSkateReplayKeyframe& OutKeyframe)
+{
+	EncodeCommon(Frame,OutPacked);
+	OutPacked.LocationDelta[0] = OutPacked.LocationDelta[1] = OutPacked.LocationDelta[2] = 0;
+	OutPacked.GrindDistanceDelta = 0;
+	OutPacked.Flags = FSkateReplayPackedFrame::Keyframe;
+
+	OutKeyframe.FrameNumber = FrameNumber;
+	OutKeyframe.Location = Frame.Location;
+	OutKeyframe.GrindDistance = Frame.GrindDistance;
+
+	ReconstructedLocation = Frame.Location;
+	ReconstructedGrindDistance = Frame.GrindDistance;
+}
+
+void FSkateReplayCodec::Decode(const FSkateReplayPackedFrame& Packed, const FSkateReplayKeyframe* Keyframe, FSkateReplayFrame& OutFrame)
+{
+	if ((Packed.Flags & FSkateReplayPackedFrame::Keyframe) && Keyframe)
+	{
+		ReconstructedLocation = Keyframe->Location;
+		ReconstructedGrindDistance = Keyframe->GrindDistance;
+	}
+	else
+	{
+		ReconstructedLocation += FVector(Packed.LocationDelta[0],Packed.LocationDelta[1],Packed.LocationDelta[2]) * LocationQuantum;
+		ReconstructedGrindDistance += Packed.GrindDistanceDelta * LocationQuantum;
+	}
+
+	OutFrame.Location = ReconstructedLocation;
+	OutFrame.GrindDistance = ReconstructedGrindDistance;
+	OutFrame.Rotation = FRotator(
+		FRotator::DecompressAxisFromShort(Packed.Rotation[0]),
+		FRotator::DecompressAxisFromShort(Packed.Rotation[1]),
+		FRotator::DecompressAxisFromShort(Packed.Rotation[2]));
+	OutFrame.SkateMode = static_cast<ESkateMode>(Packed.SkateMode);
+	OutFrame.SkaterAnimation = Animations.IsValidIndex(Packed.SkaterAnimation) ? Animations[Packed.SkaterAnimation].Get() : nullptr;
+	OutFrame.SkaterAnimationTime = Packed.SkaterAnimationTime / 1000.0f;
+	OutFrame.BoardAnimation = Animations.IsValidIndex(Packed.BoardAnimation) ? Animations[Packed.BoardAnimation].Get() : nullptr;
+	OutFrame.BoardAnimationTime = Packed.BoardAnimationTime / 1000.0f;
+}
+
+void FSkateReplayCodec::EncodeCommon(const FSkateReplayFrame& Frame, FSkateReplayPackedFrame& OutPacked)
+{
+	OutPacked.Rotation[0] = FRotator::CompressAxisToShort(Frame.Rotation.Pitch);
+	OutPacked.Rotation[1] = FRotator::CompressAxisToShort(Frame.Rotation.Yaw);
+	OutPacked.Rotation[2] = FRotator::CompressAxisToShort(Frame.Rotation.Roll);
+	OutPacked.SkateMode = static_cast<uint8>(Frame.SkateMode.GetValue());
+	OutPacked.SkaterAnimation = GetAnimationIndex(Frame.SkaterAnimation);
+	OutPacked.SkaterAnimationTime = SkateReplay::QuantizeAnimationTime(Frame.SkaterAnimationTime);
+	OutPacked.BoardAnimation = GetAnimationIndex(Frame.BoardAnimation);
+	OutPacked.BoardAnimationTime = SkateReplay::QuantizeAnimationTime(Frame.BoardAnimationTime);
+}
+
+uint8 FSkateReplayCodec::GetAnimationIndex(UAnimationAsset* Animation)
+{
+	if (!Animation)
+	{
+		return NoAnimation;
+	}
+
+	const int32 Index = Animations.IndexOfByKey(Animation);
+	if (Index != INDEX_NONE)
+	{
+		return static_cast<uint8>(Index);
+	}
+
+	// The table has a fixed size. Animations past it are not replayed.
+	if (Animations.Num() == MaxAnimations)
+	{
+		return NoAnimation;
+	}
+	return static_cast<uint8>(Animations.Add(Animation));
+}
+
+void FSkateReplayBuffer::Init(int32 FrameCapacity, int32 InKeyframeInterval)
+{
+	KeyframeInterval = FMath::Max(1,InKeyframeInterval);
+
+	// Keyframes are due every interval, plus room for keyframes forced by deltas too large to pack.
+	Frames.SetNumZeroed(FMath::Max(1,FrameCapacity));
+	Keyframes.SetNumZeroed(Frames.Num() / KeyframeInterval + 16);
+
+	Reset();
+}
+
+void FSkateReplayBuffer::Reset()
+{
+	Codec = FSkateReplayCodec();
+	FrameCount = 0;
+	KeyframeCount = 0;
+	FramesSinceKeyframe = 0;
+}
+
+void FSkateReplayBuffer::RecordFrame(const FSkateReplayFrame& Frame)
+{
+	if (Frames.Num() == 0)
+	{
+		return;
+	}
+
+	FSkateReplayPackedFrame& Packed = Frames[FrameCount % Frames.Num()];
+	const bool bKeyframeDue = FrameCount == 0 || FramesSinceKeyframe >= KeyframeInterval;
+	if (bKeyframeDue || !Codec.EncodeDelta(Frame,Packed))
+	{
+		Codec.EncodeKeyframe(Frame,FrameCount,Packed,Keyframes[KeyframeCount % Keyframes.Num()]);
+		KeyframeCount++;
+		FramesSinceKeyframe = 0;
+	}
+
+	FramesSinceKeyframe++;
+	FrameCount++;
+}
+
+int32 FSkateReplayBuffer::GetPlayableFrameCount() const
+{
+	const uint64 FirstKeyframeNumber = GetFirstPlayableKeyframeNumber();
+	if (FirstKeyframeNumber >= KeyframeCount)
+	{
+		return 0;
+	}
+	return static_cast<int32>(FrameCount - Keyframes[FirstKeyframeNumber % Keyframes.Num()].FrameNumber);
+}
+
+SIZE_T FSkateReplayBuffer::GetAllocatedSize() const
+{
+	return Frames.GetAllocatedSize() + Keyframes.GetAllocatedSize();
+}
+
+uint64 FSkateReplayBuffer::GetFirstPlayableKeyframeNumber() const
+{
+	const uint64 OldestFrameNumber = FrameCount - FMath::Min<uint64>(FrameCount,Frames.Num());
+	uint64 KeyframeNumber = KeyframeCount - FMath::Min<uint64>(KeyframeCount,Keyframes.Num());
+	while (KeyframeNumber < KeyframeCount && Keyframes[KeyframeNumber % Keyframes.Num()].FrameNumber < OldestFrameNumber)
+	{
+		KeyframeNumber++;
+	}
+	return KeyframeNumber;
+}
+
+FSkateReplayBuffer::FReader::FReader(const FSkateReplayBuffer& InBuffer)
+	: Buffer(InBuffer)
+{
+	Codec.Animations = Buffer.Codec.Animations;
+	NextKeyframeNumber = Buffer.GetFirstPlayableKeyframeNumber();
+	NextFrameNumber = NextKeyframeNumber < Buffer.KeyframeCount ? Buffer.Keyframes[NextKeyframeNumber % Buffer.Keyframes.Num()].FrameNumber : Buffer.FrameCount;
+}
+
+bool FSkateReplayBuffer::FReader::ReadFrame(FSkateReplayFrame& OutFrame)
+{
+	if (NextFrameNumber >= Buffer.FrameCount)
+	{
+		return false;
+	}
+
+	const FSkateReplayPackedFrame& Packed = Buffer.Frames[NextFrameNumber % Buffer.Frames.Num()];
+	const FSkateReplayKeyframe* Keyframe = nullptr;
+	if (Packed.Flags & FSkateReplayPackedFrame::Keyframe)
+	{
+		Keyframe = &Buffer.Keyframes[NextKeyframeNumber % Buffer.Keyframes.Num()];
+		NextKeyframeNumber++;
+	}
+
+	Codec.Decode(Packed,Keyframe,OutFrame);
+	NextFrameNumber++;
+	return true;
+}
@@ -0,0 +1,187 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "SkatePhysics.h"
+
+class ASkater;
+class UAnimationAsset;
+
+/**
+ * Skater state at one replay step, at full precision.
+ */
+struct FSkateReplayFrame
+{
+	// Skater location
+	FVector Location = FVector::ZeroVector;
+
+	// Rotation tracker orientation
+	FRotator Rotation = FRotator::ZeroRotator;
+
+	TEnumAsByte<ESkateMode> SkateMode = Skate;
+
+	// Distance along grind spline. Only meaningful while grinding.
+	float GrindDistance = 0.0f;
+
+	// Animations playing on the skater and board meshes, and their play positions
+	UAnimationAsset* SkaterAnimation = nullptr;
+	float SkaterAnimationTime = 0.0f;
+	UAnimationAsset* BoardAnimation = nullptr;
+	float BoardAnimationTime = 0.0f;
+
+	// Read the state of a skater and its skate physics
+	static FSkateReplayFrame Capture(const ASkater* Skater);
+};
+
+/**
+ * Anything replay frames can be read from in order.
+ */
+class FSkateReplayFrameSource
+{
+public:
+	virtual ~FSkateReplayFrameSource() = default;
+
+	// Read the next frame. Returns false at the end.
+	virtual bool ReadFrame(FSkateReplayFrame& OutFrame) = 0;
+};
+
+/**
+ * Replay frame packed to 22 bytes. Location and grind distance are deltas from the previous frame, unless the frame
+ * is a keyframe, in which case they are taken from the keyframe.
+ */
+struct FSkateReplayPackedFrame
+{
+	// Location delta in units of LocationQuantum
+	int16 LocationDelta[3];
+
+	// Rotation axes compressed with FRotator::CompressAxisToShort
+	uint16 Rotation[3];
+
+	// Grind distance delta in units of LocationQuantum
+	int16 GrindDistanceDelta;
+
+	uint8 SkateMode;
+
+	// Animation table indices, or 0xFF for none
+	uint8 SkaterAnimation;
+	uint8 BoardAnimation;
+
+	// EFlags
+	uint8 Flags;
+
+	// Animation play positions in milliseconds
+	uint16 SkaterAnimationTime;
+	uint16 BoardAnimationTime;
+
+	enum EFlags : uint8
+	{
+		Keyframe = 1 << 0
+	};
+};
+
+/**
+ * Full precision values a run of delta frames starts from.
+ */
+struct FSkateReplayKeyframe
+{
+	uint64 FrameNumber = 0;
+	FVector Location = FVector::ZeroVector;
+	float GrindDistance = 0.0f;
+};
+
+/**
+ * Quantization and delta coding shared by replay storage. Encoder and decoder both track the reconstructed values,
+ * so quantization error never accumulates.
+ */
+struct FSkateReplayCodec
+{
+	// Location and grind distance resolution in cm. A delta holds up to 32767 quanta, i.e. ~33m per step.
+	static constexpr float LocationQuantum = 0.1f;
+
+	static constexpr uint8 NoAnimation = 0xFF;
+
+	// Maximum distinct animations a replay can reference
+	static constexpr int32 MaxAnimations = 32;
+
+	// Values the last coded frame decodes to
+	FVector ReconstructedLocation = FVector::ZeroVector;
+	float ReconstructedGrindDistance = 0.0f;
+
+	// Animations referenced by packed frames
+	TArray<TWeakObjectPtr<UAnimationAsset>,TFixedAllocator<MaxAnimations>> Animations;
+
+	// Pack a frame. Returns false if the frame cannot be delta coded and has to be written as a keyframe instead.
+	bool EncodeDelta(const FSkateReplayFrame& Frame, FSkateReplayPackedFrame& OutPacked);
+
+	// Pack a frame as a keyframe. Location and grind distance go to the keyframe.
+	void EncodeKeyframe(const FSkateReplayFrame& Frame, uint64 FrameNumber, FSkateReplayPackedFrame& OutPacked, FSkateReplayKeyframe& OutKeyframe);
+
+	// Unpack a frame. Keyframe must be given for keyframes and is ignored otherwise.
+	void Decode(const FSkateReplayPackedFrame& Packed, const FSkateReplayKeyframe* Keyframe, FSkateReplayFrame& OutFrame);
+
+protected:
+	// Pack the parts of a frame that are not delta coded
+	void EncodeCommon(const FSkateReplayFrame& Frame, FSkateReplayPackedFrame& OutPacked);
+
+	// Index of an animation in the table, adding it if there is room
+	uint8 GetAnimationIndex(UAnimationAsset* Animation);
+};
+
+/**
+ * Fixed size ring buffer of packed replay frames. All memory is allocated by Init, recording never allocates.
+ * The oldest frames are overwritten, and playback always starts on the oldest keyframe still held.
+ */
+class FSkateReplayBuffer
+{
+public:
+	// Allocate room for FrameCapacity frames with a keyframe at least every KeyframeInterval frames
+	void Init(int32 FrameCapacity, int32 KeyframeInterval);
+
+	// Drop all recorded frames, keeping the allocation
+	void Reset();
+
+	// Append a frame, overwriting the oldest one if full
+	void RecordFrame(const FSkateReplayFrame& Frame);
+
+	// Number of frames playback can go through
+	int32 GetPlayableFrameCount() const;
+
+	// Bytes held by the buffer
+	SIZE_T GetAllocatedSize() const;
+
+	/**
+	 * Reads a buffer front to back. The buffer must not be recorded into while being read.
+	 */
+	class FReader : public FSkateReplayFrameSource
+	{
+	public:
+		explicit FReader(const FSkateReplayBuffer& InBuffer);
+
+		// Read the next frame. Returns false at the end of the buffer.
+		virtual bool ReadFrame(FSkateReplayFrame& OutFrame) override;
+
+	protected:
+		const FSkateReplayBuffer& Buffer;
+		FSkateReplayCodec Codec;
+		uint64 NextFrameNumber = 0;
+		uint64 NextKeyframeNumber = 0;
+	};
+
+protected:
+	// Keyframe playback starts on. Equals KeyframeCount if nothing is playable.
+	uint64 GetFirstPlayableKeyframeNumber() const;
+
+	TArray<FSkateReplayPackedFrame> Frames;
+	TArray<FSkateReplayKeyframe> Keyframes;
+	FSkateReplayCodec Codec;
+
+	int32 KeyframeInterval = 60;
+
+	// Total frames and keyframes ever recorded. Ring positions are these modulo capacity.
+	uint64 FrameCount = 0;
+	uint64 KeyframeCount = 0;
+
+	// Frames since the last keyframe
+	int32 FramesSinceKeyframe = 0;
+};
@@ -0,0 +1,130 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Skate/SkateReplayPawn.h"
+
+#include "SkateGhost.h"
+#include "Skater.h"
+#include "Animation/AnimSingleNodeInstance.h"
+
+// Sets default values
+ASkateReplayPawn::ASkateReplayPawn()
+{
+	PrimaryActorTick.bCanEverTick = true;
+
+	Root = CreateDefaultSubobject<USceneComponent>("Root");
+	MaxMesh = CreateDefaultSubobject<USkeletalMeshComponent>("Max");
+	BoardMesh = CreateDefaultSubobject<USkeletalMeshComponent>("Board");
+
+	RootComponent = Root;
+	MaxMesh->SetupAttachment(Root);
+	BoardMesh->SetupAttachment(MaxMesh);
+
+	// Playback only, nothing to collide with
+	MaxMesh->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+	BoardMesh->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+}
+
+void ASkateReplayPawn::StartReplay(const ASkater* Skater, const FSkateReplayBuffer& ReplayBuffer, float StepSeconds)
+{
+	CopySkaterLook(Skater);
+	PlaybackBuffer = ReplayBuffer;
+	StartPlayback(MakeUnique<FSkateReplayBuffer::FReader>(PlaybackBuffer),StepSeconds);
+}
+
+bool ASkateReplayPawn::StartGhost(const ASkater* Skater, const FString& GhostFilePath)
+{
+	TUniquePtr<FSkateGhostReader> GhostReader = MakeUnique<FSkateGhostReader>();
+	if (!GhostReader->Open(GhostFilePath))
+	{
+		Destroy();
+		return false;
+	}
+
+	CopySkaterLook(Skater);
+	const float StepSeconds = GhostReader->GetStepSeconds();
+	StartPlayback(MoveTemp(GhostReader),StepSeconds);
+	return true;
+}
+
+void ASkateReplayPawn::CopySkaterLook(const ASkater* Skater)
+{
+	MaxMesh->SetSkeletalMesh(Skater->MaxMesh->GetSkeletalMeshAsset());
+	MaxMesh->SetRelativeTransform(Skater->MaxMesh->GetRelativeTransform());
+	BoardMesh->SetSkeletalMesh(Skater->BoardMesh->GetSkeletalMeshAsset());
+	BoardMesh->SetRelativeTransform(Skater->BoardMesh->GetRelativeTransform());
+	MaxMesh->SetAnimationMode(EAnimationMode::AnimationSingleNode);
+	BoardMesh->SetAnimationMode(EAnimationMode::AnimationSingleNode);
+}
+
+void ASkateReplayPawn::StartPlayback(TUniquePtr<FSkateReplayFrameSource> Source, float StepSeconds)
+{
+	PlaybackSource = MoveTemp(Source);
+	PlaybackStepSeconds = FMath::Max(StepSeconds,KINDA_SMALL_NUMBER);
+	PlaybackStepAccumulator = 0.0f;
+
+	if (!PlaybackSource->ReadFrame(PreviousFrame))
+	{
+		PlaybackSource.Reset();
+		Destroy();
+		return;
+	}
+	NextFrame = PreviousFrame;
+	PlaybackSource->ReadFrame(NextFrame);
+	ApplyFrame(PreviousFrame,NextFrame,0.0f);
+}
+
+void ASkateReplayPawn::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+
+	if (!PlaybackSource)
+	{
+		return;
+	}
+
+	PlaybackStepAccumulator += DeltaTime;
+	while (PlaybackStepAccumulator >= PlaybackStepSeconds)
+	{
+		PlaybackStepAccumulator -= PlaybackStepSeconds;
+		PreviousFrame = NextFrame;
+		if (!PlaybackSource->ReadFrame(NextFrame))
+		{
+			// Playback over
+			PlaybackSource.Reset();
+			Destroy();
+			return;
+		}
+	}
+
+	ApplyFrame(PreviousFrame,NextFrame,PlaybackStepAccumulator / PlaybackStepSeconds);
+}
+
+void ASkateReplayPawn::ApplyFrame(const FSkateReplayFrame& From, const FSkateReplayFrame& To, float Alpha)
+{
+	SetActorLocation(FMath::Lerp(From.Location,To.Location,Alpha));
+	MaxMesh->SetWorldRotation(FQuat::Slerp(From.Rotation.Quaternion(),To.Rotation.Quaternion(),Alpha));
+
+	// Animations snap to the earlier step. Play positions are interpolated when both steps play the same animation.
+	const bool bSameSkaterAnimation = From.SkaterAnimation == To.SkaterAnimation && To.SkaterAnimationTime >= From.SkaterAnimationTime;
+	ApplyAnimation(MaxMesh,From.SkaterAnimation,bSameSkaterAnimation ? FMath::Lerp(From.SkaterAnimationTime,To.SkaterAnimationTime,Alpha) : From.SkaterAnimationTime);
+	const bool bSameBoardAnimation = From.BoardAnimation == To.BoardAnimation && To.BoardAnimationTime >= From.BoardAnimationTime;
+	ApplyAnimation(BoardMesh,From.BoardAnimation,bSameBoardAnimation ? FMath::Lerp(From.BoardAnimationTime,To.BoardAnimationTime,Alpha) : From.BoardAnimationTime);
+}
+
+void ASkateReplayPawn::ApplyAnimation(USkeletalMeshComponent* Mesh, UAnimationAsset* Animation, float Time)
+{
+	if (!Animation)
+	{
+		return;
+	}
+
+	if (Mesh->GetSingleNodeInstance() == nullptr || Mesh->GetSingleNodeInstance()->GetAnimationAsset() != Animation)
+	{
+		Mesh->PlayAnimation(Animation,false);
+	}
+
+	// Position is driven by the replay, not by the animation playing
+	Mesh->Stop();
+	Mesh->SetPosition(Time,false);
+}
@@ -0,0 +1,76 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "SkateReplay.h"
+#include "GameFramework/Pawn.h"
+#include "SkateReplayPawn.generated.h"
+
+class ASkater;
+
+/**
+ * Non simulating stand-in that plays back a skater's replay buffer or a ghost run file. Destroys itself when playback ends.
+ */
+UCLASS()
+class ASkateReplayPawn : public APawn
+{
+	GENERATED_BODY()
+
+public:
+	// Sets default values for this pawn's properties
+	ASkateReplayPawn();
+
+	// Called every frame
+	virtual void Tick(float DeltaTime) override;
+
+public:
+	// Components
+
+	// Character mesh
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Components")
+	USkeletalMeshComponent* MaxMesh;
+
+	// Board mesh
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Components")
+	USkeletalMeshComponent* BoardMesh;
+
+	// Scene root
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Components")
+	USceneComponent* Root;
+
+public:
+	// Functions
+
+	// Play back a copy of a skater's replay buffer, looking like that skater
+	void StartReplay(const ASkater* Skater, const FSkateReplayBuffer& ReplayBuffer, float StepSeconds);
+
+	// Play back a ghost run file, looking like a skater. Returns false if the file cannot be read.
+	bool StartGhost(const ASkater* Skater, const FString& GhostFilePath);
+
+protected:
+	// Take the meshes of the skater being played back
+	void CopySkaterLook(const ASkater* Skater);
+
+	// Start reading frames from a source
+	void StartPlayback(TUniquePtr<FSkateReplayFrameSource> Source, float StepSeconds);
+
+	// Show a frame between two replay steps
+	void ApplyFrame(const FSkateReplayFrame& From, const FSkateReplayFrame& To, float Alpha);
+
+	// Play a recorded animation on a mesh
+	static void ApplyAnimation(USkeletalMeshComponent* Mesh, UAnimationAsset* Animation, float Time);
+
+	// Replay frames being played, copied so the skater can keep recording
+	FSkateReplayBuffer PlaybackBuffer;
+
+	// Where frames are read from
+	TUniquePtr<FSkateReplayFrameSource> PlaybackSource;
+
+	// Replay steps being shown between
+	FSkateReplayFrame PreviousFrame;
+	FSkateReplayFrame NextFrame;
+
+	float PlaybackStepSeconds = 1.0f / 60.0f;
+	float PlaybackStepAccumulator = 0.0f;
+};
@@ -0,0 +1,158 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Skate/SkateTrajectory.h"
+
+#include "SkateProfiling.h"
+#include "Engine/World.h"
+#include "Query/QueryBudgetSubsystem.h"
+
+DECLARE_CYCLE_STAT(TEXT("Landing Solve"),STAT_SkateLandingSolve,STATGROUP_Skate);
+DECLARE_CYCLE_STAT(TEXT("Landing RefineSegment"),STAT_SkateLandingRefineSegment,STATGROUP_Skate);
+
+bool FSkateTrajectorySolver::Solve(const UWorld* World, const FSkateBallisticArc& Arc, const FSkateTrajectorySolverSettings& Settings,
+	const FCollisionQueryParams& QueryParams, FSkateLandingPrediction& OutPrediction)
+{
+	SCOPE_CYCLE_COUNTER(STAT_SkateLandingSolve);
+
+	OutPrediction = FSkateLandingPrediction();
+
+	if (!World || Settings.CoarseStep <= 0.0f)
+	{
+		return false;
+	}
+
+	// Phase 1: walk the arc in long chords until one of them hits.
+	for (float SegmentStartTime = Settings.StartTime; SegmentStartTime < Settings.Horizon; SegmentStartTime += Settings.CoarseStep)
+	{
+		const float SegmentEndTime = FMath::Min(SegmentStartTime + Settings.CoarseStep, Settings.Horizon);
+
+		FHitResult SegmentHit;
+		if (!TraceChord(World,Arc,Settings,QueryParams,SegmentStartTime,SegmentEndTime,SegmentHit,OutPrediction.QueryCount))
+		{
+			continue;
+		}
+
+		// Phase 2: bisect the segment that hit. A parabola falling under gravity bulges above its chords, so a chord can
+		// clip an edge the arc clears. In that case keep walking.
+		if (RefineSegment(World,Arc,Settings,QueryParams,SegmentStartTime,SegmentEndTime,SegmentHit,OutPrediction))
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool FSkateTrajectorySolver::RefineSegment(const UWorld* World, const FSkateBallisticArc& Arc, const FSkateTrajectorySolverSettings& Settings,
+	const FCollisionQueryParams& QueryParams, float SegmentStartTime, float SegmentEndTime, const FHitResult& SegmentHit,
+	FSkateLandingPrediction& OutPrediction)
+{
+	SCOPE_CYCLE_COUNTER(STAT_SkateLandingRefineSegment);
+
+	float LowTime = SegmentStartTime;
+	float HighTime = SegmentEndTime;
+
+	FHitResult BestHit = SegmentHit;
+
+	// Whether BestHit was traced on the current [LowTime, HighTime] chord
+	bool bBestHitOnCurrentChord = true;
+
+	while (GetChordSagitta(Arc,HighTime - LowTime) > Settings.Tolerance)
+	{
+		const float MidTime = 0.5f*(LowTime + HighTime);
+
+		FHitResult HalfHit;
+		if (TraceChord(World,Arc,Settings,QueryParams,LowTime,MidTime,HalfHit,OutPrediction.QueryCount))
+		{
+			HighTime = MidTime;
+			BestHit = HalfHit;
+			bBestHitOnCurrentChord = true;
+		}
+		else
+		{
+			// The first half is clear, so the landing can only be in the second half. It is only traced once refinement ends.
+			LowTime = MidTime;
+			bBestHitOnCurrentChord = false;
+		}
+	}
+
+	if (!bBestHitOnCurrentChord)
+	{
+		FHitResult FinalHit;
+		if (!TraceChord(World,Arc,Settings,QueryParams,LowTime,HighTime,FinalHit,OutPrediction.QueryCount))
+		{
+			return false;
+		}
+		BestHit = FinalHit;
+	}
+
+	SetPredictionFromChordHit(Arc,LowTime,HighTime,BestHit,OutPrediction);
+
+	return true;
+}
+
+bool FSkateTrajectorySolver::TraceChord(const UWorld* World, const FSkateBallisticArc& Arc, const FSkateTrajectorySolverSettings& Settings,
+	const FCollisionQueryParams& QueryParams, float StartTime, float EndTime, FHitResult& OutHit, int32& InOutQueryCount)
+{
+	const FVector TraceStart = Arc.GetLocationAtTime(StartTime);
+	const FVector TraceEnd = Arc.GetLocationAtTime(EndTime);
+
+	// Only issued queries are counted
+	if (UQueryBudgetSubsystem::GetRemainingBudget(World,EQueryDebugCategory::SkateLanding,Settings.QueryRequester) <= 0)
+	{
+		OutHit = FHitResult(1.0f);
+		return false;
+	}
+
+	InOutQueryCount++;
+	SKATE_COUNT_LINE_TRACES(1);
+	return UQueryBudgetSubsystem::LineTraceSingle(World,EQueryDebugCategory::SkateLanding,Settings.QueryRequester,OutHit,TraceStart,TraceEnd,Settings.TraceChannel,QueryParams) && OutHit.bBlockingHit;
+}
+
+void FSkateTrajectorySolver::SetPredictionFromChordHit(const FSkateBallisticArc& Arc, float StartTime, float EndTime, const FHitResult& ChordHit,
+	FSkateLandingPrediction& OutPrediction)
+{
+	const float ArcTimeToHit = FMath::Lerp(StartTime,EndTime,ChordHit.Time);
+
+	OutPrediction.bHit = true;
+	OutPrediction.Location = ChordHit.ImpactPoint;
+	OutPrediction.Normal = ChordHit.Normal;
+	OutPrediction.VelocityAtHit = Arc.GetVelocityAtTime(ArcTimeToHit);
+	OutPrediction.ArcTimeToHit = ArcTimeToHit;
+	OutPrediction.HitResult = ChordHit;
+}
+
+void FSkateTrajectorySolver::FitToQueryBudget(FSkateTrajectorySolverSettings& Settings, int32 QueryBudget)
+{
+	// Keep enough queries back to refine a hit
+	const int32 CoarseBudget = QueryBudget - RefineQueryReserve;
+	if (CoarseBudget <= 0 || Settings.CoarseStep <= 0.0f)
+	{
+		Settings.Horizon = Settings.StartTime;
+		return;
+	}
+
+	Settings.Horizon = FMath::Min(Settings.Horizon,Settings.StartTime + static_cast<float>(CoarseBudget)*Settings.CoarseStep);
+}
+
+void FSkateTrajectorySolver::GetCoarseSegments(const FSkateTrajectorySolverSettings& Settings, TArray<TPair<float, float>>& OutSegments)
+{
+	OutSegments.Reset();
+
+	if (Settings.CoarseStep <= 0.0f)
+	{
+		return;
+	}
+
+	for (float SegmentStartTime = Settings.StartTime; SegmentStartTime < Settings.Horizon; SegmentStartTime += Settings.CoarseStep)
+	{
+		OutSegments.Emplace(SegmentStartTime,FMath::Min(SegmentStartTime + Settings.CoarseStep, Settings.Horizon));
+	}
+}
+
+float FSkateTrajectorySolver::GetChordSagitta(const FSkateBallisticArc& Arc, float Duration)
+{
+	// Distance between the arc and its chord peaks at the middle of the segment and is 1/8 * |a| * t^2.
+	return 0.125f*Arc.Gravity.Length()*Duration*Duration;
+}
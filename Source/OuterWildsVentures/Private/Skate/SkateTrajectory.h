@@ -0,0 +1,145 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/EngineTypes.h"
+#include "Engine/HitResult.h"
+#include "SkateTrajectory.generated.h"
+
+struct FCollisionQueryParams;
+
+/**
+ * Ballistic arc followed by skate physics while in air. Position and velocity are evaluated in arc time, which is
+ * seconds since the arc was sampled.
+ */
+struct FSkateBallisticArc
+{
+	// Location where the arc was sampled
+	FVector Origin = FVector::ZeroVector;
+
+	// Velocity when the arc was sampled
+	FVector Velocity = FVector::ZeroVector;
+
+	// Gravitational acceleration acting on the arc
+	FVector Gravity = FVector{0.0,0.0,-980.0};
+
+	// World time in seconds when the arc was sampled
+	double StartWorldTime = 0.0;
+
+	FSkateBallisticArc() = default;
+
+	FSkateBallisticArc(const FVector& InOrigin, const FVector& InVelocity, double InStartWorldTime)
+		: Origin(InOrigin), Velocity(InVelocity), StartWorldTime(InStartWorldTime)
+	{
+	}
+
+	// s = (u * t) + (1/2 * a * t^2)
+	FVector GetLocationAtTime(float ArcTime) const
+	{
+		return Origin + Velocity*ArcTime + 0.5*Gravity*ArcTime*ArcTime;
+	}
+
+	// v = u + (a * t)
+	FVector GetVelocityAtTime(float ArcTime) const
+	{
+		return Velocity + Gravity*ArcTime;
+	}
+};
+
+/**
+ * Predicted landing on an air trajectory.
+ */
+USTRUCT(BlueprintType)
+struct FSkateLandingPrediction
+{
+	GENERATED_BODY()
+
+	// Whether a landing was found within the prediction horizon
+	UPROPERTY(BlueprintReadOnly)
+	bool bHit = false;
+
+	// Predicted landing point
+	UPROPERTY(BlueprintReadOnly)
+	FVector Location = FVector::ZeroVector;
+
+	// Surface normal at the predicted landing point
+	UPROPERTY(BlueprintReadOnly)
+	FVector Normal = FVector::UpVector;
+
+	// Predicted velocity just before landing
+	UPROPERTY(BlueprintReadOnly)
+	FVector VelocityAtHit = FVector::ZeroVector;
+
+	// Arc time at which the landing happens
+	UPROPERTY(BlueprintReadOnly)
+	float ArcTimeToHit = 0.0f;
+
+	// Hit that produced the prediction
+	UPROPERTY(BlueprintReadOnly)
+	FHitResult HitResult;
+
+	// Number of scene queries the solver issued
+	UPROPERTY(BlueprintReadOnly)
+	int32 QueryCount = 0;
+};
+
+/**
+ * Settings for the landing solver.
+ */
+struct FSkateTrajectorySolverSettings
+{
+	// Arc time the search starts at. Slightly negative so that a landing that is already very close is not missed.
+	float StartTime = -0.1f;
+
+	// How far along the arc to look for a landing, in seconds
+	float Horizon = 5.0f;
+
+	// Duration of a coarse sweep segment in seconds
+	float CoarseStep = 0.5f;
+
+	// Refinement stops once a segment's chord deviates from the arc by less than this many units
+	float Tolerance = 2.0f;
+
+	// Trace channel for landing surfaces
+	ECollisionChannel TraceChannel = ECC_Visibility;
+
+	// Requester the query budget shares landing queries by
+	const UObject* QueryRequester = nullptr;
+};
+
+/**
+ * Two phase landing search along a ballistic arc. Long chords are traced along the arc first and the first chord
+ * that hits is then bisected until the chord is within tolerance of the arc.
+ */
+struct FSkateTrajectorySolver
+{
+	// Find the first landing along the arc. Returns false if nothing is hit within the horizon.
+	static bool Solve(const UWorld* World, const FSkateBallisticArc& Arc, const FSkateTrajectorySolverSettings& Settings,
+		const FCollisionQueryParams& QueryParams, FSkateLandingPrediction& OutPrediction);
+
+	// Bisect a segment whose chord has already hit. Returns false if the arc itself passes over the hit.
+	static bool RefineSegment(const UWorld* World, const FSkateBallisticArc& Arc, const FSkateTrajectorySolverSettings& Settings,
+		const FCollisionQueryParams& QueryParams, float SegmentStartTime, float SegmentEndTime, const FHitResult& SegmentHit,
+		FSkateLandingPrediction& OutPrediction);
+
+	// Trace the chord of the arc between two arc times. Returns true on a blocking hit.
+	static bool TraceChord(const UWorld* World, const FSkateBallisticArc& Arc, const FSkateTrajectorySolverSettings& Settings,
+		const FCollisionQueryParams& QueryParams, float StartTime, float EndTime, FHitResult& OutHit, int32& InOutQueryCount);
+
+	// Fill a prediction from a hit on the chord between two arc times.
+	static void SetPredictionFromChordHit(const FSkateBallisticArc& Arc, float StartTime, float EndTime, const FHitResult& ChordHit,
+		FSkateLandingPrediction& OutPrediction);
+
+	// Queries kept back from the coarse phase for refinement when fitting to a query budget
+	static constexpr int32 RefineQueryReserve = 8;
+
+	// Shorten the horizon so a solve issues no more than QueryBudget queries.
+	static void FitToQueryBudget(FSkateTrajectorySolverSettings& Settings, int32 QueryBudget);
+
+	// Times of the coarse segments the solver would trace, as start and end pairs.
+	static void GetCoarseSegments(const FSkateTrajectorySolverSettings& Settings, TArray<TPair<float, float>>& OutSegments);
+
+	// Largest deviation between the arc and a chord spanning the given duration.
+	static float GetChordSagitta(const FSkateBallisticArc& Arc, float Duration);
+};
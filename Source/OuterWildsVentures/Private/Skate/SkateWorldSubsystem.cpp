@@ -0,0 +1,155 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Skate/SkateWorldSubsystem.h"
+
+#include "SkateCrowdSubsystem.h"
+#include "SkatePhysics.h"
+#include "Skater.h"
+
+void USkateWorldSubsystem::RegisterSkater(ASkater* Skater)
+{
+	if (!Skater || Skaters.Contains(Skater))
+	{
+		return;
+	}
+	Skaters.Add(Skater);
+
+	// Already given skate physics by whoever spawned it
+	if (Skater->SkatePhysics)
+	{
+		UnpairedSkatePhysics.Remove(Skater->SkatePhysics);
+		Pair(Skater,Skater->SkatePhysics);
+		return;
+	}
+
+	if (Skater->SkatePhysicsClass)
+	{
+		// Paired before it begins play, so it never waits in the unpaired list.
+		FActorSpawnParameters SpawnParameters;
+		SpawnParameters.Owner = Skater;
+		SpawnParameters.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+		SpawnParameters.bDeferConstruction = true;
+		if (ASkatePhysics* SkatePhysics = GetWorld()->SpawnActor<ASkatePhysics>(Skater->SkatePhysicsClass,Skater->GetActorTransform(),SpawnParameters))
+		{
+			Pair(Skater,SkatePhysics);
+			SkatePhysics->FinishSpawning(Skater->GetActorTransform());
+			return;
+		}
+	}
+
+	// Take the nearest skate physics placed in the level
+	ASkatePhysics* NearestSkatePhysics = nullptr;
+	double NearestDistanceSquared = TNumericLimits<double>::Max();
+	for (ASkatePhysics* SkatePhysics : UnpairedSkatePhysics)
+	{
+		const double DistanceSquared = FVector::DistSquared(SkatePhysics->GetActorLocation(),Skater->GetActorLocation());
+		if (DistanceSquared < NearestDistanceSquared)
+		{
+			NearestSkatePhysics = SkatePhysics;
+			NearestDistanceSquared = DistanceSquared;
+		}
+	}
+
+	if (NearestSkatePhysics)
+	{
+		UnpairedSkatePhysics.Remove(NearestSkatePhysics);
+		Pair(Skater,NearestSkatePhysics);
+	}
+	else
+	{
+		UnpairedSkaters.Add(Skater);
+	}
+}
+
+void USkateWorldSubsystem::UnregisterSkater(ASkater* Skater)
+{
+	Skaters.Remove(Skater);
+	UnpairedSkaters.Remove(Skater);
+
+	ASkatePhysics* SkatePhysics = Skater ? Skater->SkatePhysics : nullptr;
+	if (!SkatePhysics)
+	{
+		return;
+	}
+
+	Unpair(Skater,SkatePhysics);
+	if (SkatePhysics->GetOwner() == Skater)
+	{
+		if (!GetWorld()->bIsTearingDown)
+		{
+			SkatePhysics->Destroy();
+		}
+	}
+	else
+	{
+		RegisterSkatePhysics(SkatePhysics);
+	}
+}
+
+void USkateWorldSubsystem::RegisterSkatePhysics(ASkatePhysics* SkatePhysics)
+{
+	// Skate physics spawned for a skater is paired already
+	if (!SkatePhysics || SkatePhysics->GetSkater() || UnpairedSkatePhysics.Contains(SkatePhysics))
+	{
+		return;
+	}
+
+	if (UnpairedSkaters.Num() > 0)
+	{
+		Pair(UnpairedSkaters[0],SkatePhysics);
+		UnpairedSkaters.RemoveAt(0);
+	}
+	else
+	{
+		UnpairedSkatePhysics.Add(SkatePhysics);
+	}
+}
+
+void USkateWorldSubsystem::UnregisterSkatePhysics(ASkatePhysics* SkatePhysics)
+{
+	UnpairedSkatePhysics.Remove(SkatePhysics);
+
+	ASkater* Skater = SkatePhysics ? SkatePhysics->GetSkater() : nullptr;
+	if (!Skater)
+	{
+		return;
+	}
+
+	Unpair(Skater,SkatePhysics);
+	if (Skaters.Contains(Skater))
+	{
+		UnpairedSkaters.Add(Skater);
+	}
+}
+
+const TArray<ASkater*>& USkateWorldSubsystem::GetSkaters() const
+{
+	return Skaters;
+}
+
+void USkateWorldSubsystem::Pair(ASkater* Skater, ASkatePhysics* SkatePhysics)
+{
+	Skater->SkatePhysics = SkatePhysics;
+	SkatePhysics->SetSkater(Skater);
+
+	// Skater reads skate physics state after both of its stages have run this frame
+	Skater->PrimaryActorTick.AddPrerequisite(SkatePhysics,SkatePhysics->PostPhysicsTickFunction);
+
+	if (Skater->bCrowdSkater)
+	{
+		GetWorld()->GetSubsystem<USkateCrowdSubsystem>()->AddSkater(Skater);
+	}
+}
+
+void USkateWorldSubsystem::Unpair(ASkater* Skater, ASkatePhysics* SkatePhysics)
+{
+	if (USkateCrowdSubsystem* SkateCrowdSubsystem = GetWorld()->GetSubsystem<USkateCrowdSubsystem>())
+	{
+		SkateCrowdSubsystem->RemoveSkater(Skater);
+	}
+
+	Skater->PrimaryActorTick.RemovePrerequisite(SkatePhysics,SkatePhysics->PostPhysicsTickFunction);
+	Skater->SkatePhysics = nullptr;
+	SkatePhysics->SetSkater(nullptr);
+}
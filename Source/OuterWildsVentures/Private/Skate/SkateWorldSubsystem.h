@@ -0,0 +1,57 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "SkateWorldSubsystem.generated.h"
+
+class ASkatePhysics;
+class ASkater;
+
+/**
+ * Pairs every skater in the world with its own skate physics when they begin play.
+ * Paired actors reference each other directly, so no skate code needs to look up the player pawn or search for actors.
+ */
+UCLASS()
+class USkateWorldSubsystem : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	// Functions
+
+	// Pair a skater with skate physics. Spawns skate physics if the skater has a class for it, otherwise takes the nearest unpaired one.
+	void RegisterSkater(ASkater* Skater);
+
+	// Unpair a skater. Skate physics spawned for it is destroyed, placed skate physics is freed for another skater.
+	void UnregisterSkater(ASkater* Skater);
+
+	// Pair skate physics with a waiting skater, or keep it until one registers.
+	void RegisterSkatePhysics(ASkatePhysics* SkatePhysics);
+
+	// Unpair skate physics. Its skater waits for new skate physics.
+	void UnregisterSkatePhysics(ASkatePhysics* SkatePhysics);
+
+	// All registered skaters
+	const TArray<ASkater*>& GetSkaters() const;
+
+protected:
+	// Point a skater and skate physics at each other. Crowd skaters are handed to the crowd subsystem.
+	void Pair(ASkater* Skater, ASkatePhysics* SkatePhysics);
+
+	// Clear the references between a skater and its skate physics
+	void Unpair(ASkater* Skater, ASkatePhysics* SkatePhysics);
+
+	// Registered skaters, paired or not
+	UPROPERTY()
+	TArray<ASkater*> Skaters;
+
+	// Skaters waiting for skate physics
+	UPROPERTY()
+	TArray<ASkater*> UnpairedSkaters;
+
+	// Skate physics waiting for a skater
+	UPROPERTY()
+	TArray<ASkatePhysics*> UnpairedSkatePhysics;
+};
@@ -5,8 +5,23 @@
 
 #include "EnhancedInputComponent.h"
 #include "EnhancedInputSubsystems.h"
-#include "Kismet/GameplayStatics.h"
+#include "SkateProfiling.h"
+#include "SkateReplayPawn.h"
+#include "SkateWorldSubsystem.h"
 #include "Kismet/KismetMathLibrary.h"
+#include "Net/UnrealNetwork.h"
+
+DECLARE_CYCLE_STAT(TEXT("Skater Tick"),STAT_SkaterTick,STATGROUP_Skate);
+DECLARE_CYCLE_STAT(TEXT("GroundAdjust"),STAT_SkateGroundAdjust,STATGROUP_Skate);
+DECLARE_CYCLE_STAT(TEXT("MoveWithSkatePhysics"),STAT_SkateMoveWithSkatePhysics,STATGROUP_Skate);
+DECLARE_CYCLE_STAT(TEXT("Blueprint rotation"),STAT_SkateBlueprintRotation,STATGROUP_Skate);
+DECLARE_CYCLE_STAT(TEXT("RecordReplay"),STAT_SkateRecordReplay,STATGROUP_Skate);
+
+static TAutoConsoleVariable<bool> CVarSkateNetShowCorrections(
+	TEXT("skate.Net.ShowCorrections"),
+	false,
+	TEXT("Show on screen how many times the server has corrected the local skater's prediction."),
+	ECVF_Cheat);
 
 // Sets default values
 ASkater::ASkater()
@@ -14,6 +29,9 @@ ASkater::ASkater()
  	// Set this pawn to call Tick() every frame.  You can turn this off to improve performance if you don't need it.
 	PrimaryActorTick.bCanEverTick = true;
 
+	// Skater follows skate physics once its forces and queries are done for the frame. Skate physics is made a prerequisite on pairing.
+	PrimaryActorTick.TickGroup = TG_PostPhysics;
+
 	Root = CreateDefaultSubobject<USceneComponent>("Root");
 	MaxMesh = CreateDefaultSubobject<USkeletalMeshComponent>("Max");
 	BoardMesh = CreateDefaultSubobject<USkeletalMeshComponent>("Board");
@@ -29,6 +47,10 @@ ASkater::ASkater()
 
 	CameraBoom->SetupAttachment(Root);
 	MainCamera->SetupAttachment(CameraBoom);
+
+	// Every machine follows its own skate physics. The server's skate state is replicated instead of movement.
+	bReplicates = true;
+	SetReplicateMovement(false);
 	
 
 	
@@ -40,11 +62,13 @@ void ASkater::BeginPlay()
 {
 	Super::BeginPlay();
 
-	// Skate physics reference set
-	SkatePhysics = Cast<ASkatePhysics>(UGameplayStatics::GetActorOfClass(GetWorld(),ASkatePhysics::StaticClass()));
-	if (SkatePhysics == nullptr)
+	// Skate physics reference is set on pairing, now or when skate physics begins play
+	GetWorld()->GetSubsystem<USkateWorldSubsystem>()->RegisterSkater(this);
+
+	// Whole budget up front. Extra keyframe interval so a full ReplaySeconds is always playable from a keyframe.
+	if (bRecordReplay)
 	{
-		GEngine->AddOnScreenDebugMessage(1,25,FColor::Red,FString("Missing Physics"),false);
+		ReplayBuffer.Init(FMath::CeilToInt(ReplaySeconds / ReplayStepSeconds) + ReplayKeyframeInterval,ReplayKeyframeInterval);
 	}
 
 	// Add input mapping context
@@ -57,27 +81,65 @@ void ASkater::BeginPlay()
 	}
 }
 
+void ASkater::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	if (GhostWriter.IsWriting())
+	{
+		GhostWriter.End();
+	}
+
+	if (USkateWorldSubsystem* SkateWorldSubsystem = GetWorld()->GetSubsystem<USkateWorldSubsystem>())
+	{
+		SkateWorldSubsystem->UnregisterSkater(this);
+	}
+
+	Super::EndPlay(EndPlayReason);
+}
+
 // Called every frame
 void ASkater::Tick(float DeltaTime)
 {
+	SCOPE_CYCLE_COUNTER(STAT_SkaterTick);
+
 	Super::Tick(DeltaTime);
 
 	TickDelta = DeltaTime;
 
-	// Move pawn with skate physics.
-	MoveWithSkatePhysics();
-
 	// Input Cooldown
 	InputCoolDowns();
 
 	// Adjust rotations and grounded conditions and flip jumps
 	GroundAdjust();
 
-	// Rotate camera to rotation tracker
-	CameraRotation();
+	// Move pawn with skate physics.
+	MoveWithSkatePhysics();
+
+	{
+		SCOPE_CYCLE_COUNTER(STAT_SkateBlueprintRotation);
+		SKATE_COUNT_BLUEPRINT_CALLS(2);
+
+		// Rotate camera to rotation tracker
+		CameraRotation();
+
+		// Rotate mesh to rotation tracker
+		MeshRotation();
+	}
 
-	// Rotate mesh to rotation tracker
-	MeshRotation();
+	// Record the frame's final state for instant replay
+	RecordReplay(DeltaTime);
+
+	// Server publishes its state. Owning client sends its input along with the state it predicted.
+	if (HasAuthority())
+	{
+		if (SkatePhysics)
+		{
+			ServerSkateState = FSkateNetState::Capture(SkatePhysics,LastAppliedNetInputSequence);
+		}
+	}
+	else if (IsLocallyControlled())
+	{
+		SendNetInput();
+	}
 
 }
 
@@ -99,17 +161,28 @@ void ASkater::SetupPlayerInputComponent(UInputComponent* PlayerInputComponent)
 
 }
 
+void ASkater::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const
+{
+	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
+
+	DOREPLIFETIME(ASkater,ServerSkateState);
+}
+
 void ASkater::PumpActionTriggered(const FInputActionValue& Value)
 {
+	PendingNetInput.bPump = true;
+
 	if (SkatePhysics && !bPumped && bGrounded)
 	{
 		if (SkatePhysics->GetSkatePhysicsVelocity().Length()>100.0)
 		{
+			SKATE_COUNT_BLUEPRINT_CALLS(1);
 			ISkaterface::Execute_Pump(SkatePhysics);
 			bPumped = true;
 		}
 		else
 		{
+			SKATE_COUNT_BLUEPRINT_CALLS(1);
 			ISkaterface::Execute_Pump(SkatePhysics);
 			bPumped = true;
 		}
@@ -118,6 +191,8 @@ void ASkater::PumpActionTriggered(const FInputActionValue& Value)
 
 void ASkater::LeanActionTriggered(const FInputActionValue& Value)
 {
+	PendingNetInput.SetLeanAxis(Value.Get<float>());
+
 	if(bGrounded)
 	{
 		if(SkatePhysics)
@@ -150,6 +225,8 @@ void ASkater::LeanActionCompleted(const FInputActionValue& Value)
 
 void ASkater::OllieActionCompleted(const FInputActionValue& Value)
 {
+	PendingNetInput.bOllie = true;
+
 	if (SkatePhysics)
 	{
 		if (bGrounded)
@@ -161,6 +238,9 @@ void ASkater::OllieActionCompleted(const FInputActionValue& Value)
 
 void ASkater::GroundAdjust()
 {
+	SCOPE_CYCLE_COUNTER(STAT_SkateGroundAdjust);
+	SKATE_SCOPE_TIMER(GroundAdjust);
+
 	if(SkatePhysics)
 	{
 		FHitResult GroundHitResult = SkatePhysics->ReportGroundCondition();
@@ -174,6 +254,10 @@ void ASkater::GroundAdjust()
 				JustLanded();
 				bGrounded = true;
 			}
+			if (SkatePhysics->GetCurrentSkateMode() == Air)
+			{
+				SkatePhysics->ChangeSkateMode(Skate);
+			}
 			FVector PhysicsVelocity = SkatePhysics->GetSkatePhysicsVelocity();
 			if (PhysicsVelocity.Length()>50.0f)
 			{
@@ -190,6 +274,11 @@ void ASkater::GroundAdjust()
 				// Just left ground
 				bGrounded = false;
 			}
+			if (SkatePhysics->GetCurrentSkateMode() == Skate)
+			{
+				// Physics is on a ballistic arc from here until landing or a grind.
+				SkatePhysics->ChangeSkateMode(Air);
+			}
 
 			// If SkatePhysics has positive Z velocity and ground trace hit normal is nearly horizontal, Skater should perform a flip jump back onto the ramp.
 			// For this, we perform two checks
@@ -238,9 +327,11 @@ void ASkater::InputCoolDowns()
 
 void ASkater::MoveWithSkatePhysics()
 {
+	SCOPE_CYCLE_COUNTER(STAT_SkateMoveWithSkatePhysics);
+
 	if(SkatePhysics)
 	{
-		FVector PhysicsLocation = SkatePhysics->GetActorLocation();
+		FVector PhysicsLocation = SkatePhysics->GetRenderLocation();
 		SetActorLocation((FMath::VInterpTo(GetActorLocation(),PhysicsLocation,TickDelta,1000.0)),false,nullptr,ETeleportType::TeleportPhysics);
 	}
 }
@@ -281,6 +372,277 @@ void ASkater::MeshRotation()
 }
 */
 
+void ASkater::RecordReplay(float DeltaTime)
+{
+	SCOPE_CYCLE_COUNTER(STAT_SkateRecordReplay);
+
+	if ((!bRecordReplay && !GhostWriter.IsWriting()) || !SkatePhysics)
+	{
+		return;
+	}
+
+	ReplayStepAccumulator += DeltaTime;
+	if (ReplayStepAccumulator < ReplayStepSeconds)
+	{
+		return;
+	}
+
+	// One capture covers all steps due this tick. Nothing finer is known.
+	const FSkateReplayFrame Frame = FSkateReplayFrame::Capture(this);
+	while (ReplayStepAccumulator >= ReplayStepSeconds)
+	{
+		ReplayStepAccumulator -= ReplayStepSeconds;
+		if (bRecordReplay)
+		{
+			ReplayBuffer.RecordFrame(Frame);
+		}
+		GhostWriter.WriteFrame(Frame);
+	}
+}
+
+ASkateReplayPawn* ASkater::StartInstantReplay()
+{
+	if (!bRecordReplay || ReplayBuffer.GetPlayableFrameCount() == 0)
+	{
+		return nullptr;
+	}
+
+	FActorSpawnParameters SpawnParameters;
+	SpawnParameters.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+	UClass* PawnClass = ReplayPawnClass ? ReplayPawnClass.Get() : ASkateReplayPawn::StaticClass();
+	ASkateReplayPawn* ReplayPawn = GetWorld()->SpawnActor<ASkateReplayPawn>(PawnClass,GetActorTransform(),SpawnParameters);
+	if (ReplayPawn)
+	{
+		ReplayPawn->StartReplay(this,ReplayBuffer,ReplayStepSeconds);
+	}
+	return ReplayPawn;
+}
+
+const FSkateReplayBuffer& ASkater::GetReplayBuffer() const
+{
+	return ReplayBuffer;
+}
+
+bool ASkater::StartGhostRecording(const FString& GhostName)
+{
+	if (GhostWriter.IsWriting())
+	{
+		GhostWriter.End();
+	}
+	return GhostWriter.Begin(GetGhostFilePath(GhostName),ReplayStepSeconds);
+}
+
+bool ASkater::StopGhostRecording()
+{
+	return GhostWriter.End();
+}
+
+ASkateReplayPawn* ASkater::StartGhost(const FString& GhostName)
+{
+	FActorSpawnParameters SpawnParameters;
+	SpawnParameters.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+	UClass* PawnClass = ReplayPawnClass ? ReplayPawnClass.Get() : ASkateReplayPawn::StaticClass();
+	ASkateReplayPawn* GhostPawn = GetWorld()->SpawnActor<ASkateReplayPawn>(PawnClass,GetActorTransform(),SpawnParameters);
+	if (GhostPawn && !GhostPawn->StartGhost(this,GetGhostFilePath(GhostName)))
+	{
+		return nullptr;
+	}
+	return GhostPawn;
+}
+
+FString ASkater::GetGhostFilePath(const FString& GhostName)
+{
+	return FPaths::ProjectSavedDir() / TEXT("Ghosts") / GhostName + TEXT(".skghost");
+}
+
+void ASkater::SendNetInput()
+{
+	if (!SkatePhysics)
+	{
+		return;
+	}
+
+	PendingNetInput.Sequence = NextNetInputSequence;
+	if (++NextNetInputSequence == 0)
+	{
+		NextNetInputSequence = 1;
+	}
+	ServerSkateInput(PendingNetInput,LastSentNetInput);
+
+	// State this frame's input led to, to compare with the server's once it is acknowledged
+	FSkatePredictedState& Predicted = NetPredictionHistory[PendingNetInput.Sequence % NetPredictionHistorySize];
+	Predicted.Sequence = PendingNetInput.Sequence;
+	Predicted.Location = SkatePhysics->GetActorLocation();
+	Predicted.Velocity = SkatePhysics->GetSkatePhysicsVelocity();
+	Predicted.SkateMode = SkatePhysics->GetCurrentSkateMode();
+	Predicted.GrindDistance = SkatePhysics->GrindCurrentDistance;
+
+	LastSentNetInput = PendingNetInput;
+	PendingNetInput = FSkateNetInput();
+}
+
+bool ASkater::ServerSkateInput_Validate(const FSkateNetInput& Input, const FSkateNetInput& PreviousInput)
+{
+	// Lean is never quantized to -128
+	return Input.LeanAxis != MIN_int8 && PreviousInput.LeanAxis != MIN_int8;
+}
+
+void ASkater::ServerSkateInput_Implementation(const FSkateNetInput& Input, const FSkateNetInput& PreviousInput)
+{
+	NetInputQueue.Add(PreviousInput);
+	NetInputQueue.Add(Input);
+}
+
+void ASkater::ApplyQueuedNetInput()
+{
+	FSkateNetInput Input;
+	if (HasAuthority() && NetInputQueue.Pop(Input))
+	{
+		ApplyNetInput(Input);
+	}
+}
+
+uint16 ASkater::GetLastAppliedNetInputSequence() const
+{
+	return LastAppliedNetInputSequence;
+}
+
+void ASkater::ApplyNetInput(const FSkateNetInput& Input)
+{
+	LastAppliedNetInputSequence = Input.Sequence;
+
+	// Same input functions the owning client ran, so both simulate the same frame
+	if (Input.bPump)
+	{
+		PumpActionTriggered(FInputActionValue(true));
+	}
+
+	const float LeanAxis = Input.GetLeanAxis();
+	if (LeanAxis != 0.0f)
+	{
+		LeanActionTriggered(FInputActionValue(LeanAxis));
+	}
+	else if (LastAppliedNetLeanAxis != 0.0f)
+	{
+		LeanActionCompleted(FInputActionValue(0.0f));
+	}
+	LastAppliedNetLeanAxis = LeanAxis;
+
+	if (Input.bOllie)
+	{
+		OllieActionCompleted(FInputActionValue(true));
+	}
+}
+
+void ASkater::OnRep_ServerSkateState()
+{
+	if (!SkatePhysics)
+	{
+		return;
+	}
+
+	if (IsLocallyControlled())
+	{
+		ReconcileNetPrediction();
+	}
+	else
+	{
+		ApplyNetProxyState();
+	}
+}
+
+void ASkater::ReconcileNetPrediction()
+{
+	const uint16 AckedSequence = ServerSkateState.AckedInputSequence;
+	const FSkatePredictedState& Predicted = NetPredictionHistory[AckedSequence % NetPredictionHistorySize];
+	if (AckedSequence == 0 || Predicted.Sequence != AckedSequence)
+	{
+		// Nothing acknowledged yet, or too long ago to compare
+		return;
+	}
+
+	const FVector LocationError = ServerSkateState.Location - Predicted.Location;
+	const FVector VelocityError = ServerSkateState.Velocity - Predicted.Velocity;
+	const bool bModeMismatch = ServerSkateState.SkateMode != Predicted.SkateMode;
+	if (!bModeMismatch && LocationError.SizeSquared() <= FMath::Square(NetCorrectionTolerance))
+	{
+		return;
+	}
+
+	NetCorrectionCount++;
+	if (CVarSkateNetShowCorrections.GetValueOnGameThread() && GEngine)
+	{
+		GEngine->AddOnScreenDebugMessage(reinterpret_cast<uint64>(this),1.0f,FColor::Orange,FString::Printf(TEXT("%s: %d corrections, last %.1f"),*GetName(),NetCorrectionCount,LocationError.Length()));
+	}
+
+	if (bModeMismatch)
+	{
+		// Disagreeing on mode, nothing predicted since can be trusted. Take the server state as it is and let the
+		// client catch up with it. Entering a grind needs the rail, which the client finds itself on its next check.
+		if (SkatePhysics->GetCurrentSkateMode() == ESkateMode::Grind && ServerSkateState.SkateMode != ESkateMode::Grind)
+		{
+			SkatePhysics->ChangeSkateMode(Skate);
+		}
+		if (ServerSkateState.SkateMode == Air && SkatePhysics->GetCurrentSkateMode() != Air)
+		{
+			SkatePhysics->ChangeSkateMode(Air);
+		}
+		SetSkatePhysicsState(ServerSkateState.Location,ServerSkateState.Velocity);
+
+		for (FSkatePredictedState& Pending : NetPredictionHistory)
+		{
+			Pending.Sequence = 0;
+		}
+		return;
+	}
+
+	// Skate physics cannot be stepped again on its own, so the inputs sent since are not replayed. The error at the
+	// acknowledged frame is carried over to the present instead, which is what replaying them would give for small
+	// errors.
+	SetSkatePhysicsState(SkatePhysics->GetActorLocation() + LocationError,SkatePhysics->GetSkatePhysicsVelocity() + VelocityError);
+	if (ServerSkateState.SkateMode == ESkateMode::Grind)
+	{
+		SkatePhysics->GrindCurrentDistance += ServerSkateState.GrindDistance - Predicted.GrindDistance;
+	}
+
+	// Frames still to be acknowledged were predicted from the uncorrected state
+	for (FSkatePredictedState& Pending : NetPredictionHistory)
+	{
+		if (Pending.Sequence != 0 && IsNewerSkateNetSequence(Pending.Sequence,AckedSequence))
+		{
+			Pending.Location += LocationError;
+			Pending.Velocity += VelocityError;
+		}
+	}
+}
+
+void ASkater::ApplyNetProxyState()
+{
+	if (SkatePhysics->GetCurrentSkateMode() == ESkateMode::Grind && ServerSkateState.SkateMode != ESkateMode::Grind)
+	{
+		SkatePhysics->ChangeSkateMode(Skate);
+	}
+	if (ServerSkateState.SkateMode == Air && SkatePhysics->GetCurrentSkateMode() != Air)
+	{
+		SkatePhysics->ChangeSkateMode(Air);
+	}
+
+	// Local skate physics carries the skater on between updates. Only pulled back when it drifts too far.
+	const FVector Location = FVector::DistSquared(SkatePhysics->GetActorLocation(),ServerSkateState.Location) > FMath::Square(NetCorrectionTolerance)
+		? ServerSkateState.Location
+		: SkatePhysics->GetActorLocation();
+	SetSkatePhysicsState(Location,ServerSkateState.Velocity);
+}
+
+void ASkater::SetSkatePhysicsState(const FVector& Location, const FVector& Velocity)
+{
+	SkatePhysics->SetActorLocation(Location,false,nullptr,ETeleportType::TeleportPhysics);
+	if (SkatePhysics->RootSphere->IsSimulatingPhysics())
+	{
+		SkatePhysics->RootSphere->SetPhysicsLinearVelocity(Velocity);
+	}
+}
+
 void ASkater::JustLanded()
 {
 	
@@ -293,6 +655,7 @@ void ASkater::OrientToLanding(FHitResult HitResult, float TimeToHit, FVector Pro
 		switch (Cast<ASkatePhysics>(SkatePhysics)->GetCurrentSkateMode())
 		{
 		case Skate:
+		case Air:
 			{
 				if (HitResult.bBlockingHit)
 				{
@@ -302,7 +665,11 @@ void ASkater::OrientToLanding(FHitResult HitResult, float TimeToHit, FVector Pro
 					if (!(DotProduct<0.1 && DotProduct>-0.1))
 					{
 						FRotator TargetRotation = UKismetMathLibrary::MakeRotFromXZ(ProjectedForwardVector,HitResult.Normal);
-						RotationTracker->SetWorldRotation(TargetRotation,false,nullptr,ETeleportType::TeleportPhysics);
+
+						// Spread the remaining rotation over the time left before landing so the skater is aligned on touch down.
+						const float Alpha = TimeToHit > TickDelta ? TickDelta/TimeToHit : 1.0f;
+						const FQuat NewRotation = FQuat::Slerp(RotationTracker->GetComponentQuat(),TargetRotation.Quaternion(),Alpha);
+						RotationTracker->SetWorldRotation(NewRotation,false,nullptr,ETeleportType::TeleportPhysics);
 					}
 				}
 				break;
@@ -5,16 +5,24 @@
 #include "CoreMinimal.h"
 #include "InputMappingContext.h"
 #include "SkatePhysics.h"
+#include "SkateGhost.h"
+#include "SkateNet.h"
+#include "SkateReplay.h"
 #include "Camera/CameraComponent.h"
 #include "GameFramework/Pawn.h"
 #include "GameFramework/SpringArmComponent.h"
 #include "Skater.generated.h"
 
+class ASkateReplayPawn;
+
 UCLASS()
 class ASkater : public APawn, public ISkaterface
 {
 	GENERATED_BODY()
 
+	// Drives the input actions
+	friend class USkateHarnessSubsystem;
+
 public:
 	// Sets default values for this pawn's properties
 	ASkater();
@@ -23,6 +31,8 @@ protected:
 	// Called when the game starts or when spawned
 	virtual void BeginPlay() override;
 
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
 public:	
 	// Called every frame
 	virtual void Tick(float DeltaTime) override;
@@ -30,6 +40,8 @@ public:
 	// Called to bind functionality to input
 	virtual void SetupPlayerInputComponent(class UInputComponent* PlayerInputComponent) override;
 
+	virtual void GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const override;
+
 public:
 	// Components
 
@@ -92,6 +104,38 @@ public:
 	UPROPERTY(EditAnywhere, Category = "Config")
 	float PumpCooldownTarget = 1.5f;
 
+	// Skate physics spawned for this skater. If unset, the skater is paired with skate physics placed in the level.
+	UPROPERTY(EditAnywhere, Category = "Config")
+	TSubclassOf<ASkatePhysics> SkatePhysicsClass;
+
+	// Tick with the skate crowd in a batch instead of per actor. For background skaters without a camera.
+	UPROPERTY(EditAnywhere, Category = "Config")
+	bool bCrowdSkater = false;
+
+	// Keep the last ReplaySeconds of skating for instant replay
+	UPROPERTY(EditAnywhere, Category = "Replay")
+	bool bRecordReplay = true;
+
+	// Length of instant replay, in seconds
+	UPROPERTY(EditAnywhere, Category = "Replay", meta=(ClampMin="1.0"))
+	float ReplaySeconds = 30.0f;
+
+	// Time between recorded replay steps, in seconds
+	UPROPERTY(EditAnywhere, Category = "Replay", meta=(ClampMin="0.005"))
+	float ReplayStepSeconds = 1.0f / 60.0f;
+
+	// A keyframe is recorded at least every these many replay steps
+	UPROPERTY(EditAnywhere, Category = "Replay", meta=(ClampMin="1"))
+	int32 ReplayKeyframeInterval = 60;
+
+	// Pawn spawned to play back instant replay
+	UPROPERTY(EditAnywhere, Category = "Replay")
+	TSubclassOf<ASkateReplayPawn> ReplayPawnClass;
+
+	// Owning client prediction further than this from the server is corrected
+	UPROPERTY(EditAnywhere, Category = "Network", meta=(ClampMin="0.0"))
+	float NetCorrectionTolerance = 25.0f;
+
 
 	// Properties
 
@@ -107,7 +151,7 @@ public:
 	UPROPERTY(BlueprintReadWrite, Category = "Ground Condition")
 	FVector GroundTraceHitNormal;
 
-	// Skate Physics actor reference
+	// Skate Physics actor reference. Set by the skate world subsystem.
 	UPROPERTY(BlueprintReadWrite)
 	ASkatePhysics* SkatePhysics;
 
@@ -119,6 +163,10 @@ public:
 	UPROPERTY(BlueprintReadWrite, Category = "Ground Condition")
 	bool bGrounded;
 
+	// Times the owning client's prediction has been corrected by the server
+	UPROPERTY(BlueprintReadOnly, Category = "Network")
+	int32 NetCorrectionCount = 0;
+
 public:
 	// Functions
 
@@ -130,7 +178,7 @@ public:
 	UFUNCTION(BlueprintCallable, Category = "Input")
 	void InputCoolDowns();
 
-	// Move pawn with skate physics. Perform first on tick.
+	// Move pawn with skate physics. Performed after ground adjust on tick, so the pawn shows this frame's physics.
 	UFUNCTION(BlueprintCallable)
 	void MoveWithSkatePhysics();
 
@@ -146,6 +194,34 @@ public:
 	UFUNCTION(BlueprintCallable, Category = "Ground Condition")
 	void JustLanded();
 
+	// Spawn a replay pawn playing back the recorded replay. Recording carries on during playback.
+	UFUNCTION(BlueprintCallable, Category = "Replay")
+	ASkateReplayPawn* StartInstantReplay();
+
+	// Recorded replay frames
+	const FSkateReplayBuffer& GetReplayBuffer() const;
+
+	// Start writing replay steps to a ghost run file in Saved/Ghosts
+	UFUNCTION(BlueprintCallable, Category = "Replay")
+	bool StartGhostRecording(const FString& GhostName);
+
+	// Finish the ghost run file being written
+	UFUNCTION(BlueprintCallable, Category = "Replay")
+	bool StopGhostRecording();
+
+	// Spawn a replay pawn racing a ghost run from Saved/Ghosts
+	UFUNCTION(BlueprintCallable, Category = "Replay")
+	ASkateReplayPawn* StartGhost(const FString& GhostName);
+
+	// Path of a ghost run file
+	static FString GetGhostFilePath(const FString& GhostName);
+
+	// Apply the next input frame queued from the owning client. Server only, before skate physics ticks.
+	void ApplyQueuedNetInput();
+
+	// Last owning client input frame applied on the server. 0 for none.
+	uint16 GetLastAppliedNetInputSequence() const;
+
 	// Interface Functions
 
 	virtual  void OrientToLanding(FHitResult HitResult, float TimeToHit, FVector ProjectedForwardVector) override;
@@ -156,6 +232,71 @@ public:
 
 	// Internal Functions
 
+protected:
+	// Record replay steps for the time since the last tick
+	void RecordReplay(float DeltaTime);
+
+	// Last ReplaySeconds of skating. Allocated on BeginPlay.
+	FSkateReplayBuffer ReplayBuffer;
+
+	// Time not yet recorded as a replay step
+	float ReplayStepAccumulator = 0.0f;
+
+	// Ghost run being recorded, fed the same steps as the replay buffer
+	FSkateGhostWriter GhostWriter;
+
+protected:
+	// Networking
+
+	// Send this frame's input to the server and remember the state it was predicted to lead to
+	void SendNetInput();
+
+	// Apply an input frame from the owning client on the server
+	void ApplyNetInput(const FSkateNetInput& Input);
+
+	// Input from the owning client. The previous frame rides along in case its packet was lost. Queued until the
+	// server's next skate physics tick.
+	UFUNCTION(Server, Unreliable, WithValidation)
+	void ServerSkateInput(const FSkateNetInput& Input, const FSkateNetInput& PreviousInput);
+
+	UFUNCTION()
+	void OnRep_ServerSkateState();
+
+	// Correct the owning client's prediction by its error at the acknowledged input frame
+	void ReconcileNetPrediction();
+
+	// Move skate physics of a skater controlled elsewhere to the server state
+	void ApplyNetProxyState();
+
+	// Teleport skate physics, keeping it simulating
+	void SetSkatePhysicsState(const FVector& Location, const FVector& Velocity);
+
+	// Skate physics state on the server. Written by the server every tick.
+	UPROPERTY(ReplicatedUsing=OnRep_ServerSkateState)
+	FSkateNetState ServerSkateState;
+
+	// Input gathered by the input functions this frame
+	FSkateNetInput PendingNetInput;
+
+	// Input sent last frame
+	FSkateNetInput LastSentNetInput;
+
+	// Sequence of the next input frame sent
+	uint16 NextNetInputSequence = 1;
+
+	// Input frames received on the server and not yet applied
+	FSkateNetInputQueue NetInputQueue;
+
+	// Last input frame applied on the server
+	uint16 LastAppliedNetInputSequence = 0;
+
+	// Lean axis of the last input frame applied on the server, to tell when lean is released
+	float LastAppliedNetLeanAxis = 0.0f;
+
+	// Predicted states by input sequence, for input frames the server may not have acknowledged yet
+	static constexpr int32 NetPredictionHistorySize = 64;
+	FSkatePredictedState NetPredictionHistory[NetPredictionHistorySize];
+
 protected:
 	//TEMPORARY animation asset refs
 	
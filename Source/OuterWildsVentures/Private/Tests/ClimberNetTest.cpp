@@ -0,0 +1,209 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "Climber/Climber.h"
+#include "Climber/ClimberCMC.h"
+#include "Engine/StaticMesh.h"
+#include "Engine/StaticMeshActor.h"
+#include "Engine/World.h"
+#include "GameFramework/PlayerController.h"
+#include "Misc/AutomationTest.h"
+#include "Tests/AutomationCommon.h"
+#include "Tests/NetPlaySession.h"
+
+#if WITH_DEV_AUTOMATION_TESTS && WITH_EDITOR
+
+namespace ClimberNetTest
+{
+	const TCHAR* MapName = TEXT("/Game/OWV/Maps/Test");
+	const TCHAR* ClimberClassPath = TEXT("/Game/ClimberPrototype/Core/Climber/PAWN_Climber.PAWN_Climber_C");
+	const TCHAR* CubeMeshPath = TEXT("/Engine/BasicShapes/Cube.Cube");
+
+	// Same as -PktLag=100 -PktLoss=5
+	constexpr int32 PacketLagMilliseconds = 100;
+	constexpr int32 PacketLossPercent = 5;
+
+	constexpr double SessionTimeoutSeconds = 60.0;
+
+	// Frames the client is driven at the wall, and frames between climb dashes
+	constexpr int32 DriveFrames = 900;
+	constexpr int32 ClimbDashFrames = 90;
+
+	// Saved moves replay climbs and dashes as the server runs them. Lost packets alone can still cost a correction or two.
+	constexpr int32 MaxCorrections = 3;
+
+	// Far above the map, so nothing else is in reach of the climber
+	const FVector Origin(0.0f, 0.0f, 20000.0f);
+
+	struct FDedicatedServerSession
+	{
+		TWeakObjectPtr<AClimber> ClientClimber;
+		bool bSpawned = false;
+		int32 Frame = 0;
+
+		int32 StartCorrections = 0;
+		bool bClimbed = false;
+		bool bClimbDashed = false;
+	};
+
+	// Movable, so climb queries trace it whether or not the level has baked climbability
+	void SpawnCube(UWorld* World, const FVector& Location, const FVector& Scale)
+	{
+		UStaticMesh* CubeMesh = LoadObject<UStaticMesh>(nullptr, CubeMeshPath);
+		AStaticMeshActor* Cube = World->SpawnActorDeferred<AStaticMeshActor>(AStaticMeshActor::StaticClass(), FTransform(FQuat::Identity, Location, Scale));
+		if (!Cube)
+		{
+			return;
+		}
+
+		// Spawned on the server and the client alike rather than replicated
+		Cube->SetReplicates(false);
+		Cube->GetStaticMeshComponent()->SetMobility(EComponentMobility::Movable);
+		Cube->GetStaticMeshComponent()->SetStaticMesh(CubeMesh);
+		Cube->FinishSpawning(FTransform(FQuat::Identity, Location, Scale));
+	}
+
+	// A floor, and a wall taller than anything climbed in the test so no ledge is reached
+	void SpawnClimbingWall(UWorld* World)
+	{
+		SpawnCube(World, Origin, FVector(10.0f, 10.0f, 1.0f));
+		SpawnCube(World, Origin + FVector(400.0f, 0.0f, 1050.0f), FVector(1.0f, 10.0f, 20.0f));
+	}
+
+	// Possess a climber facing the wall with the client's player controller
+	bool SpawnServerClimber(UWorld* ServerWorld)
+	{
+		APlayerController* PlayerController = nullptr;
+		for (FConstPlayerControllerIterator It = ServerWorld->GetPlayerControllerIterator(); It; ++It)
+		{
+			PlayerController = It->Get();
+		}
+		if (!PlayerController)
+		{
+			return false;
+		}
+
+		UClass* ClimberClass = LoadClass<AClimber>(nullptr, ClimberClassPath);
+		FActorSpawnParameters SpawnParameters;
+		SpawnParameters.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+		AClimber* Climber = ServerWorld->SpawnActor<AClimber>(ClimberClass ? ClimberClass : AClimber::StaticClass(), Origin + FVector(0.0f, 0.0f, 150.0f), FRotator::ZeroRotator, SpawnParameters);
+		if (!Climber)
+		{
+			return false;
+		}
+
+		PlayerController->Possess(Climber);
+		PlayerController->SetControlRotation(FRotator::ZeroRotator);
+		return true;
+	}
+}
+
+DEFINE_LATENT_AUTOMATION_COMMAND_TWO_PARAMETER(FWaitForClimberDedicatedServerCommand, FAutomationTestBase*, Test, TSharedRef<ClimberNetTest::FDedicatedServerSession>, Session);
+
+bool FWaitForClimberDedicatedServerCommand::Update()
+{
+	using namespace ClimberNetTest;
+
+	UWorld* ServerWorld = NetPlaySession::FindWorld(NM_DedicatedServer);
+	UWorld* ClientWorld = NetPlaySession::FindWorld(NM_Client);
+	APlayerController* ClientController = ClientWorld ? ClientWorld->GetFirstPlayerController() : nullptr;
+
+	if (!Session->bSpawned && ServerWorld && ClientController && ServerWorld->GetNumPlayerControllers() > 0)
+	{
+		SpawnClimbingWall(ServerWorld);
+		SpawnClimbingWall(ClientWorld);
+		if (!SpawnServerClimber(ServerWorld))
+		{
+			Test->AddError(TEXT("Cannot spawn a climber for the client on the server"));
+			return true;
+		}
+		Session->bSpawned = true;
+	}
+
+	// Possession reaches the client with the packet lag
+	AClimber* ClientClimber = ClientController ? Cast<AClimber>(ClientController->GetPawn()) : nullptr;
+	const UClimberCMC* Movement = ClientClimber ? Cast<UClimberCMC>(ClientClimber->GetCharacterMovement()) : nullptr;
+	if (Session->bSpawned && Movement)
+	{
+		Session->ClientClimber = ClientClimber;
+		Session->StartCorrections = Movement->GetNetCorrectionCount();
+		return true;
+	}
+
+	if (GetCurrentRunTime() > SessionTimeoutSeconds)
+	{
+		Test->AddError(TEXT("Client did not possess its climber"));
+		return true;
+	}
+	return false;
+}
+
+DEFINE_LATENT_AUTOMATION_COMMAND_TWO_PARAMETER(FDriveClimberDedicatedServerCommand, FAutomationTestBase*, Test, TSharedRef<ClimberNetTest::FDedicatedServerSession>, Session);
+
+bool FDriveClimberDedicatedServerCommand::Update()
+{
+	using namespace ClimberNetTest;
+
+	AClimber* Climber = Session->ClientClimber.Get();
+	UClimberCMC* Movement = Climber ? Cast<UClimberCMC>(Climber->GetCharacterMovement()) : nullptr;
+	if (!Movement)
+	{
+		// Also the case if the session failed to start
+		return true;
+	}
+
+	// Walk into the wall and start climbing, then climb up it with a dash now and then
+	if (Movement->IsClimbing())
+	{
+		Session->bClimbed = true;
+		Climber->AddMovementInput(FVector::UpVector, 1.0f);
+		if (Session->Frame % ClimbDashFrames == 0)
+		{
+			Movement->TryClimbDashing();
+		}
+		Session->bClimbDashed |= Movement->IsClimbDashing();
+	}
+	else
+	{
+		Climber->AddMovementInput(FVector::ForwardVector, 1.0f);
+		Movement->TryClimbing();
+	}
+
+	if (++Session->Frame < DriveFrames)
+	{
+		return false;
+	}
+
+	const int32 Corrections = Movement->GetNetCorrectionCount() - Session->StartCorrections;
+	Test->TestTrue(TEXT("Client climbed"), Session->bClimbed);
+	Test->TestTrue(TEXT("Client climb dashed"), Session->bClimbDashed);
+	Test->TestTrue(FString::Printf(TEXT("Client corrections while climbing (%d) are at most %d"), Corrections, MaxCorrections), Corrections <= MaxCorrections);
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FClimberDedicatedServerTest, "OuterWildsVentures.Climber.Net.DedicatedServer",
+	EAutomationTestFlags::EditorContext | EAutomationTestFlags::ProductFilter)
+
+bool FClimberDedicatedServerTest::RunTest(const FString& Parameters)
+{
+	using namespace ClimberNetTest;
+
+	if (!AutomationOpenMap(MapName))
+	{
+		AddError(FString::Printf(TEXT("Cannot open %s"), MapName));
+		return false;
+	}
+	if (!NetPlaySession::Start(PIE_Client, PacketLagMilliseconds, PacketLossPercent))
+	{
+		AddError(TEXT("Cannot start a dedicated server play session"));
+		return false;
+	}
+
+	// A client climbing and dashing through lagged and lost packets. Each correction it receives is counted.
+	const TSharedRef<FDedicatedServerSession> Session = MakeShared<FDedicatedServerSession>();
+	ADD_LATENT_AUTOMATION_COMMAND(FWaitForClimberDedicatedServerCommand(this, Session));
+	ADD_LATENT_AUTOMATION_COMMAND(FDriveClimberDedicatedServerCommand(this, Session));
+	ADD_LATENT_AUTOMATION_COMMAND(FEndNetPlaySessionCommand());
+	return true;
+}
+
+#endif
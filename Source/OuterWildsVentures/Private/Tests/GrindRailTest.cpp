@@ -0,0 +1,92 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "Components/SplineComponent.h"
+#include "Engine/Engine.h"
+#include "Engine/World.h"
+#include "Misc/AutomationTest.h"
+#include "Skate/GrindRail.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace GrindRailTest
+{
+	// Linear interpolation between samples 10cm apart stays well within these on a rail this gently curved
+	constexpr float LocationTolerance = 0.5f;
+	constexpr float DistanceTolerance = 1.0f;
+	constexpr float TangentRelativeTolerance = 0.02f;
+
+	// Step between tested distances, chosen not to line up with the sample spacing
+	constexpr float DistanceStep = 37.0f;
+
+	// Query points are this far off the rail, as a grind trace hit on the rail mesh would be
+	constexpr float QueryOffset = 40.0f;
+
+	// Compare every native rail query against the spline queries the Blueprint rail used
+	void TestRailMatchesSpline(FAutomationTestBase& Test, const AGrindRail* Rail, const TCHAR* Context)
+	{
+		const USplineComponent* Spline = Rail->RailSpline;
+		const float SplineLength = Spline->GetSplineLength();
+		Test.TestEqual(FString::Printf(TEXT("%s length"), Context), Rail->GetRailLength(), SplineLength, DistanceTolerance);
+
+		for (float Distance = 0.0f; Distance <= SplineLength; Distance += DistanceStep)
+		{
+			const FString What = FString::Printf(TEXT("%s at %.0f"), Context, Distance);
+
+			const FVector SplineLocation = Spline->GetLocationAtDistanceAlongSpline(Distance, ESplineCoordinateSpace::World);
+			const FVector SplineTangent = Spline->GetTangentAtDistanceAlongSpline(Distance, ESplineCoordinateSpace::World);
+			Test.TestTrue(What + TEXT(" location"), Rail->GetRailLocationAtDistance(Distance).Equals(SplineLocation, LocationTolerance));
+			Test.TestTrue(What + TEXT(" tangent"), Rail->GetRailTangentAtDistance(Distance).Equals(SplineTangent, SplineTangent.Size() * TangentRelativeTolerance));
+
+			const FVector Side = FVector::CrossProduct(SplineTangent, FVector::UpVector).GetSafeNormal();
+			const FVector QueryLocation = SplineLocation + (Side + FVector::UpVector).GetSafeNormal() * QueryOffset;
+
+			const float SplineInputKey = Spline->FindInputKeyClosestToWorldLocation(QueryLocation);
+			Test.TestEqual(What + TEXT(" closest distance"), Rail->GetRailDistanceClosestToLocation(QueryLocation), Spline->GetDistanceAlongSplineAtSplineInputKey(SplineInputKey), DistanceTolerance);
+			Test.TestTrue(What + TEXT(" closest point"), Rail->GetRailClosestPoint(QueryLocation).Equals(Spline->FindLocationClosestToWorldLocation(QueryLocation, ESplineCoordinateSpace::World), LocationTolerance));
+
+			const FVector SplineClosestTangent = Spline->FindTangentClosestToWorldLocation(QueryLocation, ESplineCoordinateSpace::World);
+			Test.TestTrue(What + TEXT(" closest tangent"), Rail->FindRailTangentNearLocation(QueryLocation).Equals(SplineClosestTangent, SplineClosestTangent.Size() * TangentRelativeTolerance));
+		}
+	}
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FGrindRailMatchesSplineTest, "OuterWildsVentures.Skate.GrindRail.MatchesSpline",
+	EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+bool FGrindRailMatchesSplineTest::RunTest(const FString& Parameters)
+{
+	using namespace GrindRailTest;
+
+	UWorld* World = UWorld::CreateWorld(EWorldType::Game, false);
+	FWorldContext& WorldContext = GEngine->CreateNewWorldContext(EWorldType::Game);
+	WorldContext.SetCurrentWorld(World);
+
+	// Rotated and away from the origin, so the table is exercised in actor space
+	const FTransform RailTransform(FRotator(10.0f, 35.0f, 0.0f), FVector(1000.0f, -500.0f, 200.0f));
+	AGrindRail* Rail = World->SpawnActor<AGrindRail>(AGrindRail::StaticClass(), RailTransform);
+	if (TestNotNull(TEXT("Rail"), Rail))
+	{
+		Rail->RailSpline->ClearSplinePoints(false);
+		for (const FVector& Point : { FVector(0.0f, 0.0f, 0.0f), FVector(400.0f, 300.0f, 0.0f), FVector(800.0f, -200.0f, 100.0f), FVector(1200.0f, 0.0f, 50.0f) })
+		{
+			Rail->RailSpline->AddSplinePoint(Point, ESplineCoordinateSpace::Local, false);
+		}
+		Rail->RailSpline->UpdateSpline();
+		Rail->BakeRailTable();
+
+		if (TestTrue(TEXT("Rail table"), Rail->HasRailTable()))
+		{
+			TestRailMatchesSpline(*this, Rail, TEXT("Baked"));
+
+			// The table is kept relative to the rail, so it still holds after the rail moves
+			Rail->SetActorLocationAndRotation(FVector(-300.0f, 800.0f, 50.0f), FRotator(0.0f, -60.0f, 5.0f));
+			TestRailMatchesSpline(*this, Rail, TEXT("Moved"));
+		}
+	}
+
+	GEngine->DestroyWorldContext(World);
+	World->DestroyWorld(false);
+	return true;
+}
+
+#endif
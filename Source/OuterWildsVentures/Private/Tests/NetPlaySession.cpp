@@ -0,0 +1,68 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "Tests/NetPlaySession.h"
+
+#if WITH_DEV_AUTOMATION_TESTS && WITH_EDITOR
+
+#include "Editor.h"
+#include "Engine/Engine.h"
+#include "Engine/World.h"
+
+bool NetPlaySession::Start(EPlayNetMode NetMode, int32 PacketLagMilliseconds, int32 PacketLossPercent)
+{
+	if (!GEditor || GEditor->IsPlaySessionInProgress())
+	{
+		return false;
+	}
+
+	ULevelEditorPlaySettings* PlaySettings = NewObject<ULevelEditorPlaySettings>();
+	PlaySettings->SetPlayNetMode(NetMode);
+	PlaySettings->SetPlayNumberOfClients(NetMode == PIE_ListenServer ? 2 : 1);
+	PlaySettings->SetRunUnderOneProcess(true);
+	PlaySettings->bLaunchSeparateServer = NetMode == PIE_Client;
+
+	// Same as -PktLag and -PktLoss on a game instance
+	FLevelEditorPlayNetworkEmulationSettings& Emulation = PlaySettings->NetworkEmulationSettings;
+	Emulation.bIsNetworkEmulationEnabled = true;
+	Emulation.EmulationTarget = NetworkEmulationTarget::Any;
+	Emulation.OutPackets.MinLatency = PacketLagMilliseconds;
+	Emulation.OutPackets.MaxLatency = PacketLagMilliseconds;
+	Emulation.OutPackets.PacketLossPercentage = PacketLossPercent;
+	Emulation.InPackets = Emulation.OutPackets;
+
+	FRequestPlaySessionParams Params;
+	Params.WorldType = EPlaySessionWorldType::PlayInEditor;
+	Params.SessionDestination = EPlaySessionDestinationType::InProcess;
+	Params.EditorPlaySettings = PlaySettings;
+	GEditor->RequestPlaySession(Params);
+	return true;
+}
+
+UWorld* NetPlaySession::FindWorld(ENetMode NetMode)
+{
+	for (const FWorldContext& Context : GEngine->GetWorldContexts())
+	{
+		UWorld* World = Context.World();
+		if (Context.WorldType == EWorldType::PIE && World && World->HasBegunPlay() && World->GetNetMode() == NetMode)
+		{
+			return World;
+		}
+	}
+	return nullptr;
+}
+
+void NetPlaySession::End()
+{
+	if (GEditor && GEditor->IsPlaySessionInProgress())
+	{
+		GEditor->RequestEndPlayMap();
+	}
+}
+
+bool FEndNetPlaySessionCommand::Update()
+{
+	NetPlaySession::End();
+	return true;
+}
+
+#endif
@@ -0,0 +1,31 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#if WITH_DEV_AUTOMATION_TESTS && WITH_EDITOR
+
+#include "Misc/AutomationTest.h"
+#include "Settings/LevelEditorPlaySettings.h"
+
+/**
+ * Networked play in editor sessions for automation tests. The server and one client run in this process, with packet
+ * lag and loss emulated on both ends.
+ */
+namespace NetPlaySession
+{
+	// Start a session on the map open in the editor. Returns false if the editor cannot start one.
+	bool Start(EPlayNetMode NetMode, int32 PacketLagMilliseconds, int32 PacketLossPercent);
+
+	// World of the session with a net mode. Null until it has begun play.
+	UWorld* FindWorld(ENetMode NetMode);
+
+	// End the session if one is running
+	void End();
+}
+
+// Ends the session once the commands before it are done
+DEFINE_LATENT_AUTOMATION_COMMAND(FEndNetPlaySessionCommand);
+
+#endif
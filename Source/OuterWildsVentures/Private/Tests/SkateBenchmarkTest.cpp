@@ -0,0 +1,72 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "Misc/AutomationTest.h"
+#include "Skate/SkateHarnessSubsystem.h"
+#include "Tests/AutomationCommon.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace SkateBenchmarkTest
+{
+	// Pump up to speed, carve both ways, then ollie
+	const TCHAR* Script = TEXT(
+		"0 Pump 1\n"
+		"120 Pump 0\n"
+		"120 Lean 1\n"
+		"240 Lean -1\n"
+		"360 Lean 0\n"
+		"360 Ollie 1\n"
+		"370 Ollie 0\n"
+		"480 End\n");
+
+	const TCHAR* MapName = TEXT("/Game/OWV/Maps/Test");
+
+	// Same as a command line benchmark without a list
+	const int32 SkaterCounts[] = { 1, 10, 50, 200 };
+
+	// Longer than every case with its warmup takes, even on a slow build machine
+	constexpr double TimeoutSeconds = 1800.0;
+}
+
+DEFINE_LATENT_AUTOMATION_COMMAND_ONE_PARAMETER(FWaitForSkateBenchmarkCommand, FAutomationTestBase*, Test);
+
+bool FWaitForSkateBenchmarkCommand::Update()
+{
+	bool bSucceeded = false;
+	if (USkateHarnessSubsystem::IsRequestedBenchmarkDone(bSucceeded))
+	{
+		Test->TestTrue(TEXT("Benchmark wrote its results"), bSucceeded);
+		return true;
+	}
+
+	if (GetCurrentRunTime() > SkateBenchmarkTest::TimeoutSeconds)
+	{
+		USkateHarnessSubsystem::CancelRequestedBenchmark();
+		Test->AddError(TEXT("Benchmark did not finish in time"));
+		return true;
+	}
+	return false;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FSkateBenchmarkTest, "OuterWildsVentures.Skate.Benchmark",
+	EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::PerfFilter)
+
+bool FSkateBenchmarkTest::RunTest(const FString& Parameters)
+{
+	using namespace SkateBenchmarkTest;
+
+	// Results are written to Saved/SkateHarness/SkateBenchmarkTest-Benchmark.json, like a command line benchmark.
+	// Skaters ticked by their actors and skaters ticked by the crowd are both measured.
+	USkateHarnessSubsystem::RequestBenchmark(TEXT("SkateBenchmarkTest"), Script, TArray<int32>(SkaterCounts, UE_ARRAY_COUNT(SkaterCounts)), true);
+	if (!AutomationOpenMap(MapName))
+	{
+		USkateHarnessSubsystem::CancelRequestedBenchmark();
+		AddError(FString::Printf(TEXT("Cannot open %s"), MapName));
+		return false;
+	}
+
+	ADD_LATENT_AUTOMATION_COMMAND(FWaitForSkateBenchmarkCommand(this));
+	return true;
+}
+
+#endif
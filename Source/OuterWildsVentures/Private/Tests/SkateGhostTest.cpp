@@ -0,0 +1,125 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "HAL/FileManager.h"
+#include "Misc/AutomationTest.h"
+#include "Misc/Paths.h"
+#include "Skate/SkateGhost.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace SkateGhostTest
+{
+	constexpr int32 FrameCount = 30;
+	constexpr int32 FramesPerChunk = 8;
+
+	// Frame at which the skater jumps further than a delta can hold, forcing a chunk to end early
+	constexpr int32 TeleportFrame = 20;
+
+	FSkateReplayFrame MakeFrame(int32 FrameNumber)
+	{
+		FSkateReplayFrame Frame;
+		Frame.Location = FVector(FrameNumber * 12.34, FrameNumber * -4.56, 100.0 + FMath::Sin(FrameNumber * 0.5) * 50.0);
+		if (FrameNumber >= TeleportFrame)
+		{
+			Frame.Location.X += 100000.0;
+		}
+		Frame.Rotation = FRotator(FrameNumber * 1.5, FrameNumber * 17.0, -FrameNumber * 0.75);
+		Frame.SkateMode = static_cast<ESkateMode>(FrameNumber % 3);
+		Frame.GrindDistance = Frame.SkateMode == ESkateMode::Grind ? FrameNumber * 10.5f : 0.0f;
+		return Frame;
+	}
+
+	void TestFrame(FAutomationTestBase& Test, int32 FrameNumber, const FSkateReplayFrame& Frame)
+	{
+		const FSkateReplayFrame Expected = MakeFrame(FrameNumber);
+		const FString What = FString::Printf(TEXT("Frame %d"), FrameNumber);
+		Test.TestTrue(What + TEXT(" location"), Frame.Location.Equals(Expected.Location, FSkateReplayCodec::LocationQuantum));
+		Test.TestTrue(What + TEXT(" rotation"), Frame.Rotation.Equals(Expected.Rotation, 0.01f));
+		Test.TestEqual(What + TEXT(" skate mode"), static_cast<int32>(Frame.SkateMode.GetValue()), static_cast<int32>(Expected.SkateMode.GetValue()));
+		if (Expected.SkateMode == ESkateMode::Grind)
+		{
+			Test.TestEqual(What + TEXT(" grind distance"), Frame.GrindDistance, Expected.GrindDistance, FSkateReplayCodec::LocationQuantum);
+		}
+		Test.TestNull(What + TEXT(" skater animation"), Frame.SkaterAnimation);
+	}
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FSkateGhostRoundTripTest, "OuterWildsVentures.Skate.Ghost.RoundTrip",
+	EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+bool FSkateGhostRoundTripTest::RunTest(const FString& Parameters)
+{
+	using namespace SkateGhostTest;
+
+	const FString FilePath = FPaths::CreateTempFilename(*FPaths::ProjectSavedDir(), TEXT("SkateGhostTest"), TEXT(".skghost"));
+
+	FSkateGhostWriter Writer;
+	if (!TestTrue(TEXT("Begin"), Writer.Begin(FilePath, 1.0f / 60.0f, FramesPerChunk)))
+	{
+		return false;
+	}
+	for (int32 FrameNumber = 0; FrameNumber < FrameCount; FrameNumber++)
+	{
+		Writer.WriteFrame(MakeFrame(FrameNumber));
+	}
+	TestTrue(TEXT("End"), Writer.End());
+
+	// Chunks are full except the one cut short by the teleport and the last one
+	{
+		TUniquePtr<FArchive> FileReader(IFileManager::Get().CreateFileReader(*FilePath));
+		if (TestNotNull(TEXT("Ghost file"), FileReader.Get()))
+		{
+			FSkateGhostHeader Header;
+			*FileReader << Header;
+			TestEqual(TEXT("Header frame count"), Header.FrameCount, static_cast<uint32>(FrameCount));
+
+			const TArray<uint32> ExpectedFirstFrames = { 0, 8, 16, TeleportFrame, 28 };
+			if (TestEqual(TEXT("Chunk count"), Header.ChunkCount, static_cast<uint32>(ExpectedFirstFrames.Num())))
+			{
+				FileReader->Seek(Header.ChunkIndexOffset);
+				for (int32 ChunkIndex = 0; ChunkIndex < ExpectedFirstFrames.Num(); ChunkIndex++)
+				{
+					FSkateGhostChunkIndexEntry Entry;
+					*FileReader << Entry;
+					TestEqual(FString::Printf(TEXT("Chunk %d first frame"), ChunkIndex), Entry.FirstFrame, ExpectedFirstFrames[ChunkIndex]);
+				}
+			}
+		}
+	}
+
+	{
+		FSkateGhostReader Reader;
+		if (TestTrue(TEXT("Open"), Reader.Open(FilePath)))
+		{
+			TestEqual(TEXT("Frame count"), Reader.GetFrameCount(), FrameCount);
+			TestEqual(TEXT("Step seconds"), Reader.GetStepSeconds(), 1.0f / 60.0f);
+
+			FSkateReplayFrame Frame;
+			for (int32 FrameNumber = 0; FrameNumber < FrameCount; FrameNumber++)
+			{
+				if (!TestTrue(FString::Printf(TEXT("Read frame %d"), FrameNumber), Reader.ReadFrame(Frame)))
+				{
+					break;
+				}
+				TestFrame(*this, FrameNumber, Frame);
+			}
+			TestFalse(TEXT("Read past the end"), Reader.ReadFrame(Frame));
+
+			// Either side of every chunk boundary, going backwards as well as forwards
+			for (const int32 FrameNumber : { 29, 0, 7, 8, 9, 19, 20, 21, 15, 16, 27, 28 })
+			{
+				if (TestTrue(FString::Printf(TEXT("Seek %d"), FrameNumber), Reader.Seek(FrameNumber)) && Reader.ReadFrame(Frame))
+				{
+					TestFrame(*this, FrameNumber, Frame);
+				}
+			}
+			TestFalse(TEXT("Seek past the end"), Reader.Seek(FrameCount));
+			TestFalse(TEXT("Seek before the start"), Reader.Seek(-1));
+		}
+	}
+
+	IFileManager::Get().Delete(*FilePath);
+	return true;
+}
+
+#endif
@@ -0,0 +1,267 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "EngineUtils.h"
+#include "EnhancedInputSubsystems.h"
+#include "InputAction.h"
+#include "Misc/AutomationTest.h"
+#include "Skate/SkateHarnessSubsystem.h"
+#include "Skate/SkateNet.h"
+#include "Skate/Skater.h"
+#include "Tests/AutomationCommon.h"
+#include "Tests/NetPlaySession.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace SkateNetTest
+{
+	FSkateNetInput MakeInput(uint16 Sequence, bool bPump = false, bool bOllie = false)
+	{
+		FSkateNetInput Input;
+		Input.Sequence = Sequence;
+		Input.bPump = bPump;
+		Input.bOllie = bOllie;
+		return Input;
+	}
+
+	// Pop a frame and check its sequence
+	void TestPop(FAutomationTestBase& Test, FSkateNetInputQueue& Queue, uint16 ExpectedSequence, const TCHAR* What)
+	{
+		FSkateNetInput Input;
+		if (Test.TestTrue(FString::Printf(TEXT("%s pops"), What), Queue.Pop(Input)))
+		{
+			Test.TestEqual(FString::Printf(TEXT("%s sequence"), What), static_cast<int32>(Input.Sequence), static_cast<int32>(ExpectedSequence));
+		}
+	}
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FSkateNetInputQueueTest, "OuterWildsVentures.Skate.Net.InputQueue",
+	EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+bool FSkateNetInputQueueTest::RunTest(const FString& Parameters)
+{
+	using namespace SkateNetTest;
+
+	FSkateNetInputQueue Queue;
+	FSkateNetInput Input;
+	TestFalse(TEXT("Nothing to pop or hold before the first frame"), Queue.Pop(Input));
+
+	// Two packets bunched into one server tick, each with the previous frame along
+	Queue.Add(MakeInput(1));
+	Queue.Add(MakeInput(2, true));
+	Queue.Add(MakeInput(2, true));
+	Queue.Add(MakeInput(3));
+	TestEqual(TEXT("Redundant frame queued once"), Queue.Num(), 3);
+	TestPop(*this, Queue, 1, TEXT("First tick"));
+	TestPop(*this, Queue, 2, TEXT("Second tick"));
+	TestPop(*this, Queue, 3, TEXT("Third tick"));
+
+	// Late and repeated frames are not applied again
+	Queue.Add(MakeInput(2, true));
+	Queue.Add(MakeInput(3));
+	TestEqual(TEXT("Frames already taken are dropped"), Queue.Num(), 0);
+
+	// Out of order arrival is put back in order
+	Queue.Add(MakeInput(5));
+	Queue.Add(MakeInput(4, false, true));
+	TestPop(*this, Queue, 4, TEXT("Reordered first"));
+
+	// Nothing arrives for a tick. The last frame is held without its ollie.
+	TestPop(*this, Queue, 5, TEXT("Reordered second"));
+	Queue.Add(MakeInput(6, true, true));
+	TestPop(*this, Queue, 6, TEXT("Before hold"));
+	if (TestTrue(TEXT("Held frame"), Queue.Pop(Input)))
+	{
+		TestEqual(TEXT("Held frame sequence"), static_cast<int32>(Input.Sequence), 6);
+		TestTrue(TEXT("Held frame keeps pump"), Input.bPump);
+		TestFalse(TEXT("Held frame drops ollie"), Input.bOllie);
+	}
+	TestEqual(TEXT("Last sequence"), static_cast<int32>(Queue.GetLastSequence()), 6);
+
+	// Falling far behind folds the oldest frames without losing their ollie
+	Queue.Add(MakeInput(7, false, true));
+	for (uint16 Sequence = 8; Sequence < 8 + FSkateNetInputQueue::MaxQueued; Sequence++)
+	{
+		Queue.Add(MakeInput(Sequence));
+	}
+	TestEqual(TEXT("Queue is capped"), Queue.Num(), FSkateNetInputQueue::MaxQueued);
+	if (TestTrue(TEXT("Folded frame"), Queue.Pop(Input)))
+	{
+		TestEqual(TEXT("Folded frame sequence"), static_cast<int32>(Input.Sequence), 8);
+		TestTrue(TEXT("Folded frame keeps ollie"), Input.bOllie);
+	}
+
+	// Sequences wrap past 0, which is never sent
+	FSkateNetInputQueue WrapQueue;
+	WrapQueue.Add(MakeInput(MAX_uint16));
+	WrapQueue.Add(MakeInput(1));
+	WrapQueue.Add(MakeInput(MAX_uint16 - 1));
+	TestPop(*this, WrapQueue, MAX_uint16 - 1, TEXT("Before wrap"));
+	TestPop(*this, WrapQueue, MAX_uint16, TEXT("At wrap"));
+	TestPop(*this, WrapQueue, 1, TEXT("After wrap"));
+	return true;
+}
+
+#if WITH_EDITOR
+
+namespace SkateNetTest
+{
+	const TCHAR* MapName = TEXT("/Game/OWV/Maps/Test");
+
+	// Steady lag, so every input frame arrives and the server's applied sequence counts the frames it applied
+	constexpr int32 PacketLagMilliseconds = 100;
+
+	constexpr double SessionTimeoutSeconds = 60.0;
+
+	// Frames the client is driven, then frames left for the server to catch up
+	constexpr int32 DriveFrames = 480;
+	constexpr int32 SettleFrames = 60;
+
+	struct FListenServerSession
+	{
+		TWeakObjectPtr<ASkater> ClientSkater;
+		TWeakObjectPtr<ASkater> ServerSkater;
+		int32 Frame = 0;
+
+		uint16 LastAppliedSequence = 0;
+		int32 AppliedFrames = 0;
+		int32 MostAppliedInOneTick = 0;
+	};
+
+	// Skater of the client player, as seen by the client or the server
+	ASkater* FindClientSkater(UWorld* World, bool bOnServer)
+	{
+		for (TActorIterator<ASkater> It(World); It; ++It)
+		{
+			if (It->IsPlayerControlled() && It->IsLocallyControlled() != bOnServer && It->SkatePhysics)
+			{
+				return *It;
+			}
+		}
+		return nullptr;
+	}
+
+	// Pump to speed while carving both ways, with an ollie in the middle
+	void InjectClientInput(ASkater* Skater, int32 Frame)
+	{
+		const APlayerController* PlayerController = Cast<APlayerController>(Skater->GetController());
+		UEnhancedInputLocalPlayerSubsystem* InputSubsystem = PlayerController ? ULocalPlayer::GetSubsystem<UEnhancedInputLocalPlayerSubsystem>(PlayerController->GetLocalPlayer()) : nullptr;
+		if (!InputSubsystem)
+		{
+			return;
+		}
+
+		const auto Inject = [Skater, InputSubsystem](ESkateHarnessAction Action, float Value)
+		{
+			if (const UInputAction* InputAction = USkateHarnessSubsystem::GetInputAction(Skater, Action))
+			{
+				InputSubsystem->InjectInputForAction(InputAction, FInputActionValue(InputAction->ValueType, FVector(Value, 0.0, 0.0)));
+			}
+		};
+
+		if (Frame < 120)
+		{
+			Inject(ESkateHarnessAction::Pump, 1.0f);
+		}
+		if (Frame >= 120 && Frame < 360)
+		{
+			Inject(ESkateHarnessAction::Lean, (Frame / 60) % 2 == 0 ? 1.0f : -1.0f);
+		}
+		if (Frame >= 360 && Frame < 370)
+		{
+			Inject(ESkateHarnessAction::Ollie, 1.0f);
+		}
+	}
+}
+
+DEFINE_LATENT_AUTOMATION_COMMAND_TWO_PARAMETER(FWaitForSkateListenServerCommand, FAutomationTestBase*, Test, TSharedRef<SkateNetTest::FListenServerSession>, Session);
+
+bool FWaitForSkateListenServerCommand::Update()
+{
+	using namespace SkateNetTest;
+
+	UWorld* ServerWorld = NetPlaySession::FindWorld(NM_ListenServer);
+	UWorld* ClientWorld = NetPlaySession::FindWorld(NM_Client);
+	Session->ServerSkater = ServerWorld ? FindClientSkater(ServerWorld, true) : nullptr;
+	Session->ClientSkater = ClientWorld ? FindClientSkater(ClientWorld, false) : nullptr;
+	if (Session->ServerSkater.IsValid() && Session->ClientSkater.IsValid())
+	{
+		return true;
+	}
+
+	if (GetCurrentRunTime() > SessionTimeoutSeconds)
+	{
+		Test->AddError(TEXT("Client skater did not spawn on the listen server"));
+		return true;
+	}
+	return false;
+}
+
+DEFINE_LATENT_AUTOMATION_COMMAND_TWO_PARAMETER(FDriveSkateListenServerCommand, FAutomationTestBase*, Test, TSharedRef<SkateNetTest::FListenServerSession>, Session);
+
+bool FDriveSkateListenServerCommand::Update()
+{
+	using namespace SkateNetTest;
+
+	ASkater* ClientSkater = Session->ClientSkater.Get();
+	ASkater* ServerSkater = Session->ServerSkater.Get();
+	if (!ClientSkater || !ServerSkater)
+	{
+		// Also the case if the session failed to start
+		return true;
+	}
+
+	if (Session->Frame < DriveFrames)
+	{
+		InjectClientInput(ClientSkater, Session->Frame);
+	}
+
+	// Both worlds tick once per update. Every frame arrives, so the sequence moves on by the frames applied this tick.
+	const uint16 AppliedSequence = ServerSkater->GetLastAppliedNetInputSequence();
+	if (Session->LastAppliedSequence != 0)
+	{
+		const int32 AppliedThisTick = static_cast<uint16>(AppliedSequence - Session->LastAppliedSequence);
+		Session->AppliedFrames += AppliedThisTick;
+		Session->MostAppliedInOneTick = FMath::Max(Session->MostAppliedInOneTick, AppliedThisTick);
+	}
+	Session->LastAppliedSequence = AppliedSequence;
+
+	if (++Session->Frame < DriveFrames + SettleFrames)
+	{
+		return false;
+	}
+
+	Test->TestTrue(TEXT("Server applied the client's input"), Session->AppliedFrames >= DriveFrames);
+	Test->TestTrue(TEXT("Server applied at most one input frame per tick"), Session->MostAppliedInOneTick <= 1);
+	Test->TestTrue(TEXT("Pumps moved the skater on the server"), ServerSkater->SkatePhysics->GetSkatePhysicsVelocity().Size() > 100.0);
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FSkateListenServerTest, "OuterWildsVentures.Skate.Net.ListenServer",
+	EAutomationTestFlags::EditorContext | EAutomationTestFlags::ProductFilter)
+
+bool FSkateListenServerTest::RunTest(const FString& Parameters)
+{
+	using namespace SkateNetTest;
+
+	if (!AutomationOpenMap(MapName))
+	{
+		AddError(FString::Printf(TEXT("Cannot open %s"), MapName));
+		return false;
+	}
+	if (!NetPlaySession::Start(PIE_ListenServer, PacketLagMilliseconds, 0))
+	{
+		AddError(TEXT("Cannot start a listen server play session"));
+		return false;
+	}
+
+	// A client driving its skater through lagged packets. The server queues its input and applies one frame a tick.
+	const TSharedRef<FListenServerSession> Session = MakeShared<FListenServerSession>();
+	ADD_LATENT_AUTOMATION_COMMAND(FWaitForSkateListenServerCommand(this, Session));
+	ADD_LATENT_AUTOMATION_COMMAND(FDriveSkateListenServerCommand(this, Session));
+	ADD_LATENT_AUTOMATION_COMMAND(FEndNetPlaySessionCommand());
+	return true;
+}
+
+#endif
+
+#endif